@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "rest.h"
+#include "net/sec-stats.h"
+#include "sec-stats-resources.h"
+
+#define BUFLEN 96
+
+static char buf[BUFLEN];
+/*---------------------------------------------------------------------------*/
+static void
+reply(RESPONSE *response, int len)
+{
+  if(len >= BUFLEN) {
+    len = BUFLEN - 1;
+  }
+  rest_set_header_content_type(response, TEXT_PLAIN);
+  rest_set_response_payload(response, (uint8_t *)buf, len);
+}
+/*---------------------------------------------------------------------------*/
+#if SEC_STATS_ENABLED
+static int
+print_histogram(int len, const char *name, uint16_t *histogram)
+{
+  int i;
+
+  len += snprintf(buf + len, BUFLEN - len, "%s", name);
+  for(i = 0; i < SEC_STATS_BUCKETS && len < BUFLEN; i++) {
+    len += snprintf(buf + len, BUFLEN - len, " %u", histogram[i]);
+  }
+  return len;
+}
+#endif /* SEC_STATS_ENABLED */
+/*---------------------------------------------------------------------------*/
+RESOURCE(handshake, METHOD_GET, "secstats/handshake");
+void
+handshake_handler(REQUEST *request, RESPONSE *response)
+{
+#if SEC_STATS_ENABLED
+  int len;
+
+  len = snprintf(buf, BUFLEN, "ok %u failed %u rexmit %u cpu %lu radio %lu\n",
+                 sec_stats.handshakes, sec_stats.handshakes_failed,
+                 sec_stats.retransmissions,
+                 (unsigned long)sec_stats.handshake_cpu,
+                 (unsigned long)sec_stats.handshake_radio);
+  if(len < BUFLEN) {
+    len = print_histogram(len, "time", sec_stats.handshake_time);
+  }
+  reply(response, len);
+#else /* SEC_STATS_ENABLED */
+  reply(response, snprintf(buf, BUFLEN, "disabled"));
+#endif /* SEC_STATS_ENABLED */
+}
+/*---------------------------------------------------------------------------*/
+RESOURCE(records, METHOD_GET, "secstats/records");
+void
+records_handler(REQUEST *request, RESPONSE *response)
+{
+#if SEC_STATS_ENABLED
+  reply(response,
+        snprintf(buf, BUFLEN,
+                 "wire %lu/%lu app %lu/%lu ccm %lu/%lu prf %u",
+                 (unsigned long)sec_stats.wire_out,
+                 (unsigned long)sec_stats.wire_in,
+                 (unsigned long)sec_stats.app_out,
+                 (unsigned long)sec_stats.app_in,
+                 (unsigned long)sec_stats.ccm_bytes,
+                 (unsigned long)sec_stats.ccm_ticks,
+                 sec_stats.prf_calls));
+#else /* SEC_STATS_ENABLED */
+  reply(response, snprintf(buf, BUFLEN, "disabled"));
+#endif /* SEC_STATS_ENABLED */
+}
+/*---------------------------------------------------------------------------*/
+RESOURCE(drops, METHOD_GET, "secstats/drops");
+void
+drops_handler(REQUEST *request, RESPONSE *response)
+{
+#if SEC_STATS_ENABLED
+  reply(response,
+        snprintf(buf, BUFLEN,
+                 "replay %u mac %u unexpected %u malformed %u nosession %u",
+                 sec_stats.dropped[SEC_STATS_DROP_REPLAY],
+                 sec_stats.dropped[SEC_STATS_DROP_MAC],
+                 sec_stats.dropped[SEC_STATS_DROP_UNEXPECTED],
+                 sec_stats.dropped[SEC_STATS_DROP_MALFORMED],
+                 sec_stats.dropped[SEC_STATS_DROP_NO_SESSION]));
+#else /* SEC_STATS_ENABLED */
+  reply(response, snprintf(buf, BUFLEN, "disabled"));
+#endif /* SEC_STATS_ENABLED */
+}
+/*---------------------------------------------------------------------------*/
+void
+sec_stats_resources_init(void)
+{
+  rest_activate_resource(&resource_handshake);
+  rest_activate_resource(&resource_records);
+  rest_activate_resource(&resource_drops);
+}
+/*---------------------------------------------------------------------------*/
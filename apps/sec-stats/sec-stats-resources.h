@@ -0,0 +1,14 @@
+/**
+ * \file
+ *         REST resources with the DTLS/TLS counters of core/net/sec-stats:
+ *         secstats/handshake, secstats/records and secstats/drops.
+ *         Build with APPS += sec-stats rest-coap (or rest-http) and call
+ *         sec_stats_resources_init() after rest_init().
+ */
+
+#ifndef __SEC_STATS_RESOURCES_H__
+#define __SEC_STATS_RESOURCES_H__
+
+void sec_stats_resources_init(void);
+
+#endif /* __SEC_STATS_RESOURCES_H__ */
@@ -0,0 +1,114 @@
+/**
+ * \file
+ *         "secstats": handshake times, record layer costs and dropped
+ *         records of the DTLS and TLS engines, see core/net/sec-stats.h.
+ *         "secstats reset" clears them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "shell.h"
+#include "net/sec-stats.h"
+
+#define BUFLEN 64
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_sec_stats_process, "secstats");
+SHELL_COMMAND(sec_stats_command,
+	      "secstats",
+	      "secstats [reset]: DTLS/TLS handshake and record counters",
+	      &shell_sec_stats_process);
+/*---------------------------------------------------------------------------*/
+#if SEC_STATS_ENABLED
+static char *drops[SEC_STATS_DROP_MAX] =
+  { "replay", "mac", "unexpected", "malformed", "no session" };
+
+static void
+print_histogram(char *name, uint16_t *histogram)
+{
+  char buf[BUFLEN];
+  int len, i;
+
+  len = 0;
+  for(i = 0; i < SEC_STATS_BUCKETS; i++) {
+    len += snprintf(buf + len, sizeof(buf) - len, " %u", histogram[i]);
+    if(len >= sizeof(buf)) {
+      break;
+    }
+  }
+  shell_output_str(&sec_stats_command, name, buf);
+}
+#endif /* SEC_STATS_ENABLED */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_sec_stats_process, ev, data)
+{
+#if SEC_STATS_ENABLED
+  char buf[BUFLEN];
+  char name[16];
+  struct timetable_timestamp *t;
+  int i, n;
+#endif /* SEC_STATS_ENABLED */
+
+  PROCESS_BEGIN();
+
+#if SEC_STATS_ENABLED
+  if(data != NULL && strncmp(data, "reset", 5) == 0) {
+    sec_stats_reset();
+    shell_output_str(&sec_stats_command, "cleared", "");
+    PROCESS_EXIT();
+  }
+
+  snprintf(buf, sizeof(buf), "%u, failed %u, retransmissions %u",
+	   sec_stats.handshakes, sec_stats.handshakes_failed,
+	   sec_stats.retransmissions);
+  shell_output_str(&sec_stats_command, "handshakes ", buf);
+  snprintf(buf, sizeof(buf), "%lu, radio %lu",
+	   (unsigned long)sec_stats.handshake_cpu,
+	   (unsigned long)sec_stats.handshake_radio);
+  shell_output_str(&sec_stats_command, "handshake energest cpu ", buf);
+  snprintf(buf, sizeof(buf), "ms buckets from %u, doubling",
+	   SEC_STATS_BUCKET_MS);
+  shell_output_str(&sec_stats_command, "", buf);
+  print_histogram("handshake time", sec_stats.handshake_time);
+  for(i = 0; i < SEC_STATS_FLIGHTS; i++) {
+    snprintf(name, sizeof(name), "flight %d time", i + 1);
+    print_histogram(name, sec_stats.flight_time[i]);
+  }
+  snprintf(buf, sizeof(buf), "%u, ccm %lu bytes in %lu rtimer ticks",
+	   sec_stats.prf_calls, (unsigned long)sec_stats.ccm_bytes,
+	   (unsigned long)sec_stats.ccm_ticks);
+  shell_output_str(&sec_stats_command, "prf ", buf);
+  snprintf(buf, sizeof(buf), "%lu/%lu, application %lu/%lu",
+	   (unsigned long)sec_stats.wire_out, (unsigned long)sec_stats.wire_in,
+	   (unsigned long)sec_stats.app_out, (unsigned long)sec_stats.app_in);
+  shell_output_str(&sec_stats_command, "bytes out/in wire ", buf);
+  for(i = 0; i < SEC_STATS_DROP_MAX; i++) {
+    snprintf(buf, sizeof(buf), " %u", sec_stats.dropped[i]);
+    shell_output_str(&sec_stats_command, drops[i], buf);
+  }
+
+  /* oldest first, the slot at ptr is the next one to be overwritten */
+  n = timetable_ptr(&sec_stats_timetable);
+  for(i = 0; i < SEC_STATS_TIMETABLE_SIZE; i++) {
+    t = timetable_entry(&sec_stats_timetable,
+			(n + i) % SEC_STATS_TIMETABLE_SIZE);
+    if(t->id != NULL) {
+      snprintf(buf, sizeof(buf), " %u", (unsigned)t->time);
+      shell_output_str(&sec_stats_command, (char *)t->id, buf);
+    }
+  }
+#else /* SEC_STATS_ENABLED */
+  shell_output_str(&sec_stats_command, "disabled, build with SEC_STATS=1", "");
+#endif /* SEC_STATS_ENABLED */
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_sec_stats_init(void)
+{
+  shell_register_command(&sec_stats_command);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,13 @@
+/**
+ * \file
+ *         Shell command that prints the DTLS/TLS counters of core/net/sec-stats
+ */
+
+#ifndef __SHELL_SEC_STATS_H__
+#define __SHELL_SEC_STATS_H__
+
+#include "shell.h"
+
+void shell_sec_stats_init(void);
+
+#endif /* __SHELL_SEC_STATS_H__ */
@@ -383,6 +383,7 @@ struct shell_input {
 #include "shell-rime.h"
 #include "shell-rsh.h"
 #include "shell-run.h"
+#include "shell-sec-stats.h"
 #include "shell-sendtest.h"
 #include "shell-sensortweet.h"
 #include "shell-sky.h"
@@ -65,6 +65,13 @@
   HASH_ADD(hh,head,sess,sizeof(session_t),add)
 #define HASH_DEL_PEER(head,delptr)		\
   HASH_DELETE(hh,head,delptr)
+#else /* WITH_CONTIKI */
+#define HASH_FIND_PEER(head,sess,out)		\
+  ((out) = dtls_peer_table_find((head),(sess)))
+#define HASH_ADD_PEER(head,sess,add)		\
+  dtls_peer_table_add((head),(add))
+#define HASH_DEL_PEER(head,delptr)		\
+  dtls_peer_table_del((head),(delptr))
 #endif /* WITH_CONTIKI */
 
 #define DTLS_RH_LENGTH sizeof(dtls_record_header_t)
@@ -158,6 +165,69 @@ static inline void
 dtls_free_peer(dtls_peer_t *peer) {
   memb_free(&peer_storage, peer);
 }
+
+/* The peer table is an open-addressing hash table over the peers'
+ * sessions with linear probing. It has more slots than there can be
+ * peers, so every probe sequence ends at an empty slot. */
+static unsigned int
+dtls_peer_slot(const session_t *session) {
+  const unsigned char *p = (const unsigned char *)&session->addr;
+  unsigned long h = 2166136261UL;	/* FNV-1a */
+  int i;
+
+  for (i = 0; i < sizeof(uip_ipaddr_t); i++)
+    h = (h ^ p[i]) * 16777619UL;
+  h = (h ^ (session->port & 0xff)) * 16777619UL;
+  h = (h ^ (session->port >> 8)) * 16777619UL;
+  h = (h ^ (session->ifindex & 0xff)) * 16777619UL;
+
+  return h % DTLS_PEER_HASH_SIZE;
+}
+
+static dtls_peer_t *
+dtls_peer_table_find(dtls_peer_t **table, const session_t *session) {
+  unsigned int i = dtls_peer_slot(session);
+
+  while (table[i]) {
+    if (dtls_session_equals(&table[i]->session, session))
+      return table[i];
+    i = (i + 1) % DTLS_PEER_HASH_SIZE;
+  }
+  return NULL;
+}
+
+static void
+dtls_peer_table_add(dtls_peer_t **table, dtls_peer_t *peer) {
+  unsigned int i = dtls_peer_slot(&peer->session);
+
+  while (table[i])
+    i = (i + 1) % DTLS_PEER_HASH_SIZE;
+  table[i] = peer;
+}
+
+static void
+dtls_peer_table_del(dtls_peer_t **table, dtls_peer_t *peer) {
+  unsigned int i, j, k;
+
+  for (i = dtls_peer_slot(&peer->session); table[i] != peer; 
+       i = (i + 1) % DTLS_PEER_HASH_SIZE)
+    if (!table[i])
+      return;
+
+  /* Close the gap by moving back later entries of the probe sequence
+   * whose home slot k does not lie cyclically in (i, j]. */
+  for (j = i;;) {
+    table[i] = NULL;
+    do {
+      j = (j + 1) % DTLS_PEER_HASH_SIZE;
+      if (!table[j])
+	return;
+      k = dtls_peer_slot(&table[j]->session);
+    } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+    table[i] = table[j];
+    i = j;
+  }
+}
 #endif /* WITH_CONTIKI */
 
 void
@@ -200,13 +270,7 @@ dtls_peer_t *
 dtls_get_peer(struct dtls_context_t *ctx, const session_t *session) {
   dtls_peer_t *p = NULL;
 
-#ifndef WITH_CONTIKI
   HASH_FIND_PEER(ctx->peers, session, p);
-#else /* WITH_CONTIKI */
-  for (p = list_head(ctx->peers); p; p = list_item_next(p))
-    if (dtls_session_equals(&p->session, session))
-      return p;
-#endif /* WITH_CONTIKI */
   
   return p;
 }
@@ -1904,16 +1968,13 @@ int
 dtls_read(dtls_context_t *ctx, session_t *session, uint8 *msg, size_t msglen) {
   netq_t *node;
 
-  printf("dtls_read()\n");
-  hexdump(msg, msglen);
-  printf("\n");
-  node = netq_node_new();
+  /* drop rather than truncate what does not fit into a node */
+  node = netq_node_new(msglen);
   if (!node)
     return -1;
 
   memcpy(&node->remote, session, sizeof(session_t));
-  /* incoming packet may be truncated when internal storage is too small */
-  node->length = min(msglen, sizeof(netq_packet_t));
+  node->length = msglen;
   memcpy(node->data, msg, node->length);
 
   netq_insert_node((netq_t **)ctx->recvqueue, node);
@@ -1964,10 +2025,7 @@ dtls_handle_message(dtls_context_t *ctx,
       printf("dtls_handle_message: FOUND PEER\n");
   }
 #else /* WITH_CONTIKI */
-  for (peer = list_head(ctx->peers); 
-       peer && !dtls_session_equals(&peer->session, session);
-       peer = list_item_next(peer))
-    ;
+  HASH_FIND_PEER(ctx->peers, session, peer);
 #endif /* WITH_CONTIKI */
 
   if (!peer) {			
@@ -2036,11 +2094,7 @@ dtls_handle_message(dtls_context_t *ctx,
       return -1;
     }
 
-#ifndef WITH_CONTIKI
     HASH_ADD_PEER(ctx->peers, session, peer);
-#else /* WITH_CONTIKI */
-    list_add(ctx->peers, peer);
-#endif /* WITH_CONTIKI */
     
     /* update finish MAC */
     update_hs_hash(peer, msg + DTLS_RH_LENGTH, rlen - DTLS_RH_LENGTH); 
@@ -2099,11 +2153,7 @@ dtls_handle_message(dtls_context_t *ctx,
       if (handle_alert(ctx, peer, msg, data, data_length)) {
 
 	/* invalidate peer */
-#ifndef WITH_CONTIKI
 	HASH_DEL_PEER(ctx->peers, peer);
-#else /* WITH_CONTIKI */
-	list_remove(ctx->peers, peer);
-#endif /* WITH_CONTIKI */
 
 	dtls_free_peer(peer);
 
@@ -2147,7 +2197,6 @@ dtls_new_context(void *app_data) {
   c->app = app_data;
   
 #ifdef WITH_CONTIKI
-  LIST_STRUCT_INIT(c, peers);
   /* LIST_STRUCT_INIT(c, key_store); */
   
   LIST_STRUCT_INIT(c, sendqueue);
@@ -2172,6 +2221,23 @@ int
 dtls_set_psk(dtls_context_t *ctx, unsigned char *psk, size_t length,
 	     unsigned char *psk_identity, size_t id_length) {
   /** @todo: store psk in key_store */
+#ifdef WITH_CONTIKI
+  if (!psk) {
+    int n;
+
+    if (id_length > 255)
+      return 0;
+
+    n = psk_store_lookup((char *)psk_identity, id_length,
+			 (char *)ctx->psk_buf, sizeof(ctx->psk_buf));
+    if (n <= 0) {
+      warn("no key for the PSK identity in the keystore\n");
+      return 0;
+    }
+    psk = ctx->psk_buf;
+    length = n;
+  }
+#endif /* WITH_CONTIKI */
 
   ctx->psk = psk;
   ctx->psk_length = length;
@@ -2213,6 +2279,7 @@ void dtls_free_context(dtls_context_t *ctx) {
     if (peer_storage.count[i])
       dtls_free_peer(p);
   }
+  memset(ctx->peers, 0, sizeof(ctx->peers));
 #endif /* WITH_CONTIKI */
 
   dtls_remove_psk(ctx, ctx->psk_id, ctx->psk_id_length);
@@ -2226,13 +2293,7 @@ dtls_connect(dtls_context_t *ctx, const session_t *dst) {
   int res;
 
   /* check if we have DTLS state for addr/port/ifindex */
-#ifndef WITH_CONTIKI
   HASH_FIND_PEER(ctx->peers, dst, peer);
-#else /* WITH_CONTIKI */
-  for (peer = list_head(ctx->peers); peer; peer = list_item_next(peer))
-    if (dtls_session_equals(&peer->session, dst))
-      break;
-#endif /* WITH_CONTIKI */
   
   if (peer) {
     debug("found peer, try to re-connect\n");
@@ -2242,16 +2303,16 @@ dtls_connect(dtls_context_t *ctx, const session_t *dst) {
   }
 
   peer = dtls_new_peer(ctx, dst);
+  if (!peer) {
+    dsrv_log(LOG_ALERT, "cannot create peer");
+    return -1;
+  }
 
   /* set peer role to server: */
   OTHER_CONFIG(peer)->role = DTLS_SERVER;
   CURRENT_CONFIG(peer)->role = DTLS_SERVER;
 
-#ifndef WITH_CONTIKI
   HASH_ADD_PEER(ctx->peers, session, peer);
-#else /* WITH_CONTIKI */
-  list_add(ctx->peers, peer);
-#endif /* WITH_CONTIKI */
 
   /* send ClientHello with some Cookie */
 
@@ -44,6 +44,16 @@
 
 #include "config.h"
 #include "global.h"
+
+#ifdef WITH_CONTIKI
+#include "psk-store.h"
+#endif /* WITH_CONTIKI */
+
+#ifndef DTLS_PEER_HASH_SIZE
+/** Slots of the peer hash table on Contiki, must exceed DTLS_PEER_MAX. */
+#define DTLS_PEER_HASH_SIZE (2 * DTLS_PEER_MAX)
+#endif
+
 #ifndef DTLSv12
 #define DTLS_VERSION 0xfeff	/* DTLS v1.1 */
 #else
@@ -83,8 +93,6 @@ typedef struct {
 typedef struct dtls_peer_t {
 #ifndef WITH_CONTIKI
   UT_hash_handle hh;
-#else /* WITH_CONTIKI */
-  struct dtls_peer_t *next;
 #endif /* WITH_CONTIKI */
 
   session_t session;	     /**< peer address and local interface */
@@ -129,7 +137,7 @@ typedef struct dtls_context_t {
 #ifndef WITH_CONTIKI
   dtls_peer_t *peers;		/**< peer hash map */
 #else /* WITH_CONTIKI */
-  LIST_STRUCT(peers);
+  dtls_peer_t *peers[DTLS_PEER_HASH_SIZE]; /**< peer hash table */
 #endif /* WITH_CONTIKI */
 
   LIST_STRUCT(sendqueue);	/**< the packets to send */
@@ -148,6 +156,9 @@ typedef struct dtls_context_t {
 
   unsigned char *psk_id; /**< psk identity (set with dtls_set_psk()) */
   size_t psk_id_length;  /**< length of psk identity  */
+#ifdef WITH_CONTIKI
+  unsigned char psk_buf[PSK_STORE_MAX_KEY]; /**< psk read from the keystore */
+#endif /* WITH_CONTIKI */
 
   unsigned char readbuf[DTLS_MAX_BUF];
   unsigned char sendbuf[DTLS_MAX_BUF];
@@ -185,6 +196,13 @@ void dtls_free_context(dtls_context_t *ctx);
  */
 int dtls_connect(dtls_context_t *ctx, const session_t *dst);
 
+/**
+ * Returns the peer with the given @p session, or @c NULL if @p ctx
+ * has no state for it. On Contiki, this is a lookup in a hash table
+ * of DTLS_PEER_HASH_SIZE slots.
+ */
+dtls_peer_t *dtls_get_peer(struct dtls_context_t *ctx, const session_t *session);
+
 /**
  * Closes the DTLS connection associated with @p remote. This function
  * returns zero on success, and a value less than zero on error.
@@ -283,12 +301,17 @@ int dtls_record_read(dtls_state_t *state, uint8 *msg, int msglen);
  * storage used by @p psk and @psk_id must remain valid until the PSK is
  * invalidated explicitly by dtls_remove_psk() or until @p ctx becomes
  * invalid.
+ *
+ * On Contiki, @p psk may be @c NULL. The key of @p psk_id is then
+ * looked up in the PSK keystore (see core/net/psk-store.h) and copied
+ * into @p ctx.
  * 
  * @param psk     The pre-shared key to be used.
  * @param length  Length of @p psk.
  * @param psk_id  The identity to use with @p psk.
  * @param id_length Length of @p psk_id.
- * @return @c 1 if psk and psk_id have been set, @c 0 otherwise.
+ * @return @c 1 if psk and psk_id have been set, @c 0 otherwise,
+ *         also when the keystore has no key for @p psk_id.
  */
 int dtls_set_psk(dtls_context_t *ctx, unsigned char *psk, size_t length,
 		 unsigned char *psk_id, size_t id_length);
@@ -318,13 +341,17 @@ int dtls_handle_message(dtls_context_t *ctx, session_t *session,
 
 /**
  * This function is called to add the received @p msg of size @p len to
- * the internal receive queue.
+ * the internal receive queue. It copies @p msg, so it is only needed when
+ * the message cannot be handled right away. When called with the data
+ * of the current tcpip_event, dtls_handle_message() can be used directly
+ * on uip_appdata instead.
  *
  * @param ctx     The dtls context to use.
  * @param remote  Sender of the data.
  * @param msg     The received data
  * @param len     The actual length of @p msg.
- * @return A value less than zero on error, greater zero on success.
+ * @return A value less than zero on error, e.g. when @p len exceeds
+ *         NETQ_LARGE_SIZE, greater zero on success.
  */
 int dtls_read(dtls_context_t *ctx, session_t *remote, uint8 *msg, size_t len);
 
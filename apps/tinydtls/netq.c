@@ -24,8 +24,16 @@
 #include <stdlib.h>
 
 static inline netq_t *
-netq_malloc_node() {
-  return (netq_t *)malloc(sizeof(netq_t));
+netq_malloc_node(size_t size) {
+  netq_t *node;
+
+  if (size > NETQ_LARGE_SIZE)
+    return NULL;
+
+  node = (netq_t *)malloc(sizeof(netq_t) + size);
+  if (node)
+    node->data = (unsigned char *)(node + 1);
+  return node;
 }
 
 static inline void
@@ -38,16 +46,50 @@ netq_free_node(netq_t *node) {
 #else /* WITH_CONTIKI */
 #include "memb.h"
 
-MEMB(netq_storage, netq_t, NETQ_MAXCNT);
+/* Each size class holds the node and its datagram in one block. */
+struct netq_small_t {
+  netq_t node;
+  unsigned char data[NETQ_SMALL_SIZE];
+};
+
+struct netq_large_t {
+  netq_t node;
+  unsigned char data[NETQ_LARGE_SIZE];
+};
+
+MEMB(netq_storage, struct netq_small_t, NETQ_MAXCNT);
+MEMB(netq_large_storage, struct netq_large_t, NETQ_LARGE_CNT);
 
 static inline netq_t *
-netq_malloc_node() {
-  return (netq_t *)memb_alloc(&netq_storage);
+netq_malloc_node(size_t size) {
+  struct netq_small_t *small;
+  struct netq_large_t *large;
+
+  if (size <= NETQ_SMALL_SIZE) {
+    small = (struct netq_small_t *)memb_alloc(&netq_storage);
+    if (small) {
+      small->node.data = small->data;
+      return &small->node;
+    }
+  }
+
+  if (size <= NETQ_LARGE_SIZE) {
+    large = (struct netq_large_t *)memb_alloc(&netq_large_storage);
+    if (large) {
+      large->node.data = large->data;
+      return &large->node;
+    }
+  }
+
+  return NULL;
 }
 
 static inline void
 netq_free_node(netq_t *node) {
-  memb_free(&netq_storage, node);
+  if (memb_inmemb(&netq_storage, node))
+    memb_free(&netq_storage, node);
+  else
+    memb_free(&netq_large_storage, node);
 }
 #endif /* WITH_CONTIKI */
 
@@ -55,41 +97,46 @@ void
 netq_init() {
 #ifdef WITH_CONTIKI
   memb_init(&netq_storage);
+  memb_init(&netq_large_storage);
 #endif /* WITH_CONTIKI */
 }
 
 int 
 netq_insert_node(netq_t **queue, netq_t *node) {
-  netq_t *p;
+  netq_t *p, *prev = NULL;
 
   assert(queue);
   assert(node);
 
   p = (netq_t *)list_head((list_t)queue);
-  while(p && p->t <= node->t)
+  while(p && p->t <= node->t) {
+    prev = p;
     p = list_item_next(p);
+  }
 
-  if (p)
-    list_insert((list_t)queue, p, node);
-  else
-    list_push((list_t)queue, node);
+  /* list_insert() adds the new node behind prev, or at the head */
+  list_insert((list_t)queue, prev, node);
 
   return 1;
 }
 
 
 netq_t *
-netq_node_new() {
+netq_node_new(size_t size) {
   netq_t *node;
-  node = netq_malloc_node();
+  unsigned char *data;
+  node = netq_malloc_node(size);
 
 #ifndef NDEBUG
   if (!node)
     dsrv_log(LOG_WARN, "netq_node_new: malloc\n");
 #endif
 
-  if (node)
+  if (node) {
+    data = node->data;
     memset(node, 0, sizeof(netq_t));
+    node->data = data;
+  }
 
   return node;  
 }
@@ -22,13 +22,22 @@
  */
 
 #ifndef NETQ_MAXCNT
-#define NETQ_MAXCNT 4 /**< maximum number of elements in netq structure */
+#define NETQ_MAXCNT 4 /**< maximum number of small elements in netq structure */
 #endif
 
-/** 
- * Datagrams in the netq_t structure have a fixed maximum size of
- * DTLS_MAX_BUF to simplify memory management on constrained nodes. */ 
-typedef unsigned char netq_packet_t[DTLS_MAX_BUF];
+#ifndef NETQ_SMALL_SIZE
+/** Datagrams up to this size are stored in one of NETQ_MAXCNT small nodes. */
+#define NETQ_SMALL_SIZE DTLS_MAX_BUF
+#endif
+
+#ifndef NETQ_LARGE_SIZE
+/** Maximum size of a datagram in netq, enough for a full IPv6 MTU. */
+#define NETQ_LARGE_SIZE 1280
+#endif
+
+#ifndef NETQ_LARGE_CNT
+#define NETQ_LARGE_CNT 1 /**< maximum number of large elements in netq structure */
+#endif
 
 typedef struct netq_t {
   struct netq_t *next;
@@ -43,11 +52,12 @@ typedef struct netq_t {
 #endif
 
   size_t length;		/**< actual length of data */
-  netq_packet_t data;		/**< the datagram to send */
+  unsigned char *data;		/**< the datagram, stored behind the node */
 } netq_t;
 
 /** 
  * Adds a node to the given queue, ordered by their time-stamp t.
+ * Nodes with equal time-stamps keep the order in which they were added.
  * This function returns @c 0 on error, or non-zero if @p node has
  * been added successfully.
  *
@@ -64,8 +74,13 @@ void netq_node_free(netq_t *node);
 /** Removes all items from given queue and frees the allocated storage */
 void netq_delete_all(netq_t *queue);
 
-/** Creates a new node suitable for adding to a netq_t queue. */
-netq_t *netq_node_new();
+/** 
+ * Creates a new node suitable for adding to a netq_t queue with room
+ * for @p size bytes of data. On Contiki, the node is taken from the
+ * smallest size class that fits @p size. This function returns @c NULL
+ * when @p size exceeds NETQ_LARGE_SIZE or no node is available.
+ */
+netq_t *netq_node_new(size_t size);
 
 /**@}*/
 
@@ -1,217 +1,24 @@
 /*
- * aes_ccm.c
+ * aes.c
  *
- *  Created on: Jan 30, 2012
- *      Author: vladislav
+ * AES-128 encryption shared by the DTLS and TLS engines. AES_CONF_TABLES
+ * trades flash for speed, see aes.h: four round tables, one round table
+ * whose rotations give the other three, or only the S-box with the
+ * MixColumns products computed on every lookup.
  */
 
-#include "aes_ccm.h"
-#include "stdlib.h"
-//#define CONTIKI_TARGET_AVR_RAVEN 1
+#include <stdint.h>
+#include "aes.h"
 #if CONTIKI_TARGET_AVR_RAVEN
-#include <avr/io.h>
 #include <avr/pgmspace.h>
+#define READ_WORD(p) pgm_read_dword(p)
+#define READ_BYTE(p) pgm_read_byte(p)
 #else
 #define PROGMEM
+#define READ_WORD(p) (*(p))
+#define READ_BYTE(p) (*(p))
 #endif
-#include <string.h>
-#include <assert.h>
-#include "raven-lcd.h"
-#include "aes.h"
-#define CEILING(X) ((X-(int)(X)) > 0 ? (int)(X+1) : (int)(X))
-
-int encrypt(char* output, int offset, char* key, char* nonce, char* plaintext, int plaintext_length, char* additional_data){
-	uint8_t** blocks;
-	blocks=(uint8_t**)malloc(sizeof(uint8_t*)*(2+CEILING((double)plaintext_length/16)));
-	if (!blocks) return -1;
-//	char* output = (char*)malloc(sizeof(char)*(plaintext_length+8));
-//	if (!output ){
-//		free(blocks);
-//		return NULL;
-//	}
-	long i, j;
-	for (i = 0; i < 2+CEILING((double)plaintext_length/16); i++){
-		if (! (blocks[i] = (uint8_t*) malloc(sizeof(uint8_t)*16))){
-			free(blocks);
-		//	free(output);
-			return -1;
-		}
-	}
-	uint8_t** Y = blocks;
-	uint8_t** Ctr = blocks;
-	//b0= 01011010 NONCE (12 octets) Q (3 octets); Q=00000000 00000000 00010000
-
-	blocks[0][0] = 90;
-	for (i = 0; i < 12; i++){
-		blocks[0][i+1] = (unsigned char)nonce[i];
-	}
-	blocks[0][13] = 0;
-	blocks[0][14] = 0;
-	blocks[0][15] = 16;
-	//b1 formats additional data. b1 = 00000000 00001101 followed by additional data followed by another 00000000
-	blocks[1][0] = 0;
-	blocks[1][1] = 13;
-	for (i = 0; i < 13; i++){
-		blocks[1][i+2] = (unsigned char)additional_data[i];
-	}
-	blocks[1][15] = 0;
-	//b2+ format the payload
-	for (i = 2; i < 2+CEILING((double)plaintext_length/16); i++){
-		if(i == 1 +CEILING((double)plaintext_length/16)){
-			for (j = 0; j < plaintext_length-(i-2)*16; j++){
-				blocks[i][j] = plaintext[(i-2)*16 + j];
-			}
-			for (j = plaintext_length - (i-2)*16; j < 16; j++){
-				blocks[i][j] = 0;
-			}
-		} else {
-			for (j = 0; j < 16; j++){
-				blocks[i][j] = plaintext[(i-2)*16 + j];
-			}
-		}
-	}
-	AES_KEY aes_key;
-	//set Y0 = CIPH_k{(B0)}
-	AES_set_encrypt_key((unsigned char*)key, &aes_key);
-	AES_encrypt(blocks[0], Y[0],&aes_key);
-	for (i = 1; i < 2+CEILING((double)plaintext_length/16); i++){
-		for(j = 0; j < 16; j++){
-			blocks[i][j] = blocks[i][j] ^ Y[i-1][j];
-		}
-		AES_encrypt(blocks[i], Y[i], &aes_key);
-	}
-	uint8_t T[8];
-	memcpy(T, Y[1+CEILING((double)plaintext_length/16)], 8);
-
-	//create counter blocks Ctr
-	for (i = 0; i <= CEILING((double)plaintext_length/16); i++){
-		Ctr[i][0] = 2;
-		for (j = 0; j < 12; j++){
-			Ctr[i][j+1] = (unsigned char)nonce[j];
-		}
-		Ctr[i][13] = (unsigned char)((i >> 16) & 0xFF);
-		Ctr[i][14] = (unsigned char)((i >> 8) & 0xFF);
-		Ctr[i][15] = (unsigned char)(i & 0xFF);
-	}
 
-	//generate S_j = CIPH_k{(Ctr_j)}
-	for (i = 0; i <= CEILING((double)plaintext_length/16); i++){
-		AES_encrypt(Ctr[i], Ctr[i], &aes_key);
-	}
-
-	//P XOR MSB_plen(S) where S = S1||S2||...||Sm
-	for (i = 0; i < plaintext_length; i++){
-		output[i+offset] = plaintext[i]^Ctr[(i/16)+1][i%16];
-	}
-	for (i = 0; i < 8; i++){
-		output[plaintext_length+i+offset] = T[i]^Ctr[0][i];
-	}
-	for (i = 0; i < 2+CEILING((double)plaintext_length/16); i++){
-		free(blocks[i]);
-	}
-	free(blocks);
-	return 1;
-}
-
-int decrypt(char* output, int offset, char* key, char* nonce, char* ciphertext, int ciphertext_length, char* additional_data){
-	if (ciphertext_length < 8){
-		return -1;
-	}
-	uint8_t** blocks;
-	blocks=(uint8_t**)malloc(sizeof(uint8_t*)*(2+CEILING((double)(ciphertext_length-8)/16)));
-	if (!blocks) {
-		return -1;
-	}
-//	char* output = (char*)malloc(sizeof(char)*(ciphertext_length-8));
-//	if (!output ){
-//		free(blocks);
-//		return NULL;
-//	}
-	long i,j;
-	for (i = 0; i < 2+CEILING((double)(ciphertext_length-8)/16); i++){
-			if (! (blocks[i] = (uint8_t*) malloc(sizeof(uint8_t)*16))){
-				free(blocks);
-			//	free(output);
-				return -1;
-			}
-		}
-	uint8_t** Y = blocks;
-	uint8_t** Ctr = blocks;
-	AES_KEY aes_key;
-	//set Y0 = CIPH_k{(B0)}
-	AES_set_encrypt_key((unsigned char*)key, &aes_key);
-
-	for (i = 0; i <= CEILING((double)(ciphertext_length-8)/16); i++){
-		Ctr[i][0] = 2;
-		for (j = 0; j < 12; j++){
-			Ctr[i][j+1] = (unsigned char)nonce[j];
-		}
-		Ctr[i][13] = (unsigned char)((i >> 16) & 0xFF);
-		Ctr[i][14] = (unsigned char)((i >> 8) & 0xFF);
-		Ctr[i][15] = (unsigned char)(i & 0xFF);
-	}
-
-	//generate S_j = CIPH_k{(Ctr_j)}
-	for (i = 0; i <= CEILING((double)(ciphertext_length-8)/16); i++){
-		AES_encrypt(Ctr[i], Ctr[i], &aes_key);
-	}
-
-	for (i = 0; i < (ciphertext_length - 8); i++){
-		output[i+offset] = ciphertext[i] ^ Ctr[(i/16)+1][i%16];
-	}
-	uint8_t T[8];
-	for (i = 0; i < 8; i++){
-		T[i] = ciphertext[ciphertext_length-8+i] ^ Ctr[0][i];
-	}
-
-	blocks[0][0] = 90;
-	for (i = 0; i < 12; i++){
-		blocks[0][i+1] = (unsigned char)nonce[i];
-	}
-	blocks[0][13] = 0;
-	blocks[0][14] = 0;
-	blocks[0][15] = 16;
-	//b1 formats additional data. b1 = 00000000 00001101 followed by additional data followed by another 00000000
-	blocks[1][0] = 0;
-	blocks[1][1] = 13;
-	for (i = 0; i < 13; i++){
-		blocks[1][i+2] = (unsigned char)additional_data[i];
-	}
-	blocks[1][15] = 0;
-	//b2+ format the payload
-	for (i = 2; i < 2+CEILING((double)(ciphertext_length-8)/16); i++){
-		if(i == 1 +CEILING((double)(ciphertext_length-8)/16)){
-			for (j = 0; j < (ciphertext_length-8)-(i-2)*16; j++){
-				blocks[i][j] = output[(i-2)*16 + j + offset];
-			}
-			for (j = (ciphertext_length-8) - (i-2)*16; j < 16; j++){
-				blocks[i][j] = 0;
-			}
-		} else {
-			for (j = 0; j < 16; j++){
-				blocks[i][j] = output[(i-2)*16 + j + offset];
-			}
-		}
-	}
-
-	AES_encrypt(blocks[0], Y[0],&aes_key);
-	for (i = 1; i < 2+CEILING((double)(ciphertext_length-8)/16); i++){
-		for(j = 0; j < 16; j++){
-			blocks[i][j] = blocks[i][j] ^ Y[i-1][j];
-		}
-		AES_encrypt(blocks[i], Y[i], &aes_key);
-	}
-	if (strncmp((char*)T, (char*)Y[1+CEILING((double)(ciphertext_length-8)/16)],8 )!=0){
-		for (i = 0; i < 2+CEILING((double)(ciphertext_length-8)/16); i++){
-				free(blocks[i]);
-		}
-		free(blocks);
-		//free(output);
-		return -1;
-	}
-	free(blocks);
-	return 1;
-}
 /*
 Te0[x] = S [x].[02, 01, 01, 03];
 Te1[x] = S [x].[03, 02, 01, 01];
@@ -225,6 +32,7 @@ Td3[x] = Si[x].[09, 0d, 0b, 0e];
 Td4[x] = Si[x].[01];
 */
 
+#if AES_TABLES != AES_TABLES_SBOX
 static const unsigned long Te0u[256] PROGMEM = {
     0xc66363a5U, 0xf87c7c84U, 0xee777799U, 0xf67b7b8dU,
     0xfff2f20dU, 0xd66b6bbdU, 0xde6f6fb1U, 0x91c5c554U,
@@ -292,6 +100,9 @@ static const unsigned long Te0u[256] PROGMEM = {
     0x7bb0b0cbU, 0xa85454fcU, 0x6dbbbbd6U, 0x2c16163aU,
 };
 
+#endif /* AES_TABLES != AES_TABLES_SBOX */
+
+#if AES_TABLES == AES_TABLES_FULL
 static const unsigned long Te1u[256] PROGMEM = {
     0xa5c66363U, 0x84f87c7cU, 0x99ee7777U, 0x8df67b7bU,
     0x0dfff2f2U, 0xbdd66b6bU, 0xb1de6f6fU, 0x5491c5c5U,
@@ -492,6 +303,28 @@ static const unsigned long Te3u[256] PROGMEM = {
     0x4141c382U, 0x9999b029U, 0x2d2d775aU, 0x0f0f111eU,
     0xb0b0cb7bU, 0x5454fca8U, 0xbbbbd66dU, 0x16163a2cU,
 };
+#endif /* AES_TABLES == AES_TABLES_FULL */
+
+#if AES_TABLES == AES_TABLES_SBOX
+static const uint8_t sbox[256] PROGMEM = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+#endif /* AES_TABLES == AES_TABLES_SBOX */
 
 static const unsigned long rcon[] = {
 	0x01000000, 0x02000000, 0x04000000, 0x08000000,
@@ -499,38 +332,38 @@ static const unsigned long rcon[] = {
 	0x1B000000, 0x36000000, /* for 128-bit blocks, Rijndael never uses more than 10 rcon values */
 };
 
-
-unsigned long getTe0(uint16_t index) {
-#if CONTIKI_TARGET_AVR_RAVEN
-    return pgm_read_dword(&Te0u[index]);
-#else
-    return Te0u[index];
-#endif
+/*
+ * Round table lookups, expanded in place. SBOX(x) is all the key schedule
+ * and the last round need, it is the second byte of Te0[x].
+ */
+#if AES_TABLES == AES_TABLES_SBOX
+#define SBOX(x) ((u32)READ_BYTE(&sbox[x]))
+
+/* Te0[x] = S[x].[02, 01, 01, 03], left out of line to stay small */
+static u32 te0(uint8_t x) {
+    u32 s = SBOX(x);
+    u32 s2 = ((s << 1) ^ ((s & 0x80) ? 0x1b : 0)) & 0xff;
+    return (s2 << 24) | (s << 16) | (s << 8) | (s2 ^ s);
 }
-
-unsigned long getTe1(uint16_t index) {
-#if CONTIKI_TARGET_AVR_RAVEN
-    return pgm_read_dword(&Te1u[index]);
+#define TE0(x) te0(x)
 #else
-    return Te1u[index];
+#define SBOX(x) ((READ_WORD(&Te0u[x]) >> 8) & 0xff)
+#define TE0(x) READ_WORD(&Te0u[x])
 #endif
-}
 
-unsigned long getTe2(uint16_t index) {
-#if CONTIKI_TARGET_AVR_RAVEN
-    return pgm_read_dword(&Te2u[index]);
+#if AES_TABLES == AES_TABLES_FULL
+#define TE1(x) READ_WORD(&Te1u[x])
+#define TE2(x) READ_WORD(&Te2u[x])
+#define TE3(x) READ_WORD(&Te3u[x])
 #else
-    return Te2u[index];
-#endif
+/* Te1..Te3 are Te0 rotated right by one, two and three bytes */
+static inline u32 rotr(u32 w, uint8_t r) {
+    return ((w >> r) | (w << (32 - r))) & 0xffffffffUL;
 }
-
-unsigned long getTe3(uint16_t index) {
-#if CONTIKI_TARGET_AVR_RAVEN
-    return pgm_read_dword(&Te3u[index]);
-#else
-    return Te3u[index];
+#define TE1(x) rotr(TE0(x), 8)
+#define TE2(x) rotr(TE0(x), 16)
+#define TE3(x) rotr(TE0(x), 24)
 #endif
-}
 
 /**
  * Expand the cipher key into the encryption key schedule.
@@ -554,10 +387,10 @@ int AES_set_encrypt_key(const uint8_t *userKey, AES_KEY *key) {
         while (1) {
             temp  = rk[3];
             rk[4] = rk[0] ^
-                    (getTe2((temp >> 16) & 0xff) & 0xff000000) ^
-                    (getTe3((temp >>  8) & 0xff) & 0x00ff0000) ^
-                    (getTe0((temp      ) & 0xff) & 0x0000ff00) ^
-                    (getTe1((temp >> 24)       ) & 0x000000ff) ^
+                    (SBOX((temp >> 16) & 0xff) << 24) ^
+                    (SBOX((temp >>  8) & 0xff) << 16) ^
+                    (SBOX((temp      ) & 0xff) <<  8) ^
+                    (SBOX((temp >> 24)       )      ) ^
                     rcon[i];
             rk[5] = rk[1] ^ rk[4];
             rk[6] = rk[2] ^ rk[5];
@@ -567,11 +400,6 @@ int AES_set_encrypt_key(const uint8_t *userKey, AES_KEY *key) {
             }
             rk += 4;
         }
-	rk[4] = GETU32(userKey + 16);
-	rk[5] = GETU32(userKey + 20);
-	rk[6] = GETU32(userKey + 24);
-	rk[7] = GETU32(userKey + 28);
-	return 0;
 }
 
 /*
@@ -599,28 +427,28 @@ void AES_encrypt(const uint8_t *in, uint8_t *out, const AES_KEY *key) {
     r = key->rounds >> 1;
     for (;;) {
         t0 =
-            getTe0((s0 >> 24)       ) ^
-            getTe1((s1 >> 16) & 0xff) ^
-            getTe2((s2 >>  8) & 0xff) ^
-            getTe3((s3      ) & 0xff) ^
+            TE0((s0 >> 24)       ) ^
+            TE1((s1 >> 16) & 0xff) ^
+            TE2((s2 >>  8) & 0xff) ^
+            TE3((s3      ) & 0xff) ^
             rk[4];
         t1 =
-            getTe0((s1 >> 24)       ) ^
-            getTe1((s2 >> 16) & 0xff) ^
-            getTe2((s3 >>  8) & 0xff) ^
-            getTe3((s0      ) & 0xff) ^
+            TE0((s1 >> 24)       ) ^
+            TE1((s2 >> 16) & 0xff) ^
+            TE2((s3 >>  8) & 0xff) ^
+            TE3((s0      ) & 0xff) ^
             rk[5];
         t2 =
-            getTe0((s2 >> 24)       ) ^
-            getTe1((s3 >> 16) & 0xff) ^
-            getTe2((s0 >>  8) & 0xff) ^
-            getTe3((s1      ) & 0xff) ^
+            TE0((s2 >> 24)       ) ^
+            TE1((s3 >> 16) & 0xff) ^
+            TE2((s0 >>  8) & 0xff) ^
+            TE3((s1      ) & 0xff) ^
             rk[6];
         t3 =
-            getTe0((s3 >> 24)       ) ^
-            getTe1((s0 >> 16) & 0xff) ^
-            getTe2((s1 >>  8) & 0xff) ^
-            getTe3((s2      ) & 0xff) ^
+            TE0((s3 >> 24)       ) ^
+            TE1((s0 >> 16) & 0xff) ^
+            TE2((s1 >>  8) & 0xff) ^
+            TE3((s2      ) & 0xff) ^
             rk[7];
 
         rk += 8;
@@ -629,28 +457,28 @@ void AES_encrypt(const uint8_t *in, uint8_t *out, const AES_KEY *key) {
         }
 
         s0 =
-            getTe0((t0 >> 24)       ) ^
-            getTe1((t1 >> 16) & 0xff) ^
-            getTe2((t2 >>  8) & 0xff) ^
-            getTe3((t3      ) & 0xff) ^
+            TE0((t0 >> 24)       ) ^
+            TE1((t1 >> 16) & 0xff) ^
+            TE2((t2 >>  8) & 0xff) ^
+            TE3((t3      ) & 0xff) ^
             rk[0];
         s1 =
-            getTe0((t1 >> 24)       ) ^
-            getTe1((t2 >> 16) & 0xff) ^
-            getTe2((t3 >>  8) & 0xff) ^
-            getTe3((t0      ) & 0xff) ^
+            TE0((t1 >> 24)       ) ^
+            TE1((t2 >> 16) & 0xff) ^
+            TE2((t3 >>  8) & 0xff) ^
+            TE3((t0      ) & 0xff) ^
             rk[1];
         s2 =
-            getTe0((t2 >> 24)       ) ^
-            getTe1((t3 >> 16) & 0xff) ^
-            getTe2((t0 >>  8) & 0xff) ^
-            getTe3((t1      ) & 0xff) ^
+            TE0((t2 >> 24)       ) ^
+            TE1((t3 >> 16) & 0xff) ^
+            TE2((t0 >>  8) & 0xff) ^
+            TE3((t1      ) & 0xff) ^
             rk[2];
         s3 =
-            getTe0((t3 >> 24)       ) ^
-            getTe1((t0 >> 16) & 0xff) ^
-            getTe2((t1 >>  8) & 0xff) ^
-            getTe3((t2      ) & 0xff) ^
+            TE0((t3 >> 24)       ) ^
+            TE1((t0 >> 16) & 0xff) ^
+            TE2((t1 >>  8) & 0xff) ^
+            TE3((t2      ) & 0xff) ^
             rk[3];
     }
     /*
@@ -658,31 +486,31 @@ void AES_encrypt(const uint8_t *in, uint8_t *out, const AES_KEY *key) {
 	 * map cipher state to byte array block:
 	 */
 	s0 =
-		(getTe2((t0 >> 24)       ) & 0xff000000) ^
-		(getTe3((t1 >> 16) & 0xff) & 0x00ff0000) ^
-		(getTe0((t2 >>  8) & 0xff) & 0x0000ff00) ^
-		(getTe1((t3      ) & 0xff) & 0x000000ff) ^
+		(SBOX((t0 >> 24)       ) << 24) ^
+		(SBOX((t1 >> 16) & 0xff) << 16) ^
+		(SBOX((t2 >>  8) & 0xff) <<  8) ^
+		(SBOX((t3      ) & 0xff)      ) ^
 		rk[0];
 	PUTU32(out     , s0);
 	s1 =
-		(getTe2((t1 >> 24)       ) & 0xff000000) ^
-		(getTe3((t2 >> 16) & 0xff) & 0x00ff0000) ^
-		(getTe0((t3 >>  8) & 0xff) & 0x0000ff00) ^
-		(getTe1((t0      ) & 0xff) & 0x000000ff) ^
+		(SBOX((t1 >> 24)       ) << 24) ^
+		(SBOX((t2 >> 16) & 0xff) << 16) ^
+		(SBOX((t3 >>  8) & 0xff) <<  8) ^
+		(SBOX((t0      ) & 0xff)      ) ^
 		rk[1];
 	PUTU32(out +  4, s1);
 	s2 =
-		(getTe2((t2 >> 24)       ) & 0xff000000) ^
-		(getTe3((t3 >> 16) & 0xff) & 0x00ff0000) ^
-		(getTe0((t0 >>  8) & 0xff) & 0x0000ff00) ^
-		(getTe1((t1      ) & 0xff) & 0x000000ff) ^
+		(SBOX((t2 >> 24)       ) << 24) ^
+		(SBOX((t3 >> 16) & 0xff) << 16) ^
+		(SBOX((t0 >>  8) & 0xff) <<  8) ^
+		(SBOX((t1      ) & 0xff)      ) ^
 		rk[2];
 	PUTU32(out +  8, s2);
 	s3 =
-		(getTe2((t3 >> 24)       ) & 0xff000000) ^
-		(getTe3((t0 >> 16) & 0xff) & 0x00ff0000) ^
-		(getTe0((t1 >>  8) & 0xff) & 0x0000ff00) ^
-		(getTe1((t2      ) & 0xff) & 0x000000ff) ^
+		(SBOX((t3 >> 24)       ) << 24) ^
+		(SBOX((t0 >> 16) & 0xff) << 16) ^
+		(SBOX((t1 >>  8) & 0xff) <<  8) ^
+		(SBOX((t2      ) & 0xff)      ) ^
 		rk[3];
 	PUTU32(out + 12, s3);
 }
@@ -52,12 +52,28 @@
 #ifndef HEADER_AES_H
 #define HEADER_AES_H
 
+/*
+ * Round tables kept in flash:
+ *   AES_TABLES_FULL   Te0..Te3, 4 kB
+ *   AES_TABLES_SINGLE Te0, Te1..Te3 are its rotations, 1 kB
+ *   AES_TABLES_SBOX   the S-box, MixColumns computed per lookup, 256 bytes
+ * Set AES_TABLES=1 or 0 in the Makefile (AES_CONF_TABLES) on small parts.
+ */
+#define AES_TABLES_SBOX 0
+#define AES_TABLES_SINGLE 1
+#define AES_TABLES_FULL 4
+#ifdef AES_CONF_TABLES
+#define AES_TABLES AES_CONF_TABLES
+#else
+#define AES_TABLES AES_TABLES_FULL
+#endif
+
 #define AES_ENCRYPT	1
 #define AES_DECRYPT	0
 
 /* Because array size can't be a const in C, the following two are macros.
    Both sizes are in bytes. */
-#define AES_MAXNR 14
+#define AES_MAXNR 10 //only AES-128 keys are expanded, saves 64 bytes per schedule
 #define AES_BLOCK_SIZE 16
 
 /* This should be a hidden type, but EVP requires that the size be known */
@@ -0,0 +1,140 @@
+/*
+ * aes_ccm.c
+ *
+ *  Created on: Jan 30, 2012
+ *      Author: vladislav
+ */
+
+#include "aes_ccm.h"
+#include "sec-stats.h"
+#include <string.h>
+
+#define t 8
+#define Tlen 64
+#define q 3
+#define n 12
+#define a 13
+
+/*
+ * The payload is processed one 16 octet block at a time: every block is
+ * folded into the CBC-MAC state X and xored with its own counter block S.
+ * Together with the counter block that is built in S and encrypted in place
+ * this keeps the working set at 32 octets whatever the record size, and
+ * output may be the same buffer as the input.
+ */
+
+/* Ctr_i = flags || N || [i]_3 */
+static void ccm_counter(unsigned char* S, const AES_KEY* K, char* N, uint16_t i){
+	S[0] = (unsigned char)(q-1);
+	memcpy(S+1, N, n);
+	S[13] = 0;
+	S[14] = (unsigned char)((i >> 8) & 0xFF);
+	S[15] = (unsigned char)(i & 0xFF);
+	AES_encrypt(S, S, K);
+}
+
+/* Y_0 = CIPH_K(B_0) followed by the block(s) holding [a]_2 || A, zero padded */
+static void ccm_start(unsigned char* X, const AES_KEY* K, char* N, int Plen, char* A){
+	uint8_t i, j;
+	uint8_t Adata = a>0 ? 1 : 0;
+	X[0] = (unsigned char)(64*Adata+ (8*((t-2)/2)) + (q-1)); //Flags = 64*Adata + 8*((t-2)/2) + (q-1) = 90 (Adata is 1 if a > 0)
+	memcpy(X+1, N, n);
+	//next is Plen in most-significant-byte first order (3 bytes)
+	//assuming that Plen will not be greater 65535
+	X[13] = 0;
+	X[14] = (unsigned char)((Plen >> 8) & 0xFF);
+	X[15] = (unsigned char)(Plen & 0xFF);
+	AES_encrypt(X, X, K);
+	//assuming that A will not exceed 65280
+	X[0] ^= (unsigned char)((a>>8) & 0xFF);
+	X[1] ^= (unsigned char)(a & 0xFF);
+	j = 2;
+	for (i = 0; i < a; i++){
+		X[j++] ^= (unsigned char)A[i];
+		if (j == 16){
+			AES_encrypt(X, X, K);
+			j = 0;
+		}
+	}
+	if (j != 0){
+		AES_encrypt(X, X, K);
+	}
+}
+
+/**
+ * K - expanded key schedule, see AES_set_encrypt_key()
+ * N - nonce of length n octets
+ * P - payload data
+ * Plen - length of the payload = p octets
+ * A - associated data of length a octets
+ * output gets Plen+t octets and may be P itself
+ */
+int encrypt(char* output, const AES_KEY* K, char* N, char* P, int Plen, char* A){
+	unsigned char X[16]; //CBC-MAC state
+	unsigned char S[16]; //key stream block
+	uint16_t i = 1;
+	int done, j, len;
+
+	SEC_STATS_CCM_START();
+	ccm_start(X, K, N, Plen, A);
+	for (done = 0; done < Plen; done += 16, i++){
+		len = Plen - done < 16 ? Plen - done : 16;
+		ccm_counter(S, K, N, i);
+		for (j = 0; j < len; j++){
+			X[j] ^= (unsigned char)P[done+j];
+			output[done+j] = P[done+j] ^ S[j];
+		}
+		AES_encrypt(X, X, K);
+	}
+	//T = MSB_Tlen(Y_r), returned xored with S_0
+	ccm_counter(S, K, N, 0);
+	for (j = 0; j < t; j++){
+		output[Plen+j] = X[j] ^ S[j];
+	}
+	SEC_STATS_CCM_STOP(Plen);
+	return 1;
+}
+
+/**
+ *  K - expanded key schedule, see AES_set_encrypt_key()
+ *  N - nonce of length n octets
+ *  C - ciphertext
+ *  Clen - length of C in bytes
+ *  A -associated data of length a octets
+ *  output gets Clen-t octets and may be C itself
+ */
+int decrypt(char* output, const AES_KEY* K, char* N, char* C, int Clen, char* A){
+	unsigned char X[16]; //CBC-MAC state
+	unsigned char S[16]; //key stream block
+	unsigned char diff = 0;
+	uint16_t i = 1;
+	int done, j, len, Plen;
+
+	//If Clen<=Tlen, then return INVALID
+	if (Clen*8 < Tlen){
+		return 0;
+	}
+	Plen = Clen - t;
+	SEC_STATS_CCM_START();
+	ccm_start(X, K, N, Plen, A);
+	for (done = 0; done < Plen; done += 16, i++){
+		len = Plen - done < 16 ? Plen - done : 16;
+		ccm_counter(S, K, N, i);
+		for (j = 0; j < len; j++){
+			output[done+j] = C[done+j] ^ S[j];
+			X[j] ^= (unsigned char)output[done+j];
+		}
+		AES_encrypt(X, X, K);
+	}
+	//If T != MSB_Tlen(Y_r), then return INVALID, else return P
+	ccm_counter(S, K, N, 0);
+	for (j = 0; j < t; j++){
+		diff |= X[j] ^ S[j] ^ (unsigned char)C[Plen+j];
+	}
+	SEC_STATS_CCM_STOP(Plen);
+	if (diff != 0){
+		memset(output, 0, Plen);
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,22 @@
+/*
+ * aes_ccm.h
+ *
+ *  Created on: Jan 30, 2012
+ *      Author: vladislav
+ */
+
+#ifndef AES_CCM_H_
+#define AES_CCM_H_
+
+#include <contiki.h>
+#include <contiki-net.h>
+#include <contiki-lib.h>
+#include "aes.h"
+
+/*
+ * key is the schedule expanded once per epoch with AES_set_encrypt_key(),
+ * so that records do not pay for the key expansion
+ */
+int encrypt(char* output, const AES_KEY* key, char* nonce, char* plaintext, int plaintext_length, char* additional_data);
+int decrypt(char* output, const AES_KEY* key, char* nonce, char* ciphertext, int ciphertext_length, char* additional_data);
+#endif /* AES_CCM_H_ */
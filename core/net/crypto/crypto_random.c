@@ -0,0 +1,132 @@
+/*
+ * crypto_random.c
+ */
+
+#include "crypto_random.h"
+#include "hmac_sha2.h"
+#include "crypto_util.h"
+#include "string.h"
+#if !defined(CRYPTO_RANDOM_ENTROPY) && (CONTIKI_TARGET_NATIVE || CONTIKI_TARGET_MINIMAL_NET)
+#include <stdio.h>
+#include <stdlib.h>
+#elif !defined(CRYPTO_RANDOM_ENTROPY)
+#include "sys/clock.h"
+#include "sys/rtimer.h"
+#include "net/rime/rimeaddr.h"
+#endif
+
+#ifdef CRYPTO_RANDOM_ENTROPY
+void CRYPTO_RANDOM_ENTROPY(unsigned char* buf, uint16_t length);
+#endif
+
+#define SEED_LENGTH 48 //256 bits of entropy plus half as much again, SP 800-90A 10.1.2.3
+#define JITTER_SAMPLES 256
+
+static unsigned char K[32];
+static unsigned char V[32];
+static uint8_t seeded = 0;
+
+//K = HMAC(K, V | round | data), V = HMAC(K, V), a second round only if there is data
+static void drbg_update(const unsigned char* data, uint16_t length){
+	static unsigned char block[33+SEED_LENGTH];
+	hmac_sha256_key key;
+	uint8_t round;
+	for (round = 0; round < 2; round++){
+		memcpy(block, V, 32);
+		block[32] = round;
+		if (length > 0){
+			memcpy(block+33, data, length);
+		}
+		hmac_sha256_key_init(&key, K, 32);
+		hmac_sha256_keyed(&key, block, 33+length, K, 32);
+		hmac_sha256_key_init(&key, K, 32);
+		hmac_sha256_keyed(&key, V, 32, V, 32);
+		if (length == 0) break;
+	}
+	crypto_wipe(block, sizeof(block));
+	crypto_wipe(&key, sizeof(key));
+}
+
+#if !defined(CRYPTO_RANDOM_ENTROPY) && (CONTIKI_TARGET_NATIVE || CONTIKI_TARGET_MINIMAL_NET)
+static void entropy(unsigned char* buf, uint16_t length){
+	FILE* f = fopen("/dev/urandom", "rb");
+	if (f == NULL || fread(buf, 1, length, f) != length){
+		//nothing to fall back on here, better no keys than guessable ones
+		perror("crypto_random: /dev/urandom");
+		abort();
+	}
+	fclose(f);
+}
+#elif !defined(CRYPTO_RANDOM_ENTROPY)
+//how often a busy loop spins until the rtimer ticks drifts with interrupts and
+//clock skew. Hashed together with the node's address, so nodes of the same
+//image at least start from different seeds.
+static void entropy(unsigned char* buf, uint16_t length){
+	sha256_ctx ctx;
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	rtimer_clock_t t;
+	clock_time_t c;
+	uint16_t spins, i;
+	uint8_t counter = 0;
+	sha256_init(&ctx);
+	sha256_update(&ctx, rimeaddr_node_addr.u8, RIMEADDR_SIZE);
+	for (i = 0; i < JITTER_SAMPLES; i++){
+		spins = 0;
+		t = RTIMER_NOW();
+		while (RTIMER_NOW() == t && spins < 0xFFFF){
+			spins++;
+		}
+		t = RTIMER_NOW();
+		c = clock_time();
+		sha256_update(&ctx, (unsigned char*)&spins, sizeof(spins));
+		sha256_update(&ctx, (unsigned char*)&t, sizeof(t));
+		sha256_update(&ctx, (unsigned char*)&c, sizeof(c));
+	}
+	while (length > 0){
+		sha256_ctx out = ctx;
+		sha256_update(&out, &counter, 1);
+		sha256_final(&out, digest);
+		i = length < SHA256_DIGEST_SIZE ? length : SHA256_DIGEST_SIZE;
+		memcpy(buf, digest, i);
+		buf += i;
+		length -= i;
+		counter++;
+	}
+	crypto_wipe(&ctx, sizeof(ctx));
+	crypto_wipe(digest, sizeof(digest));
+}
+#endif
+
+static void instantiate(){
+	unsigned char seed[SEED_LENGTH];
+#ifdef CRYPTO_RANDOM_ENTROPY
+	CRYPTO_RANDOM_ENTROPY(seed, SEED_LENGTH);
+#else
+	entropy(seed, SEED_LENGTH);
+#endif
+	memset(K, 0x00, 32);
+	memset(V, 0x01, 32);
+	drbg_update(seed, SEED_LENGTH);
+	crypto_wipe(seed, SEED_LENGTH);
+	seeded = 1;
+}
+
+void crypto_random(void* out, uint16_t length){
+	unsigned char* p = out;
+	hmac_sha256_key key;
+	uint16_t n;
+	if (!seeded){
+		instantiate();
+	}
+	hmac_sha256_key_init(&key, K, 32);
+	while (length > 0){
+		hmac_sha256_keyed(&key, V, 32, V, 32);
+		n = length < 32 ? length : 32;
+		memcpy(p, V, n);
+		p += n;
+		length -= n;
+	}
+	crypto_wipe(&key, sizeof(key));
+	//backtracking resistance: the bytes just handed out can't be recomputed from K and V
+	drbg_update(NULL, 0);
+}
@@ -0,0 +1,32 @@
+/*
+ * crypto_random.h
+ *
+ * Random bytes for the secrets of the DTLS and TLS engines: cookie
+ * secrets, session ids and hello randoms. An HMAC-DRBG over SHA-256
+ * (NIST SP 800-90A) seeded once, on first use, from the platform's
+ * entropy source. It keeps its own state, so random_rand() and those
+ * relying on it (CSMA backoff and the like) are left alone.
+ */
+
+#ifndef CRYPTO_RANDOM_H_
+#define CRYPTO_RANDOM_H_
+
+#include <stdint.h>
+
+/*
+ * A platform with a true entropy source (hardware RNG, radio noise) sets
+ * this to a function void f(unsigned char* buf, uint16_t length) filling
+ * buf with length bytes from it. Without it native and minimal-net read
+ * /dev/urandom and every other target falls back to timer jitter, which
+ * is weak and only meant until the platform provides the hook.
+ */
+#ifdef CRYPTO_RANDOM_CONF_ENTROPY
+#define CRYPTO_RANDOM_ENTROPY CRYPTO_RANDOM_CONF_ENTROPY
+#endif
+
+/*
+ * Fills out with length random bytes.
+ */
+void crypto_random(void* out, uint16_t length);
+
+#endif /* CRYPTO_RANDOM_H_ */
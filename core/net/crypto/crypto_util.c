@@ -0,0 +1,24 @@
+/*
+ * crypto_util.c
+ */
+
+#include "crypto_util.h"
+
+uint8_t crypto_equal(const void* a, const void* b, uint16_t length){
+	const unsigned char* x = a;
+	const unsigned char* y = b;
+	unsigned char diff = 0;
+	uint16_t i;
+	for (i = 0; i < length; i++){
+		diff |= x[i] ^ y[i];
+	}
+	//1 if diff is 0, without a branch on it
+	return (uint8_t)((((uint16_t)diff - 1) >> 8) & 1);
+}
+
+void crypto_wipe(void* p, uint16_t length){
+	volatile unsigned char* v = p;
+	while (length--){
+		*v++ = 0;
+	}
+}
@@ -0,0 +1,26 @@
+/*
+ * crypto_util.h
+ *
+ * Helpers the DTLS and TLS engines use on secrets: comparing MACs and
+ * Finished values without leaking where they differ, and clearing key
+ * material once it is no longer needed.
+ */
+
+#ifndef CRYPTO_UTIL_H_
+#define CRYPTO_UTIL_H_
+
+#include <stdint.h>
+
+/*
+ * 1 if the length bytes at a and b are equal, 0 otherwise. All bytes are
+ * compared, so the time taken does not depend on where they differ.
+ */
+uint8_t crypto_equal(const void* a, const void* b, uint16_t length);
+
+/*
+ * Overwrites length bytes at p with zeros. Unlike memset() the stores are
+ * not dropped when p is not read again, e.g. a buffer on the stack.
+ */
+void crypto_wipe(void* p, uint16_t length);
+
+#endif /* CRYPTO_UTIL_H_ */
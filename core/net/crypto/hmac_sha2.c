@@ -121,3 +121,56 @@ void hmac_sha256(const unsigned char *key, unsigned int key_size,
     hmac_sha256_final(&ctx, mac, mac_size);
 }
 
+void hmac_sha256_key_init(hmac_sha256_key *key, const unsigned char *secret,
+                          unsigned int secret_size)
+{
+    sha256_ctx ctx;
+    unsigned char block[SHA256_BLOCK_SIZE];
+    unsigned char key_temp[SHA256_DIGEST_SIZE];
+    unsigned int i;
+
+    if (secret_size > SHA256_BLOCK_SIZE) {
+        sha256(secret, secret_size, key_temp);
+        secret = key_temp;
+        secret_size = SHA256_DIGEST_SIZE;
+    }
+
+    for (i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        block[i] = (i < secret_size ? secret[i] : 0) ^ 0x36;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, block, SHA256_BLOCK_SIZE);
+    memcpy(key->h_inside, ctx.h, sizeof(key->h_inside));
+
+    for (i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        block[i] ^= 0x36 ^ 0x5c;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, block, SHA256_BLOCK_SIZE);
+    memcpy(key->h_outside, ctx.h, sizeof(key->h_outside));
+}
+
+/* resume from a midstate: exactly one block (the pad) has been hashed */
+static void sha256_resume(sha256_ctx *ctx, const uint32 *h)
+{
+    memcpy(ctx->h, h, sizeof(ctx->h));
+    ctx->len = 0;
+    ctx->tot_len = SHA256_BLOCK_SIZE;
+}
+
+void hmac_sha256_keyed(const hmac_sha256_key *key,
+                       const unsigned char *message, unsigned int message_len,
+                       unsigned char *mac, unsigned int mac_size)
+{
+    sha256_ctx ctx;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+
+    sha256_resume(&ctx, key->h_inside);
+    sha256_update(&ctx, message, message_len);
+    sha256_final(&ctx, digest);
+
+    sha256_resume(&ctx, key->h_outside);
+    sha256_update(&ctx, digest, SHA256_DIGEST_SIZE);
+    sha256_final(&ctx, digest);
+    memcpy(mac, digest, mac_size);
+}
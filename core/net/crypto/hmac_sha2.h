@@ -65,6 +65,21 @@ void hmac_sha256(const unsigned char *key, unsigned int key_size,
                  const unsigned char *message, unsigned int message_len,
                  unsigned char *mac, unsigned mac_size);
 
+/* HMAC-SHA-256 key kept as the two compression function states after
+   key ^ ipad and key ^ opad: 64 bytes instead of a full hmac_sha256_ctx,
+   and every MAC under that key skips hashing the pads again */
+
+typedef struct {
+    uint32 h_inside[8];
+    uint32 h_outside[8];
+} hmac_sha256_key;
+
+void hmac_sha256_key_init(hmac_sha256_key *key, const unsigned char *secret,
+                          unsigned int secret_size);
+void hmac_sha256_keyed(const hmac_sha256_key *key,
+                       const unsigned char *message, unsigned int message_len,
+                       unsigned char *mac, unsigned int mac_size);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,59 @@
+/*
+ * prf.c
+ *
+ * The PRF both the DTLS and the TLS engine derive their master secret,
+ * key block and Finished values with.
+ */
+
+#include "prf.h"
+#include "sec-stats.h"
+#include "lib/assert.h"
+#include <string.h>
+
+//"master secret" and "key expansion" followed by both randoms are the longest label + seed the engines pass
+CTASSERT(sizeof("key expansion") - 1 + 64 <= PRF_MAX_LABEL_SEED);
+
+/*
+ * TLS 1.2 PRF (RFC 5246 section 5), P_SHA256 under a key prepared once with PRF_key().
+ * label and seed are laid out once behind room for A(i): every output block is a single
+ * HMAC over A(i) + label + seed, the next A(i) one over the first 32 bytes of the same buffer,
+ * and no A(i) is computed past the last block
+ */
+
+void PRF_key(hmac_sha256_key* key, char* secret, int secret_length){
+	hmac_sha256_key_init(key, (unsigned char*)secret, secret_length);
+}
+
+int PRF_keyed(char* output, hmac_sha256_key* key, char* label, char* seed, int seed_length, int output_length){
+	char block[32+PRF_MAX_LABEL_SEED];
+	int label_length = strlen(label);
+	int current_length = 0;
+	int min;
+	if (label_length + seed_length > PRF_MAX_LABEL_SEED){
+		//no caller gets here, see above. a zero key block fails the handshake instead of leaking stack contents
+		memset(output, 0, output_length);
+		return 0;
+	}
+	SEC_STATS_ADD(prf_calls, 1);
+	memcpy(block+32, label, label_length);
+	memcpy(block+32+label_length, seed, seed_length);
+	//A(1) = HMAC(label + seed)
+	hmac_sha256_keyed(key, (unsigned char*)block+32, label_length+seed_length, (unsigned char*)block, 32);
+	while (1){
+		min = output_length - current_length < 32 ? output_length - current_length : 32;
+		hmac_sha256_keyed(key, (unsigned char*)block, 32+label_length+seed_length, (unsigned char*)output+current_length, min);
+		current_length += 32;
+		if (current_length >= output_length){
+			break;
+		}
+		//A(i+1) = HMAC(A(i))
+		hmac_sha256_keyed(key, (unsigned char*)block, 32, (unsigned char*)block, 32);
+	}
+	return 1;
+}
+
+int PRF(char* output,  char* key, int key_length, char* label, char* seed, int seed_length, int output_length){
+	hmac_sha256_key k;
+	PRF_key(&k, key, key_length);
+	return PRF_keyed(output, &k, label, seed, seed_length, output_length);
+}
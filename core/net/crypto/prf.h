@@ -0,0 +1,12 @@
+#ifndef __PRF_H__
+#define __PRF_H__
+
+#include <contiki.h>
+#include "hmac_sha2.h"
+
+#define PRF_MAX_LABEL_SEED 80 //longest label + seed the PRF takes, "key expansion" and both randoms fit, checked in prf.c
+int PRF(char* output, char* secret, int secret_length, char* label, char* seed, int seed_length, int size);
+void PRF_key(hmac_sha256_key* key, char* secret, int secret_length);
+int PRF_keyed(char* output, hmac_sha256_key* key, char* label, char* seed, int seed_length, int size);
+
+#endif
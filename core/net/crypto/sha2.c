@@ -32,7 +32,6 @@
  */
 
 #include <string.h>
-
 #include "sha2.h"
 
 #define SHFR(x, n)    (x >> n)
@@ -92,7 +91,6 @@
           + SHA256_F3(w[i - 15]) + w[i - 16]; \
 }
 
-
 uint32 sha256_h0[8] =
             {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
@@ -115,8 +113,11 @@ uint32 sha256_k[64] =
              0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
              0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
 
-/* SHA-256 functions */
+#ifdef SHA2_COUNT_BLOCKS
+unsigned long sha256_blocks;
+#endif
 
+/* SHA-256 functions */
 void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
                    unsigned int block_nb)
 {
@@ -127,6 +128,10 @@ void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
     int i;
     int j;
 
+#ifdef SHA2_COUNT_BLOCKS
+    sha256_blocks += block_nb;
+#endif
+
     for (i = 0; i < (int) block_nb; i++) {
         sub_block = message + (i << 6);
 
@@ -137,7 +142,6 @@ void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
         for (j = 16; j < 64; j++) {
             SHA256_SCR(j);
         }
-
         for (j = 0; j < 8; j++) {
             wv[j] = ctx->h[j];
         }
@@ -62,6 +62,11 @@ typedef struct {
 
 typedef sha256_ctx sha224_ctx;
 
+#ifdef SHA2_COUNT_BLOCKS
+/* compression function calls so far */
+extern unsigned long sha256_blocks;
+#endif
+
 void sha256_init(sha256_ctx * ctx);
 void sha256_update(sha256_ctx *ctx, const unsigned char *message,
                    unsigned int len);
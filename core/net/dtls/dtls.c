@@ -7,11 +7,13 @@
 
 #include "dtls.h"
 #include "ntpd.h"
-#include "random.h"
+#include "crypto_random.h"
 #include "hmac_sha2.h"
 #include "aes_ccm.h"
+#include "crypto_util.h"
 #include "string.h"
 #include "lib/mmem.h"
+#include "psk-store.h"
 #include "raven-lcd.h"
 #include <avr/io.h>
 #if CONTIKI_TARGET_MINIMAL_NET
@@ -23,64 +25,52 @@
 /***************************************************************/
 /*                     Static variables                        */
 /***************************************************************/
-static clock_time_t start = 0;
 static uint8_t server = 0;
-static uint8_t expected_message = SERVER_HELLO;
 static uint8_t max_connections = 1;
-static uint8_t num_connected = 0;
-static uint8_t alert_received = 0;
-static uint8_t alert_sent = 0;
-static uint8_t sent_something = 0;
-static uint8_t handshake_done = 0;
-static uint16_t current_epoch = 0;
+static uint16_t listen_port = 0;
 static uint16_t rcvd_epoch = 0;
 static uint64 rcvd_seq = 0;
-static uint64 next_receive_seq = 0;
-static uint64 next_send_seq = 0;
-static uint64 next_send_seq_copy = 0;
-static uint16_t sent_message_seq_number = 0;
-static uint16_t rcvd_message_seq_number = 0;
-static uint8_t first_fragment = 1;
-static uint8_t first_data = 1;
-static uint8_t first_data_sent = 1;
-static uint16_t overall_sent_data = 65535;
-static char server_random[32] = "";
-static char client_random[32] = "";
+static uint8_t just_connected = 0; //the datagram being processed completed the handshake
+static uint8_t rcvd_bad_mac = 0; //the record being processed did not verify and is dropped
 static char finished_clear[24] = "";
 static char nonce[12] = "";
 static char additional_data[13] = "";
-static unsigned char cookie_secret[8] = "";
-static char handshake_hash[32] = "";
-static struct etimer retransmit_timer;
-static SecurityParameters* secParam;
-static Connection* connection;
-static uint8_t send_error = 0;
+static unsigned char cookie_secret[DTLS_COOKIE_SECRET_LENGTH];
+static unsigned char old_cookie_secret[DTLS_COOKIE_SECRET_LENGTH]; //cookies handed out just before a rotation stay valid
+static unsigned char hello_cookie[DTLS_COOKIE_LENGTH];
+static struct etimer cookie_timer;
 static struct uip_udp_conn* udp_conn;
 static struct process* calling_process;
 static struct process* cur_process;
-static sha256_ctx ctx;
-static sha256_ctx ctxCopy;
-static char psk[10] = "secretPSK\0";
-static char* psk_identity = "this";
+static char psk[10] = "secretPSK\0"; //used when there is no keystore
+static char* client_psk_identity = "this";
+static char* psk_identity = "this"; //only valid while the ClientKeyExchange is built or looked at
 static uint16_t psk_identity_length = 4;
-static char* premaster_secret;
-static char master_secret[48] = "";
-static char client_write_key[16] = "";
-static char client_write_IV[4] ="";
-static char server_write_key[16] = "";
-static char server_write_IV[4] = "";
 static struct mmem mmem;
-static struct mmem psk_mmem;
-static struct mmem message_mmem; //store incoming record if it is fragmented
-static struct mmem data_mmem; //store outgoing application data until the new one is ready to be sent
-static struct mmem sec_mmem;
-static struct mmem conn_mmem;
 static char* buffer;
+MEMB(sessions_memb, dtls_session, MAX_CONNECTIONS);
+LIST(sessions);
+//the handles given to the app, they outlive their session until the app has seen DTLS_CLOSED
+MEMB(connections_memb, Connection, MAX_CONNECTIONS);
+static uint8_t connections_used = 0;
+static process_event_t connection_release_event;
+static dtls_session* session; //the peer whose record is being processed
+/*
+ * master secrets of finished handshakes. a server finds them by session id,
+ * a client by the address of the server it talked to
+ */
+static struct cached_session {
+	uip_ipaddr_t addr;
+	uint16_t port;
+	uint8_t id_len; //0 if the slot is free
+	char id[DTLS_SESSION_ID_LENGTH];
+	char master_secret[48];
+	unsigned long stored;
+} session_cache[DTLS_SESSION_CACHE];
 static char internal_error[] = { (char) 0x15, (char) 0xFE, (char) 0xFD,
 		(char)0x00,(char)0x00, (char)0x00, (char)0x00,(char)0x00,(char)0x00,
 		(char)0x00, (char)0x00, (char) 0x00, (char) 0x02, (char) 0x02, (char) 0x50 };
 #define UDP_IP_BUF   ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
-#define RETRANSMIT_INTERVAL 3
 
 
 /***************************************************************/
@@ -89,6 +79,8 @@ static char internal_error[] = { (char) 0x15, (char) 0xFE, (char) 0xFD,
 PROCESS(dtls_client_handshake_process, "1");
 PROCESS(dtls_server_listen, "2");
 
+static void generate_keying_material();
+
 static void send(char* data, int length){
 #if CONTIKI_TARGET_MINIMAL_NET
 	uint8_t i;
@@ -99,261 +91,681 @@ static void send(char* data, int length){
 	}
 	PRINTF("\n");
 #endif
-	sent_something = 1;
-	uip_udp_packet_send(udp_conn, data, length);
-	etimer_set(&retransmit_timer, CLOCK_CONF_SECOND*RETRANSMIT_INTERVAL);
+	session->sent_something = 1;
+	SEC_STATS_ADD(wire_out, length);
+	uip_udp_packet_sendto(udp_conn, data, length, &session->addr, session->port);
+}
+
+/*
+ * RFC 6347 4.2.4: a flight is built straight into the session's flight buffer and kept there
+ * until the peer answers, so a retransmission is the same bytes sent again
+ */
+static void flight_free(dtls_session* s){
+	if (s->flight_length != 0){
+		mmem_free(&s->flight);
+		s->flight_length = 0;
+	}
+}
+
+static char* flight_alloc(uint16_t length){
+	flight_free(session);
+	if (mmem_alloc(&session->flight, length)==0){
+		return NULL;
+	}
+	session->flight_length = length;
+	return (char*)MMEM_PTR(&session->flight);
+}
+
+static void retransmit_timer_set(){
+	//the timer has to belong to the dtls process even when called from dtls_write()
+	PROCESS_CONTEXT_BEGIN(cur_process);
+	etimer_set(&session->retransmit_timer, session->retransmit_interval);
+	PROCESS_CONTEXT_END(cur_process);
+}
+
+/*
+ * send the flight that was just built, the timeout starts over at DTLS_RETRANSMIT_INITIAL
+ */
+static void flight_send(){
+	send((char*)MMEM_PTR(&session->flight), session->flight_length);
+	SEC_STATS_FLIGHT_SENT(&session->stats);
+	session->retransmit_interval = DTLS_RETRANSMIT_INITIAL;
+	retransmit_timer_set();
+}
+
+/*
+ * writes made while a handshake runs wait in the session's pending buffer, each as
+ * length (2) and data, until the handshake is complete
+ */
+static void pending_free(dtls_session* s){
+	if (s->pending_length != 0){
+		mmem_free(&s->pending);
+		s->pending_length = 0;
+	}
+}
+
+static int pending_add(char* data, int length){
+	char* queue;
+	if (length < 0 || session->pending_length+2+length > DTLS_PENDING_WRITE
+			|| length+29 > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN){
+		return -1;
+	}
+	if (session->pending_length == 0 && mmem_alloc(&session->pending, DTLS_PENDING_WRITE)==0){
+		return -1;
+	}
+	queue = (char*)MMEM_PTR(&session->pending) + session->pending_length;
+	queue[0] = (char)((length >> 8) & 0xFF);
+	queue[1] = (char)(length & 0xFF);
+	memcpy(queue+2, data, length);
+	session->pending_length += 2+length;
+	return 0;
+}
+
+/*
+ * encrypt length bytes of data into an application data record at out: 13 bytes of record
+ * header and 8 bytes of explicit nonce, the ciphertext and the 8 byte CCM tag, length+29
+ * in all. data must not overlap out+21. returns 0 if encryption failed
+ */
+static uint8_t record_seal(char* out, char* data, uint16_t length){
+	uint8_t i;
+	for (i = 0; i < 4; i++){
+		if (server) nonce[i] = session->server_write_IV[i];
+		else nonce[i] = session->client_write_IV[i];
+	}
+	nonce[4] = (char)((session->current_epoch >> 8) & 0xFF);
+	additional_data[0] = nonce[4];
+	nonce[5] = (char)((session->current_epoch) & 0xFF);
+	additional_data[1] = nonce[5];
+	for (i = 0; i < 6; i++){
+		nonce[11-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
+		additional_data[7-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
+	}
+	additional_data[8] = 0x17;
+	additional_data[9] = 0xfe;
+	additional_data[10] = 0xfd;
+	additional_data[11] = (char)((length >> 8) & 0xFF);
+	additional_data[12] = (char)(length & 0xFF);
+	if(!encrypt(out+21, server ? &session->server_write_schedule : &session->client_write_schedule, nonce, data, length, additional_data)){
+		return 0;
+	}
+	create_application_data(out, length+16, session->next_send_seq, session->current_epoch);
+	session->next_send_seq++;
+	return 1;
+}
+
+/*
+ * the handshake is complete: seal the queued writes into as few datagrams as uIP takes,
+ * the first one starting with the last flight if with_flight is set. the new keys start
+ * with a fresh budget
+ */
+static void pending_flush(uint8_t with_flight){
+	char* packet = (char*)&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+	char* queue;
+	uint16_t position, length = 0, n;
+	session->overall_sent_data = 65535;
+	if (with_flight){
+		memcpy(packet, MMEM_PTR(&session->flight), session->flight_length);
+		length = session->flight_length;
+	}
+	for (position = 0; position < session->pending_length; position += 2+n){
+		queue = (char*)MMEM_PTR(&session->pending) + position;
+		n = ((unsigned char)queue[0]<<8) + (unsigned char)queue[1];
+		if (length+n+29 > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN){
+			send(packet, length);
+			length = 0;
+		}
+		if (!record_seal(packet+length, queue+2, n)){
+			break;
+		}
+		session->overall_sent_data -= n;
+		SEC_STATS_ADD(app_out, n);
+		length += n+29;
+	}
+	if (length != 0){
+		send(packet, length);
+	}
+	pending_free(session);
+}
+
+/*
+ * like flight_send() for the last flight of a handshake, the queued writes go out in the
+ * same datagram. retransmissions repeat the flight alone
+ */
+static void flight_send_last(){
+	pending_flush(1);
+	SEC_STATS_FLIGHT_SENT(&session->stats);
+	session->retransmit_interval = DTLS_RETRANSMIT_INITIAL;
+	retransmit_timer_set();
+}
+static uint8_t cache_expired(struct cached_session* c){
+	return c->id_len == 0 || clock_seconds() - c->stored > DTLS_SESSION_LIFETIME;
+}
+
+static struct cached_session* cache_find(char* id, uint8_t id_len){
+	uint8_t i;
+	if (id_len == 0 || id_len > DTLS_SESSION_ID_LENGTH){
+		return NULL;
+	}
+	for (i = 0; i < DTLS_SESSION_CACHE; i++){
+		if (!cache_expired(&session_cache[i]) && session_cache[i].id_len == id_len &&
+				memcmp(session_cache[i].id, id, id_len) == 0){
+			return &session_cache[i];
+		}
+	}
+	return NULL;
+}
+
+static struct cached_session* cache_find_peer(uip_ipaddr_t* addr, uint16_t port){
+	uint8_t i;
+	for (i = 0; i < DTLS_SESSION_CACHE; i++){
+		if (!cache_expired(&session_cache[i]) && session_cache[i].port == port &&
+				uip_ipaddr_cmp(&session_cache[i].addr, addr)){
+			return &session_cache[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * remember the session that just finished a full handshake, replacing the same peer or id,
+ * a free or expired slot, or else the oldest entry
+ */
+static void cache_store(dtls_session* s){
+	struct cached_session* c;
+	uint8_t i;
+	if (s->session_id_len == 0){
+		return;
+	}
+	c = server ? cache_find(s->session_id, s->session_id_len) : cache_find_peer(&s->addr, s->port);
+	for (i = 0; c == NULL && i < DTLS_SESSION_CACHE; i++){
+		if (cache_expired(&session_cache[i])){
+			c = &session_cache[i];
+		}
+	}
+	if (c == NULL){
+		c = &session_cache[0];
+		for (i = 1; i < DTLS_SESSION_CACHE; i++){
+			if (session_cache[i].stored < c->stored){
+				c = &session_cache[i];
+			}
+		}
+	}
+	uip_ipaddr_copy(&c->addr, &s->addr);
+	c->port = s->port;
+	c->id_len = s->session_id_len;
+	memcpy(c->id, s->session_id, s->session_id_len);
+	memcpy(c->master_secret, s->master_secret, 48);
+	c->stored = clock_seconds();
+}
+
+static void cache_remove(dtls_session* s){
+	struct cached_session* c = cache_find(s->session_id, s->session_id_len);
+	if (c != NULL){
+		crypto_wipe(c, sizeof(struct cached_session));
+	}
 }
+
 static void error(uint8_t level, uint8_t type){
-	if (server) num_connected--;
-
-	internal_error[3] = (char)((current_epoch>>8) & 0xFF);
-	internal_error[4] = (char)(current_epoch & 0xFF);
-	internal_error[5] = (char) ((next_send_seq >> 40) & 0xFF);
-	internal_error[6] = (char) ((next_send_seq >> 32) & 0xFF);
-	internal_error[7] = (char) ((next_send_seq >> 24) & 0xFF);
-	internal_error[8] = (char) ((next_send_seq >> 16) & 0xFF);
-	internal_error[9] = (char) ((next_send_seq >> 8) & 0xFF);
-	internal_error[10] = (char) (next_send_seq & 0xFF);
+	internal_error[3] = (char)((session->current_epoch>>8) & 0xFF);
+	internal_error[4] = (char)(session->current_epoch & 0xFF);
+	internal_error[5] = (char) ((session->next_send_seq >> 40) & 0xFF);
+	internal_error[6] = (char) ((session->next_send_seq >> 32) & 0xFF);
+	internal_error[7] = (char) ((session->next_send_seq >> 24) & 0xFF);
+	internal_error[8] = (char) ((session->next_send_seq >> 16) & 0xFF);
+	internal_error[9] = (char) ((session->next_send_seq >> 8) & 0xFF);
+	internal_error[10] = (char) (session->next_send_seq & 0xFF);
 	if (type == 80){
-		uip_udp_packet_send(udp_conn, internal_error, 15);
+		uip_udp_packet_sendto(udp_conn, internal_error, 15, &session->addr, session->port);
 	}
 	else {
-		if(!first_data_sent)mmem_free(&mmem);
-		first_data_sent = 1;
 		if(mmem_alloc(&mmem, 15)==0){
-			uip_udp_packet_send(udp_conn, internal_error, 15);
+			uip_udp_packet_sendto(udp_conn, internal_error, 15, &session->addr, session->port);
 		} else {
 			buffer = (char*)MMEM_PTR(&mmem);
-			create_alert(buffer, next_send_seq, current_epoch, level, type);
-			uip_udp_packet_send(udp_conn, buffer, 15);
+			create_alert(buffer, session->next_send_seq, session->current_epoch, level, type);
+			uip_udp_packet_sendto(udp_conn, buffer, 15, &session->addr, session->port);
 			mmem_free(&mmem);
 		}
 	}
-	send_error = 1;
-	alert_sent = type;
+	session->send_error = 1;
+	session->alert_sent = type;
+	if (level == 2 && session->expected_message != APPLICATION_DATA){
+		SEC_STATS_ADD(handshakes_failed, 1);
+	}
+	if (level == 2){
+		//a session that ended in a fatal alert must not be resumed
+		cache_remove(session);
+	}
 }
 
-static void retransmit(){
-
-	switch(expected_message){
-	case FIRST_CLIENT_HELLO:
-		if (mmem_alloc(&mmem,25)==0){
-			error(2,80);
-			return;
+static dtls_session* session_lookup(uip_ipaddr_t* addr, uint16_t port){
+	dtls_session* s;
+	for (s = list_head(sessions); s != NULL; s = list_item_next(s)){
+		if (s->port == port && uip_ipaddr_cmp(&s->addr, addr)){
+			return s;
 		}
-		buffer = (char*)MMEM_PTR(&mmem);
-		create_hello_request(buffer, next_send_seq, current_epoch);
-		next_send_seq++;
-		send(buffer, 25);
-		mmem_free(&mmem);
-		break;
-	case HELLO_VERIFY_REQUEST:
-		if(mmem_alloc(&mmem, 67)==0){
-			error(2, 80);
-			break;
-		} else {
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_second_client_hello(buffer, client_random, NULL, 0, next_send_seq, current_epoch, sent_message_seq_number);
-			next_send_seq++;
-			send(buffer, 67);
-			mmem_free(&mmem);
-		}
-		break;
-	case SERVER_HELLO:
-		if (mmem_alloc(&mmem, 67+psk_identity_length)==0){
-			error(2,80);
-			return;
-		}
-		buffer = (char*)MMEM_PTR(&mmem);
-		create_second_client_hello(buffer, client_random, psk_identity, psk_identity_length, next_send_seq, current_epoch, sent_message_seq_number);
-		send(buffer, 67+psk_identity_length);
-		next_send_seq++;
-		mmem_free(&mmem);
-		break;
-	case CLIENT_KEY_EXCHANGE:
-		if(mmem_alloc(&mmem, 88)==0){
-			error(2, 80);
-			return;
-		}
-		buffer = (char*)MMEM_PTR(&mmem);
-		create_next_server_hello(buffer, server_random, next_send_seq, current_epoch, sent_message_seq_number);
-		next_send_seq++; //need to increment since the above line creates 2 records
-		buffer[13] = 0x02; //wtf? without this buffer[13] magically changes to 0x01 :/
-		send(buffer, 88);
-		next_send_seq++;
-		mmem_free(&mmem);
-		break;
+	}
+	return NULL;
+}
 
+/*
+ * take a free slot for a new peer, NULL if max_connections peers are already served
+ */
+static void session_init(dtls_session* s, uip_ipaddr_t* addr, uint16_t port){
+	Connection* c = s->connection;
+	memset(s, 0, sizeof(dtls_session));
+	s->connection = c;
+	uip_ipaddr_copy(&s->addr, addr);
+	s->port = port;
+	s->expected_message = server ? FIRST_CLIENT_HELLO : HELLO_VERIFY_REQUEST;
+	s->overall_sent_data = 65535;
+	sha256_init(&s->ctx);
+	c->securityParameters = NULL;
+	c->conn = udp_conn;
+	c->session = s;
+	c->flags = 0;
+	SEC_STATS_HANDSHAKE_START(&s->stats);
+}
+
+static dtls_session* session_new(uip_ipaddr_t* addr, uint16_t port){
+	dtls_session* s;
+	if (list_length(sessions) >= max_connections){
+		return NULL;
+	}
+	s = memb_alloc(&sessions_memb);
+	if (s == NULL){
+		return NULL;
+	}
+	s->connection = memb_alloc(&connections_memb);
+	if (s->connection == NULL){
+		//the app has not seen DTLS_CLOSED of a previous peer yet
+		memb_free(&sessions_memb, s);
+		return NULL;
 	}
+	connections_used++;
+	session_init(s, addr, port);
+	list_add(sessions, s);
+	return s;
+}
+
+/*
+ * drop all partially received handshake messages of a session
+ */
+static void reassembly_clear(dtls_session* s){
 	uint8_t i;
-	if (server==0){
-		if (expected_message == CHANGE_CIPHER_SPEC){
+	for (i = 0; i < DTLS_REASSEMBLY_SLOTS; i++){
+		if (s->reassembly[i].used){
+			mmem_free(&s->reassembly[i].buf);
+			s->reassembly[i].used = 0;
+		}
+	}
+}
 
-			current_epoch--;
-			if(mmem_alloc(&mmem, psk_identity_length+27+14+53)==0){
-				error(2, 80);
-				return;
-			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_client_key_exchange(buffer, psk_identity, psk_identity_length, next_send_seq_copy, current_epoch, sent_message_seq_number);
-			next_send_seq_copy++;
-			create_change_cipher_spec(buffer+psk_identity_length+27, next_send_seq_copy, current_epoch);
-			next_send_seq_copy++;
-			current_epoch++; //incrementing the epoch!
-			finished_clear[0] = 0x14; //msg_type = finished
-			finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
-			finished_clear[4] = (char)((sent_message_seq_number>>8)&0xFF); finished_clear[5] = (char)((sent_message_seq_number) & 0xFF);
-			finished_clear[6] = 0x00; finished_clear[7] = 0x00; finished_clear[8] = 0x00; //frag_offset
-			finished_clear[9] = 0x00; finished_clear[10] = 0x00; finished_clear[11] = 0x0c; //frag_length
-			sha256_final(&ctx, (unsigned char*)handshake_hash);
-			PRF(finished_clear+12, master_secret, 48, "client finished", handshake_hash, 32, 12);
+/*
+ * forget the application data last handed to the app
+ */
+static void data_free(dtls_session* s){
+	if (s->data_kept){
+		mmem_free(&s->data);
+		s->data_kept = 0;
+	}
+}
 
-			for (i = 0; i < 4; i++){
-				nonce[i] = client_write_IV[i];
-			}
-			memcpy(nonce+4, &current_epoch, 2);
-			memcpy(additional_data, &current_epoch, 2);
-			for (i = 0; i < 6; i++){
-				nonce[6+i] = (char)((next_send_seq >> (8*i))&0xFF);
-				additional_data[2+i] = (char)((next_send_seq >> (8*i))&0xFF);
-			}
-			additional_data[8] = 0x16;
-			additional_data[9] = 0xfe;
-			additional_data[10] = 0xfd;
-			additional_data[11] = 0x00;
-			additional_data[12] = 0x18;
+/*
+ * the app learns from DTLS_CLOSED that the session behind c is gone. c is given back only once
+ * the event was delivered: events posted before it are read first and find c->session == NULL,
+ * c never stands for another peer while the app may still hold it
+ */
+static void connection_close(Connection* c){
+	c->session = NULL;
+	c->securityParameters = NULL;
+	c->flags = DTLS_CLOSED;
+	if (process_post(PROCESS_BROADCAST, dtls_event, (void*)c) != PROCESS_ERR_OK ||
+			process_post(cur_process, connection_release_event, (void*)c) != PROCESS_ERR_OK){
+		//the event queue is full, nothing will come back to free c later
+		memb_free(&connections_memb, c);
+		connections_used--;
+	}
+}
 
-			if(!encrypt(buffer+psk_identity_length+27+14+21, client_write_key, nonce, finished_clear, 24, additional_data)){
-				mmem_free(&mmem);
-				error(2,80);
-				return;
-			}
+static void session_remove(dtls_session* s){
+	Connection* c = s->connection;
+	etimer_stop(&s->retransmit_timer);
+	reassembly_clear(s);
+	data_free(s);
+	flight_free(s);
+	pending_free(s);
+	list_remove(sessions, s);
+	//keys and schedules must not linger in the free slot
+	crypto_wipe(s, sizeof(dtls_session));
+	memb_free(&sessions_memb, s);
+	if (session == s){
+		session = NULL;
+	}
+	connection_close(c);
+}
 
-			create_finished(buffer+psk_identity_length+27+14, next_send_seq, current_epoch);
-			send(buffer, psk_identity_length+94);
-			next_send_seq++;
-			mmem_free(&mmem);
-			sha256_final(&ctxCopy, (unsigned char*)handshake_hash);
+/*
+ * pick a new cookie secret, the previous one is kept to verify cookies that are still in flight
+ */
+static void cookie_secret_rotate(){
+	memcpy(old_cookie_secret, cookie_secret, DTLS_COOKIE_SECRET_LENGTH);
+	crypto_random(cookie_secret, DTLS_COOKIE_SECRET_LENGTH);
+}
+
+/*
+ * cookie = HMAC-SHA256(secret, client address | client port | ClientHello without the cookie), truncated to 16 bytes.
+ * hello points to the ClientHello body (behind the handshake header). returns 0 if the ClientHello is malformed
+ */
+static uint8_t create_cookie(unsigned char* cookie, const unsigned char* secret, uip_ipaddr_t* addr, uint16_t port, char* hello, uint16_t hello_length){
+	hmac_sha256_ctx cookie_ctx;
+	uint16_t position = 34; //version and random
+	if (hello_length <= position){
+		return 0;
+	}
+	position += (unsigned char)hello[position] + 1; //session id
+	if (hello_length <= position || hello_length < position + 1 + (unsigned char)hello[position]){
+		return 0;
+	}
+	hmac_sha256_init(&cookie_ctx, secret, DTLS_COOKIE_SECRET_LENGTH);
+	hmac_sha256_update(&cookie_ctx, (unsigned char*)addr, sizeof(uip_ipaddr_t));
+	hmac_sha256_update(&cookie_ctx, (unsigned char*)&port, 2);
+	hmac_sha256_update(&cookie_ctx, (unsigned char*)hello, position);
+	position += (unsigned char)hello[position] + 1; //skip the cookie itself
+	hmac_sha256_update(&cookie_ctx, (unsigned char*)hello+position, hello_length-position);
+	hmac_sha256_final(&cookie_ctx, cookie, DTLS_COOKIE_LENGTH);
+	return 1;
+}
+
+/*
+ * check the cookie a ClientHello carries against the current and the previous secret
+ */
+static uint8_t cookie_valid(uip_ipaddr_t* addr, uint16_t port, char* hello, uint16_t hello_length){
+	unsigned char expected[DTLS_COOKIE_LENGTH];
+	uint8_t i, k, diff;
+	uint16_t position;
+	if (hello_length <= 34 || hello_length <= 35 + (unsigned char)hello[34]){
+		return 0;
+	}
+	position = 35 + (unsigned char)hello[34];
+	if ((unsigned char)hello[position] != DTLS_COOKIE_LENGTH || hello_length < position + 1 + DTLS_COOKIE_LENGTH){
+		return 0;
+	}
+	position++;
+	for (k = 0; k < 2; k++){
+		create_cookie(expected, k == 0 ? cookie_secret : old_cookie_secret, addr, port, hello, hello_length);
+		diff = 0;
+		for (i = 0; i < DTLS_COOKIE_LENGTH; i++){
+			diff |= expected[i] ^ (unsigned char)hello[position+i];
 		}
-	} else {
-		if (expected_message == APPLICATION_DATA){
-			current_epoch--;
-			if(!first_data_sent){
-				mmem_free(&mmem);
-				first_data_sent = 1;
-			}
-			if(mmem_alloc(&mmem, 14+53)==0){
-				error(2, 80);
-				return;
-			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_change_cipher_spec(buffer, next_send_seq_copy, current_epoch);
-			next_send_seq_copy++;
-			current_epoch++; //incrementing the epoch!
-			sha256_final(&ctx, (unsigned char*)handshake_hash);
-			//create finished_clear
-			finished_clear[0] = 0x14; //msg_type = finished
-			finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
-			finished_clear[4] = (char)(((sent_message_seq_number+1)>>8)&0xFF); finished_clear[5] = (char)(((sent_message_seq_number+1)) & 0xFF);
-			finished_clear[6] = 0x00; finished_clear[7] = 0x00; finished_clear[8] = 0x00; //frag_offset
-			finished_clear[9] = 0x00; finished_clear[10] = 0x00; finished_clear[11] = 0x0c; //frag_length
+		if (diff == 0){
+			return 1;
+		}
+	}
+	return 0;
+}
 
-			PRF(finished_clear+12, master_secret, 48, "server finished", handshake_hash, 32, 12);
-			for (i = 0; i < 4; i++){
-				nonce[i] = server_write_IV[i];
-			}
-			memcpy(nonce+4, &current_epoch, 2);
-			memcpy(additional_data, &current_epoch, 2);
-			for (i = 0; i < 6; i++){
-				nonce[6+i] = (char)((next_send_seq >> (8*i))&0xFF);
-				additional_data[2+i] = (char)((next_send_seq >> (8*i))&0xFF);
+/*
+ * a server answers ClientHellos from peers it holds no state for without allocating anything:
+ * a HelloVerifyRequest if the cookie is missing or wrong, a fresh session only once it comes back valid.
+ * returns 1 if the datagram should be processed with the (new) session
+ */
+static uint8_t accept_client_hello(char* input, uint16_t input_length){
+	uip_ipaddr_t addr;
+	uint16_t port;
+	uint16_t msg_length = ((unsigned char)input[11]<<8) + (unsigned char)input[12];
+	uint16_t msg_seq;
+	uint32 hello_length;
+	char hello_verify[44];
+	if (input_length < 25 || msg_length > input_length - 13 || msg_length < 12){
+		return 0;
+	}
+	//only accept an unfragmented ClientHello, there is nowhere to keep fragments yet
+	hello_length = ((uint32)(unsigned char)input[15]<<8) + (unsigned char)input[16];
+	if (input[14] != 0 || hello_length + 12 > msg_length ||
+			input[19] != 0 || input[20] != 0 || input[21] != 0 ||
+			input[22] != input[14] || input[23] != input[15] || input[24] != input[16]){
+		return 0;
+	}
+	msg_seq = ((unsigned char)input[17]<<8) + (unsigned char)input[18];
+	uip_ipaddr_copy(&addr, &UDP_IP_BUF->srcipaddr);
+	port = UDP_IP_BUF->srcport;
+	//RFC 6347 4.2.1 would let a resumption skip the cookie exchange, but the session id travels in the
+	//clear: every peer proves its address first, before any state is kept or a flight is sent to it
+	if (cookie_valid(&addr, port, input+25, hello_length)){
+		if (session == NULL){
+			session = session_new(&addr, port);
+			if (session == NULL){
+				return 0;
 			}
-			additional_data[8] = 0x16;
-			additional_data[9] = 0xfe;
-			additional_data[10] = 0xfd;
-			additional_data[11] = 0x00;
-			additional_data[12] = 0x18;
+		} else {
+			//the peer started over, drop whatever was left from the old association
+			etimer_stop(&session->retransmit_timer);
+			reassembly_clear(session);
+			flight_free(session);
+			data_free(session);
+			session_init(session, &addr, port);
+		}
+		//continue as if the HelloVerifyRequest had been sent from this session
+		session->expected_message = SECOND_CLIENT_HELLO;
+		session->sent_message_seq_number = 1;
+		session->rcvd_message_seq_number = msg_seq;
+		session->next_send_seq = 1;
+		return 1;
+	}
+	if (!create_cookie(hello_cookie, cookie_secret, &addr, port, input+25, hello_length)){
+		return 0;
+	}
+	//RFC 6347 4.2.1: the HelloVerifyRequest echoes the record sequence number of the ClientHello
+	memcpy(hello_verify, input, 13);
+	create_helloverify_request(hello_verify, hello_cookie,
+			((uint64)(unsigned char)input[5]<<40) + ((uint64)(unsigned char)input[6]<<32) +
+			((uint64)(unsigned char)input[7]<<24) + ((uint64)(unsigned char)input[8]<<16) +
+			((uint64)(unsigned char)input[9]<<8) + (unsigned char)input[10], 0, 0);
+	uip_udp_packet_sendto(udp_conn, hello_verify, 44, &addr, port);
+	return 0;
+}
 
-			if(!encrypt(buffer+14+21, server_write_key, nonce, finished_clear, 24, additional_data)){
-				mmem_free(&mmem);
-				error(2,80);
-				return;
-			}
-			create_finished(buffer+14, next_send_seq, current_epoch);
-			send(buffer, 67);
-			next_send_seq++;
-			mmem_free(&mmem);
+/*
+ * ChangeCipherSpec followed by the encrypted Finished over session->handshake_hash (14+53 bytes),
+ * used by the abbreviated handshake. moves on to the next epoch,
+ * the caller increments next_send_seq once the records are sent
+ */
+static uint8_t create_ccs_finished(char* out, char* label, uint16_t msn){
+	uint8_t i;
+	create_change_cipher_spec(out, session->next_send_seq, session->current_epoch);
+	session->next_send_seq_copy = session->next_send_seq+1;
+	session->current_epoch++; //incrementing the epoch!
+	session->next_send_seq = 0;
+	finished_clear[0] = 0x14; //msg_type = finished
+	finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
+	finished_clear[4] = (char)((msn>>8)&0xFF); finished_clear[5] = (char)(msn & 0xFF);
+	finished_clear[6] = 0x00; finished_clear[7] = 0x00; finished_clear[8] = 0x00; //frag_offset
+	finished_clear[9] = 0x00; finished_clear[10] = 0x00; finished_clear[11] = 0x0c; //frag_length
+	PRF_keyed(finished_clear+12, &session->master_key, label, session->handshake_hash, 32, 12);
+	for (i = 0; i < 4; i++){
+		nonce[i] = server ? session->server_write_IV[i] : session->client_write_IV[i];
+	}
+	nonce[4] = (char)((session->current_epoch >> 8) & 0xFF);
+	additional_data[0] = nonce[4];
+	nonce[5] = (char)((session->current_epoch) & 0xFF);
+	additional_data[1] = nonce[5];
+	for (i = 0; i < 6; i++){
+		nonce[11-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
+		additional_data[7-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
+	}
+	additional_data[8] = 0x16;
+	additional_data[9] = 0xfe;
+	additional_data[10] = 0xfd;
+	additional_data[11] = 0x00;
+	additional_data[12] = 0x18;
+	if (!encrypt(out+14+21, server ? &session->server_write_schedule : &session->client_write_schedule, nonce, finished_clear, 24, additional_data)){
+		return 0;
+	}
+	create_finished(out+14, session->next_send_seq, session->current_epoch);
+	return 1;
+}
+
+/*
+ * server side of an abbreviated handshake: ServerHello, ChangeCipherSpec and Finished in one datagram
+ */
+static void send_resumed_server_flight(){
+	uint16_t hello_length = 63+session->session_id_len;
+	buffer = flight_alloc(hello_length+67);
+	if (buffer == NULL){
+		error(2,80);
+		return;
+	}
+	create_server_hello(buffer, NULL, session->session_id, session->session_id_len, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+	session->next_send_seq++;
+	memcpy(session->server_random, buffer+27, 32);
+	sha256_update(&session->ctx, (unsigned char*)buffer+13, hello_length-13);
+	generate_keying_material();
+	//the server's Finished covers ClientHello and ServerHello
+	session->ctxCopy = session->ctx;
+	sha256_final(&session->ctxCopy, (unsigned char*)session->handshake_hash);
+	if (!create_ccs_finished(buffer+hello_length, "server finished", session->sent_message_seq_number+1)){
+		flight_free(session);
+		error(2,80);
+		return;
+	}
+	sha256_update(&session->ctx, (unsigned char*)finished_clear, 24);
+	flight_send();
+	session->next_send_seq++;
+}
+
+/*
+ * client side of an abbreviated handshake: ChangeCipherSpec and Finished answer the server's Finished
+ */
+static void send_resumed_client_flight(){
+	buffer = flight_alloc(67);
+	if (buffer == NULL){
+		error(2,80);
+		return;
+	}
+	if (!create_ccs_finished(buffer, "client finished", session->sent_message_seq_number)){
+		flight_free(session);
+		error(2,80);
+		return;
+	}
+	session->next_send_seq++;
+	flight_send_last();
+}
+
+/*
+ * send the stored flight again and back off. the records up to a ChangeCipherSpec get fresh
+ * sequence numbers of their epoch so the peer's replay window lets them through, the encrypted
+ * Finished behind it keeps its number since the nonce and MAC depend on it
+ */
+static void retransmit(){
+	char* record;
+	uint16_t position, length;
+	uint8_t epoch_changed = 0;
+	uint64* seq;
+	if (session->flight_length == 0){
+		return;
+	}
+	record = (char*)MMEM_PTR(&session->flight);
+	for (position = 0; position + 13 <= session->flight_length; position += 13 + length){
+		length = ((unsigned char)record[position+11]<<8) + (unsigned char)record[position+12];
+		if (record[position] == 0x14){
+			epoch_changed = 1;
+		}
+	}
+	//once the ChangeCipherSpec went out, next_send_seq_copy continues the old epoch
+	seq = epoch_changed ? &session->next_send_seq_copy : &session->next_send_seq;
+	for (position = 0; position + 13 <= session->flight_length; position += 13 + length){
+		length = ((unsigned char)record[position+11]<<8) + (unsigned char)record[position+12];
+		record[position+5] = (char)((*seq >> 40) & 0xFF);
+		record[position+6] = (char)((*seq >> 32) & 0xFF);
+		record[position+7] = (char)((*seq >> 24) & 0xFF);
+		record[position+8] = (char)((*seq >> 16) & 0xFF);
+		record[position+9] = (char)((*seq >> 8) & 0xFF);
+		record[position+10] = (char)(*seq & 0xFF);
+		(*seq)++;
+		if (record[position] == 0x14){
+			break;
 		}
 	}
+	send(record, session->flight_length);
+	SEC_STATS_RETRANSMIT(&session->stats);
+	//RFC 6347 4.2.4.1: double the timeout up to DTLS_RETRANSMIT_MAX
+	if (session->retransmit_interval > DTLS_RETRANSMIT_MAX/2){
+		session->retransmit_interval = DTLS_RETRANSMIT_MAX;
+	} else {
+		session->retransmit_interval *= 2;
+	}
+	retransmit_timer_set();
 }
 
 static void rehandshake(){
-	overall_sent_data=0;
-	if(!first_data_sent)mmem_free(&mmem);
-	first_data_sent = 1;
-	if (!first_data)mmem_free(&data_mmem);
-	first_data = 1;
-	sha256_init(&ctx);
+	SEC_STATS_HANDSHAKE_START(&session->stats);
+	session->overall_sent_data=0;
+	reassembly_clear(session);
+	data_free(session);
+	sha256_init(&session->ctx);
 	if (server){
-		if (mmem_alloc(&mmem,25)==0){
+		buffer = flight_alloc(25);
+		if (buffer == NULL){
 			error(2,80);
 			return;
 		}
-		buffer = (char*)MMEM_PTR(&mmem);
-		create_hello_request(buffer, next_send_seq, current_epoch);
-		next_send_seq++;
-		send(buffer, 25);
-		expected_message = FIRST_CLIENT_HELLO;
-		sent_message_seq_number = 0;
-		rcvd_message_seq_number = 0;
-		handshake_done = 0;
-		mmem_free(&mmem);
+		create_hello_request(buffer, session->next_send_seq, session->current_epoch);
+		session->next_send_seq++;
+		flight_send();
+		session->expected_message = FIRST_CLIENT_HELLO;
+		session->sent_message_seq_number = 0;
+		session->rcvd_message_seq_number = 0;
+		session->handshake_done = 0;
 	} else {
-		sent_message_seq_number = 0;
-		rcvd_message_seq_number = 0;
-		handshake_done = 0;
-		if (mmem_alloc(&mmem, 67)==0){
+		session->sent_message_seq_number = 0;
+		session->rcvd_message_seq_number = 0;
+		session->handshake_done = 0;
+		buffer = flight_alloc(67+session->session_id_len);
+		if (buffer == NULL){
 			error(2,80);
 			return;
 		}
-		buffer = (char*)MMEM_PTR(&mmem);
-		create_first_client_hello(buffer, next_send_seq, current_epoch, sent_message_seq_number);
-		next_send_seq++;
+		//offer the current session, the server may renegotiate on the same master_secret
+		create_first_client_hello(buffer, session->session_id, session->session_id_len, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+		session->next_send_seq++;
 		uint8_t i;
 		for (i = 0; i < 32; i++){
-			client_random[i] = buffer[27+i];
+			session->client_random[i] = buffer[27+i];
 		}
-		send(buffer, 67);
-		mmem_free(&mmem);
-		expected_message = HELLO_VERIFY_REQUEST;
+		//hashed in case the server answers without a HelloVerifyRequest
+		sha256_update(&session->ctx, (unsigned char*)buffer+13, 54+session->session_id_len);
+		flight_send();
+		session->expected_message = HELLO_VERIFY_REQUEST;
 	}
-	dtls_flags = DTLS_REHANDSHAKE;
-	dtls_event = process_alloc_event();
-	process_post(PROCESS_BROADCAST, dtls_event, NULL);
+	session->connection->flags = DTLS_REHANDSHAKE;
+	process_post(PROCESS_BROADCAST, dtls_event, (void*)session->connection);
 }
 /***************************************************************/
 /*                          API Calls                          */
 /***************************************************************/
 
-void dtls_connect(uip_ipaddr_t *ripaddr, uint16_t port) {
+static void events_alloc(){
+	if (dtls_event == 0){
+		dtls_event = process_alloc_event();
+		connection_release_event = process_alloc_event();
+	}
+}
+
+Connection* dtls_connect(uip_ipaddr_t *ripaddr, uint16_t port) {
 
 #if CONTIKI_TARGET_MINIMAL_NET
 mmem_init();
 #endif
 	server = 0;
-	expected_message = HELLO_VERIFY_REQUEST;
+	max_connections = 1;
 	Data data = { ripaddr, port };
-	if(mmem_alloc(&sec_mmem, sizeof(SecurityParameters))==0){
-		return;
-	}
-	secParam = (SecurityParameters*)MMEM_PTR(&sec_mmem);
-	if(mmem_alloc(&conn_mmem, sizeof(Connection))==0){
-		return;
-	}
-	connection = (Connection*)MMEM_PTR(&conn_mmem);
 	calling_process = PROCESS_CURRENT();
+	events_alloc();
 	process_start(&dtls_client_handshake_process, (void*) &data);
-
+	//the process ran up to its first yield, the session exists once the ClientHello is out
+	dtls_session* s = list_head(sessions);
+	return s != NULL ? s->connection : NULL;
 }
 
 int dtls_listen(uint16_t port, uint8_t max_conn) {
@@ -361,87 +773,66 @@ int dtls_listen(uint16_t port, uint8_t max_conn) {
 #if CONTIKI_TARGET_MINIMAL_NET
 mmem_init();
 #endif
-	if (max_conn > MAX_CONNECTIONS) {
+	if (max_conn == 0 || max_conn > MAX_CONNECTIONS) {
 		return -1;
 	}
 	server = 1;
-	expected_message = FIRST_CLIENT_HELLO;
 	max_connections = max_conn;
-	if(mmem_alloc(&sec_mmem, sizeof(SecurityParameters))==0){
-		return -1;
-	}
-	secParam = (SecurityParameters*)MMEM_PTR(&sec_mmem);
-	if(mmem_alloc(&conn_mmem, sizeof(Connection))==0){
-		return -1;
-	}
-	connection = (Connection*)MMEM_PTR(&conn_mmem);
+	listen_port = port;
 	calling_process = PROCESS_CURRENT();
-	process_start(&dtls_server_listen, (void*) &port);
+	events_alloc();
+	process_start(&dtls_server_listen, NULL);
 	return 0;
 }
 
 int dtls_write(Connection* conn, char* toWrite, int length){
-	if (expected_message != APPLICATION_DATA){
-			return -1;
+	int result;
+	session = conn->session;
+	if (session == NULL){
+		return -1;
 	}
-	if(overall_sent_data<length){
-		rehandshake();
-		return 0;
+	if(length+29 > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN){
+		//would never fit into one datagram, nothing is counted or queued
+		return -1;
 	}
-	overall_sent_data-=length;
-	uint8_t i;
-	udp_conn = conn->conn;
-	for (i = 0; i < 4; i++){
-		if (server) nonce[i] = server_write_IV[i];
-		else nonce[i] = client_write_IV[i];
+	if (session->expected_message != APPLICATION_DATA){
+		//sent as soon as the handshake is complete
+		return pending_add(toWrite, length);
 	}
-	nonce[4] = (char)((current_epoch >> 8) & 0xFF);
-	additional_data[0] = nonce[4];
-	nonce[5] = (char)((current_epoch) & 0xFF);
-	additional_data[1] = nonce[5];
-	for (i = 0; i < 6; i++){
-		nonce[11-i] = (char)((next_send_seq >> (8*i))&0xFF);
-		additional_data[7-i] = (char)((next_send_seq >> (8*i))&0xFF);
+	if(session->overall_sent_data<length){
+		//queued first, the new hello is built in uip_buf where toWrite may be
+		result = pending_add(toWrite, length);
+		rehandshake();
+		return result;
 	}
-	additional_data[8] = 0x17;
-	additional_data[9] = 0xfe;
-	additional_data[10] = 0xfd;
-	additional_data[11] = (char)((length >> 8) & 0xFF);
-	additional_data[12] = (char)(length & 0xFF);
-	if (!first_data_sent){
-		mmem_free(&mmem);
+	session->overall_sent_data-=length;
+	/*
+	 * build the record right where uIP sends it from, see record_seal()
+	 */
+	char* encrypted = (char*)&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+	if (toWrite != encrypted+21 && toWrite < encrypted+length+29 && toWrite+length > encrypted){
+		//plaintext already sits in the packet buffer but not in place
+		memmove(encrypted+21, toWrite, length);
+		toWrite = encrypted+21;
 	}
-	first_data_sent = 0;
-	if(mmem_alloc(&mmem, length+29)==0){
-		error(2, 80);
+	if (!record_seal(encrypted, toWrite, length)){
+		error(2,80);
 		return -1;
 	}
-	char* encrypted = (char*)MMEM_PTR(&mmem);
-	start = clock_time();
-	if (server){
-		if(!encrypt(encrypted+21, server_write_key, nonce, toWrite, length, additional_data)){
-			mmem_free(&mmem);
-			error(2,80);
-			return -1;
-		}
-	} else {
-		if(!encrypt(encrypted+21, client_write_key, nonce, toWrite, length, additional_data)){
-			mmem_free(&mmem);
-			error(2,80);
-			return -1;
-		}
-	}
-
-	create_application_data(encrypted, length+16, next_send_seq, current_epoch);
-	next_send_seq++;
+	SEC_STATS_ADD(app_out, length);
 	send(encrypted, length+29);
-	etimer_stop(&retransmit_timer);
+	etimer_stop(&session->retransmit_timer);
 
 	return 0;
 }
 
 void dtls_close(Connection* conn){
+	session = conn->session;
+	if (session == NULL){
+		return;
+	}
 	error(1,0);
+	session_remove(session);
 }
 
 static uint8_t check_finished_correctness(char* finished){
@@ -449,8 +840,8 @@ static uint8_t check_finished_correctness(char* finished){
 			finished[2]!=0x00 || finished[3]!=0x0c){
 		return 0;
 	}
-	if (finished[4] != (char)((rcvd_message_seq_number >> 8)&0xFF) ||
-			finished[5] != (char)((rcvd_message_seq_number) & 0xFF)){
+	if (finished[4] != (char)((session->rcvd_message_seq_number >> 8)&0xFF) ||
+			finished[5] != (char)((session->rcvd_message_seq_number) & 0xFF)){
 		return 0;
 	}
 	if (finished[6]!=0x00 || finished[7]!=0x00 || finished[8]!=0x00){
@@ -460,140 +851,177 @@ static uint8_t check_finished_correctness(char* finished){
 		return 0;
 	}
 	char out[12];
-	if (server){
-		PRF(out, master_secret, 48, "client finished", handshake_hash, 32, 12);
-		if (strncmp(finished+12,out,12)!=0){
-			return 0;
-		}
-	} else {
-		PRF(out, master_secret, 48, "server finished", handshake_hash, 32, 12);
-		if (strncmp(finished+12, out, 12)!=0){
-			return 0;
-		}
-	}
-	return 1;
+	uint8_t ok;
+	PRF_keyed(out, &session->master_key, server ? "client finished" : "server finished", session->handshake_hash, 32, 12);
+	ok = crypto_equal(finished+12, out, 12);
+	crypto_wipe(out, sizeof(out));
+	return ok;
 }
 
-static void generate_premaster_secret(char* ps, char* localpsk){
-	uint16_t n = strlen(localpsk);
-
-	uint8_t i;
-	premaster_secret[0]=(char)((n>>8) & 0xFF);
-	premaster_secret[1]=(char)(n & 0xFF);
+static void generate_premaster_secret(char* ps, char* localpsk, uint16_t n){
+	uint16_t i;
+	ps[0]=(char)((n>>8) & 0xFF);
+	ps[1]=(char)(n & 0xFF);
 	for (i = 0; i < n; i++){
-		premaster_secret[2+i] = 0x00;
-		premaster_secret[n+4+i] = localpsk[i];
+		ps[2+i] = 0x00;
+		ps[n+4+i] = localpsk[i];
 	}
-	premaster_secret[n+2]=(char)((n>>8) & 0xFF);
-	premaster_secret[n+3]=(char)(n & 0xFF);
+	ps[n+2]=(char)((n>>8) & 0xFF);
+	ps[n+3]=(char)(n & 0xFF);
 
 }
 
-static void generate_master_secret(){
+static void generate_master_secret(char* premaster_secret, uint16_t premaster_length){
 	/*
 	 * calculate master secret
 	 * RFC5246 section 8.1
-	 * master_secret = PRF(pre_master_secret, "master secret",
+	 * session->master_secret = PRF(pre_master_secret, "master secret",
 	 * 						ClientHello.random + ServerHello.random)[0..47];
 	 */
 
 	char seed[64];
-	memcpy(seed, client_random, 32);
-	memcpy(seed+32, server_random, 32);
-	PRF(master_secret, premaster_secret, 22, "master secret", seed, 64, 48);
+	memcpy(seed, session->client_random, 32);
+	memcpy(seed+32, session->server_random, 32);
+	PRF(session->master_secret, premaster_secret, premaster_length, "master secret", seed, 64, 48);
 	return ;
 
 
 }
 
+/*
+ * key of identity from the keystore. without a keystore only the built-in
+ * identity is known and gets the built-in psk.
+ * returns the length of the key, 0 for an unknown identity
+ */
+static int lookup_psk(char* identity, uint16_t length, char* key){
+	int n;
+	if (length > 255){
+		return 0;
+	}
+	n = psk_store_lookup(identity, length, key, PSK_STORE_MAX_KEY);
+	if (n < 0){
+		if (length != strlen(client_psk_identity) || strncmp(identity, client_psk_identity, length) != 0){
+			return 0;
+		}
+		n = strlen(psk);
+		memcpy(key, psk, n);
+	}
+	return n;
+}
+
 static void generate_keying_material(){
 
 	char seed[64];
-	memcpy(seed, server_random, 32);
-	memcpy(seed+32, client_random, 32);
+	memcpy(seed, session->server_random, 32);
+	memcpy(seed+32, session->client_random, 32);
 	char out[40];
-	PRF(out, master_secret, 48, "key expansion", seed, 64, 40);
-	memcpy(client_write_key, out, 16);
-	memcpy(server_write_key, out+16, 16);
-	memcpy(client_write_IV, out+32, 4);
-	memcpy(server_write_IV, out+36, 4);
-
-		return ;
+	//the Finished messages are derived under the same key, prepare it once for all of them
+	PRF_key(&session->master_key, session->master_secret, 48);
+	PRF_keyed(out, &session->master_key, "key expansion", seed, 64, 40);
+	memcpy(session->client_write_key, out, 16);
+	memcpy(session->server_write_key, out+16, 16);
+	memcpy(session->client_write_IV, out+32, 4);
+	memcpy(session->server_write_IV, out+36, 4);
+	AES_set_encrypt_key((unsigned char*)session->client_write_key, &session->client_write_schedule);
+	AES_set_encrypt_key((unsigned char*)session->server_write_key, &session->server_write_schedule);
+	crypto_wipe(out, sizeof(out));
+}
 
+/*
+ * once both Finished are through nothing derives from the master secret
+ * any more, a resumption takes it from session_cache
+ */
+static void handshake_wipe(dtls_session* s){
+	crypto_wipe(s->master_secret, sizeof(s->master_secret));
+	crypto_wipe(&s->master_key, sizeof(s->master_key));
+	crypto_wipe(s->handshake_hash, sizeof(s->handshake_hash));
+	crypto_wipe(&s->ctxCopy, sizeof(s->ctxCopy));
 }
 
 static void response_to_server_messages(int result){
 	if (result!=1){
 		error(2, result);
 	} else {
+		char localpsk[PSK_STORE_MAX_KEY];
+		char premaster_secret[2*PSK_STORE_MAX_KEY+4]; //RFC 4279 section 2
+		int psk_length;
 
-		switch(expected_message){
+		switch(session->expected_message){
 		case HELLO_VERIFY_REQUEST:
-			if (mmem_alloc(&mmem, 67+psk_identity_length)==0){
+			buffer = flight_alloc(67+session->session_id_len+session->cookie_len);
+			if (buffer == NULL){
 				error(2,80);
 				return;
 			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_second_client_hello(buffer, client_random, psk_identity, psk_identity_length, next_send_seq, current_epoch, sent_message_seq_number);
-			sha256_update(&ctx, (unsigned char*)buffer+13, psk_identity_length+54);
-			send(buffer, 67+psk_identity_length);
-			next_send_seq++;
-			mmem_free(&mmem);
-			expected_message = SERVER_HELLO;
+			create_second_client_hello(buffer, session->client_random, session->session_id, session->session_id_len, session->cookie, session->cookie_len, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+			//the handshake hash starts over with the ClientHello that carries the cookie
+			sha256_init(&session->ctx);
+			sha256_update(&session->ctx, (unsigned char*)buffer+13, session->session_id_len+session->cookie_len+54);
+			flight_send();
+			session->next_send_seq++;
+			session->expected_message = SERVER_HELLO;
 			break;
 		case SERVER_HELLO:
+			if (session->resumed){
+				//the server accepted our session id, the cached master_secret is all we need
+				generate_keying_material();
+				session->expected_message = CHANGE_CIPHER_SPEC;
+				break;
+			}
 			/*
 			 * generate premaster secret
 			 * RFC4279 section 2
 			 */
 
-			if(mmem_alloc(&mmem, 2*strlen(psk)+4)==0){
+			psk_length = lookup_psk(client_psk_identity, strlen(client_psk_identity), localpsk);
+			if (psk_length == 0){
+				//the keystore has no key for our own identity
 				error(2, 80);
 				return;
 			}
-			premaster_secret = (char*)MMEM_PTR(&mmem);
-			generate_premaster_secret(premaster_secret, psk);
-			generate_master_secret();
+			generate_premaster_secret(premaster_secret, localpsk, psk_length);
+			generate_master_secret(premaster_secret, 2*psk_length+4);
 			generate_keying_material();
 
 #if CONTIKI_TARGET_MINIMAL_NET
 			uint8_t j;
 			PRINTF("client random: ");
 			for (j = 0; j < 32; j++){
-				PRINTF("%02X ", (unsigned char)client_random[j]);
+				PRINTF("%02X ", (unsigned char)session->client_random[j]);
 			}
 			PRINTF("\nserver random: ");
 			for (j = 0; j < 32; j++){
-				PRINTF("%02X ", (unsigned char)server_random[j]);
+				PRINTF("%02X ", (unsigned char)session->server_random[j]);
 			}
 			PRINTF("\npremaster secret: ");
-			for (j = 0; j < 2*strlen(psk)+4; j++){
+			for (j = 0; j < 2*psk_length+4; j++){
 				PRINTF("%02X ", (unsigned char)premaster_secret[j]);
 			}
 			PRINTF("\nmaster secret: ");
 			for (j = 0; j < 48; j++){
-				PRINTF("%02X ", (unsigned char)master_secret[j]);
+				PRINTF("%02X ", (unsigned char)session->master_secret[j]);
 			}
 			PRINTF("\nclient write key: ");
 			for (j = 0; j < 16; j++){
-				PRINTF("%02X ", (unsigned char)client_write_key[j]);
+				PRINTF("%02X ", (unsigned char)session->client_write_key[j]);
 			}
 			PRINTF("\nserver write key: ");
 			for (j = 0; j < 16; j++){
-				PRINTF("%02X ", (unsigned char)server_write_key[j]);
+				PRINTF("%02X ", (unsigned char)session->server_write_key[j]);
 			}
 			PRINTF("\nclient write IV: ");
 			for (j = 0; j < 4; j++){
-				PRINTF("%02X ", (unsigned char)client_write_IV[j]);
+				PRINTF("%02X ", (unsigned char)session->client_write_IV[j]);
 			}
 			PRINTF("\nserver write IV: ");
 			for (j = 0; j < 4; j++){
-				PRINTF("%02X ", (unsigned char)server_write_IV[j]);
+				PRINTF("%02X ", (unsigned char)session->server_write_IV[j]);
 			}
 			PRINTF("\n");
 #endif
-			mmem_free(&mmem);
-			expected_message = SERVER_HELLO_DONE;
+			crypto_wipe(localpsk, sizeof(localpsk));
+			crypto_wipe(premaster_secret, sizeof(premaster_secret));
+			session->expected_message = SERVER_HELLO_DONE;
 			break;
 		case SERVER_HELLO_DONE:
 			/*send ClientKeyExchange + ChangeCipherSuite + Finished
@@ -601,47 +1029,47 @@ static void response_to_server_messages(int result){
 			changeCipherSpec has length 14
 			Finished has length 53*/
 
-			psk_identity = "this";
-			psk_identity_length = 4;
-			if(mmem_alloc(&mmem, psk_identity_length+27+14+53)==0){
+			psk_identity = client_psk_identity;
+			psk_identity_length = strlen(client_psk_identity);
+			buffer = flight_alloc(psk_identity_length+27+14+53);
+			if (buffer == NULL){
 				error(2, 80);
 				return;
 			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_client_key_exchange(buffer, psk_identity, psk_identity_length, next_send_seq, current_epoch, sent_message_seq_number);
-			next_send_seq++;
-			sha256_update(&ctx, (unsigned char*)buffer+13, psk_identity_length+14);
+			create_client_key_exchange(buffer, psk_identity, psk_identity_length, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+			session->next_send_seq++;
+			sha256_update(&session->ctx, (unsigned char*)buffer+13, psk_identity_length+14);
 
-			create_change_cipher_spec(buffer+psk_identity_length+27, next_send_seq, current_epoch);
+			create_change_cipher_spec(buffer+psk_identity_length+27, session->next_send_seq, session->current_epoch);
 
-			next_send_seq++;
-			next_send_seq_copy = next_send_seq;
-			current_epoch++; //incrementing the epoch!
-			next_send_seq=0;
+			session->next_send_seq++;
+			session->next_send_seq_copy = session->next_send_seq;
+			session->current_epoch++; //incrementing the epoch!
+			session->next_send_seq=0;
 
 			//copy a sha256 context so that it can be used later for verifying the hash received from the server
-			ctxCopy = ctx;
+			session->ctxCopy = session->ctx;
 			//encrypt the hash of all previous messages of the handshake!
-			sha256_final(&ctx, (unsigned char*)handshake_hash);
+			sha256_final(&session->ctx, (unsigned char*)session->handshake_hash);
 			//create finished_clear
 			finished_clear[0] = 0x14; //msg_type = finished
 			finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
-			finished_clear[4] = (char)(((sent_message_seq_number+1)>>8)&0xFF); finished_clear[5] = (char)(((sent_message_seq_number+1)) & 0xFF);
+			finished_clear[4] = (char)(((session->sent_message_seq_number+1)>>8)&0xFF); finished_clear[5] = (char)(((session->sent_message_seq_number+1)) & 0xFF);
 			finished_clear[6] = 0x00; finished_clear[7] = 0x00; finished_clear[8] = 0x00; //frag_offset
 			finished_clear[9] = 0x00; finished_clear[10] = 0x00; finished_clear[11] = 0x0c; //frag_length
 
-			PRF(finished_clear+12, master_secret, 48, "client finished", handshake_hash, 32, 12);
+			PRF_keyed(finished_clear+12, &session->master_key, "client finished", session->handshake_hash, 32, 12);
 			uint8_t i;
 			for (i = 0; i < 4; i++){
-				nonce[i] = client_write_IV[i];
+				nonce[i] = session->client_write_IV[i];
 			}
-			nonce[4] = (char)((current_epoch >> 8) & 0xFF);
+			nonce[4] = (char)((session->current_epoch >> 8) & 0xFF);
 			additional_data[0] = nonce[4];
-			nonce[5] = (char)((current_epoch) & 0xFF);
+			nonce[5] = (char)((session->current_epoch) & 0xFF);
 			additional_data[1] = nonce[5];
 			for (i = 0; i < 6; i++){
-				nonce[11-i] = (char)((next_send_seq >> (8*i))&0xFF);
-				additional_data[7-i] = (char)((next_send_seq >> (8*i))&0xFF);
+				nonce[11-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
+				additional_data[7-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
 			}
 			additional_data[8] = 0x16;
 			additional_data[9] = 0xfe;
@@ -649,40 +1077,52 @@ static void response_to_server_messages(int result){
 			additional_data[11] = 0x00;
 			additional_data[12] = 0x18;
 
-			if(!encrypt(buffer+psk_identity_length+27+14+21, client_write_key, nonce, finished_clear, 24, additional_data)){
-				mmem_free(&mmem);
+			if(!encrypt(buffer+psk_identity_length+27+14+21, &session->client_write_schedule, nonce, finished_clear, 24, additional_data)){
+				flight_free(session);
 				error(2,80);
 				return;
 			}
 			//update hash with the made finished message (non encryped or encrypted?)
-			//sha256_update(&ctxCopy, (unsigned char*)buffer+psk_identity_length+27+14+13, 40);
-			sha256_update(&ctxCopy, (unsigned char*)finished_clear, 24);
-			sha256_final(&ctxCopy, (unsigned char*)handshake_hash); //now handshake_hash has everything including the just sent finished message
+			//sha256_update(&session->ctxCopy, (unsigned char*)buffer+psk_identity_length+27+14+13, 40);
+			sha256_update(&session->ctxCopy, (unsigned char*)finished_clear, 24);
+			sha256_final(&session->ctxCopy, (unsigned char*)session->handshake_hash); //now handshake_hash has everything including the just sent finished message
 
-			create_finished(buffer+psk_identity_length+27+14, next_send_seq, current_epoch);
-			send(buffer, psk_identity_length+94);
-			next_send_seq++;
-			mmem_free(&mmem);
-			expected_message = CHANGE_CIPHER_SPEC;
+			create_finished(buffer+psk_identity_length+27+14, session->next_send_seq, session->current_epoch);
+			flight_send();
+			session->next_send_seq++;
+			session->expected_message = CHANGE_CIPHER_SPEC;
 
 			break;
 		case CHANGE_CIPHER_SPEC:
-			expected_message = FINISHED;
+			session->expected_message = FINISHED;
 			break;
 		case FINISHED:
-
-			secParam->client_write_IV = client_write_IV;
-			secParam->server_write_IV = server_write_IV;
-			secParam->client_write_key = client_write_key;
-			secParam->server_write_key = server_write_key;
-
-			connection->securityParameters = secParam;
-			connection->conn = udp_conn;
-			dtls_event = process_alloc_event();
-			dtls_flags = DTLS_CONNECTED;
-			process_post(PROCESS_BROADCAST, dtls_event, (void*)connection);
-			expected_message = APPLICATION_DATA;
-			handshake_done = 1;
+			if (session->resumed){
+				//our Finished covers the server's as well
+				sha256_final(&session->ctx, (unsigned char*)session->handshake_hash);
+				send_resumed_client_flight();
+				if (session->send_error){
+					return;
+				}
+			} else {
+				cache_store(session);
+				//the server's Finished ends the full handshake, nothing of ours is left to repeat
+				flight_free(session);
+			}
+			session->sec_param.client_write_IV = session->client_write_IV;
+			session->sec_param.server_write_IV = session->server_write_IV;
+			session->sec_param.client_write_key = session->client_write_key;
+			session->sec_param.server_write_key = session->server_write_key;
+
+			session->connection->securityParameters = &session->sec_param;
+			session->connection->flags = DTLS_CONNECTED;
+			just_connected = 1;
+			process_post(PROCESS_BROADCAST, dtls_event, (void*)session->connection);
+			session->expected_message = APPLICATION_DATA;
+			//after an abbreviated handshake the server's first record tells us our Finished arrived
+			session->handshake_done = !session->resumed;
+			handshake_wipe(session);
+			SEC_STATS_HANDSHAKE_DONE(&session->stats);
 
 			break;
 		}
@@ -693,101 +1133,120 @@ static void response_to_client_messages(int result){
 	if (result!=1){
 		error(2, result);
 	} else {
-		int fd;
 		uint8_t i;
-		char* localpsk = psk;
-		switch(expected_message){
+		char localpsk[PSK_STORE_MAX_KEY];
+		char premaster_secret[2*PSK_STORE_MAX_KEY+4]; //RFC 4279 section 2
+		int psk_length;
+		switch(session->expected_message){
 		case FIRST_CLIENT_HELLO:
 			//send the helloverify request
-			if (mmem_alloc(&mmem, 44)==0){
+			buffer = flight_alloc(44);
+			if (buffer == NULL){
 				error(2,80);
 				return;
 			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_helloverify_request(buffer, (unsigned char*)psk_identity, next_send_seq, current_epoch, sent_message_seq_number);
-			send(buffer, 44);
-			next_send_seq++;
-			mmem_free(&mmem);
-			mmem_free(&psk_mmem);
-			expected_message = SECOND_CLIENT_HELLO;
+			create_helloverify_request(buffer, hello_cookie, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+			flight_send();
+			session->next_send_seq++;
+			session->expected_message = SECOND_CLIENT_HELLO;
 			break;
 		case SECOND_CLIENT_HELLO:
-			if(mmem_alloc(&mmem, 88)==0){
+			if (session->resumed){
+				send_resumed_server_flight();
+				session->expected_message = CHANGE_CIPHER_SPEC;
+				break;
+			}
+			//a fresh id under which the session can be resumed later
+			crypto_random(session->session_id, DTLS_SESSION_ID_LENGTH);
+			session->session_id_len = DTLS_SESSION_ID_LENGTH;
+			buffer = flight_alloc(88+session->session_id_len);
+			if (buffer == NULL){
 				error(2, 80);
 				return;
 			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_first_server_hello(buffer, next_send_seq, current_epoch, sent_message_seq_number);
-			next_send_seq++; //need to increment since the above line creates 2 records
+			create_first_server_hello(buffer, session->session_id, session->session_id_len, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+			session->next_send_seq++; //need to increment since the above line creates 2 records
 			//save server_random
 			for (i = 0; i < 32; i++){
-				server_random[i] = buffer[27+i];
+				session->server_random[i] = buffer[27+i];
 			}
 			//update the hash
-			sha256_update(&ctx, (unsigned char*)buffer+13, 50);
-			sha256_update(&ctx, (unsigned char*)buffer+76, 12);
-			expected_message = CLIENT_KEY_EXCHANGE;
+			sha256_update(&session->ctx, (unsigned char*)buffer+13, 50+session->session_id_len);
+			sha256_update(&session->ctx, (unsigned char*)buffer+76+session->session_id_len, 12);
+			session->expected_message = CLIENT_KEY_EXCHANGE;
 			buffer[13] = 0x02; //wtf? without this buffer[13] magically changes to 0x01 :/
-			send(buffer, 88);
-			next_send_seq++;
-			mmem_free(&mmem);
-			mmem_free(&psk_mmem);
+			flight_send();
+			session->next_send_seq++;
 			break;
 		case CLIENT_KEY_EXCHANGE:
 			//lookup PSK based on the psk_identity
-			if  (strncmp(psk_identity,"this",4)!=0){
+			psk_length = lookup_psk(psk_identity, psk_identity_length, localpsk);
+			if (psk_length == 0){
 				error(2, 115);
 				return;
 			}
-			mmem_free(&psk_mmem);
-			if(mmem_alloc(&mmem, 2*strlen(psk)+4)==0){
-				error(2, 80);
-				return;
-			}
-			premaster_secret = (char*)MMEM_PTR(&mmem);
-
-			generate_premaster_secret(premaster_secret, psk);
-			generate_master_secret();
-			mmem_free(&mmem);
+			generate_premaster_secret(premaster_secret, localpsk, psk_length);
+			generate_master_secret(premaster_secret, 2*psk_length+4);
+			crypto_wipe(localpsk, sizeof(localpsk));
+			crypto_wipe(premaster_secret, sizeof(premaster_secret));
 
-			expected_message = CHANGE_CIPHER_SPEC;
+			session->expected_message = CHANGE_CIPHER_SPEC;
 
 			break;
 		case CHANGE_CIPHER_SPEC:
-			generate_keying_material();
-			expected_message = FINISHED;
+			if (!session->resumed){
+				generate_keying_material();
+			}
+			session->expected_message = FINISHED;
 			break;
 		case FINISHED:
+			if (session->resumed){
+				//our ChangeCipherSpec and Finished went out with the ServerHello
+				etimer_stop(&session->retransmit_timer);
+				flight_free(session);
+				handshake_wipe(session);
+				SEC_STATS_HANDSHAKE_DONE(&session->stats);
+				session->expected_message = APPLICATION_DATA;
+				session->sec_param.client_write_IV = session->client_write_IV;
+				session->sec_param.server_write_IV = session->server_write_IV;
+				session->sec_param.client_write_key = session->client_write_key;
+				session->sec_param.server_write_key = session->server_write_key;
+				session->connection->securityParameters = &session->sec_param;
+				session->connection->flags = DTLS_CONNECTED;
+				just_connected = 1;
+				process_post(PROCESS_BROADCAST, dtls_event, (void*)session->connection);
+				break;
+			}
 			//send ChangeCipherSpec and Finished
-			if(mmem_alloc(&mmem, 14+53)==0){
+			buffer = flight_alloc(14+53);
+			if (buffer == NULL){
 				error(2, 80);
 				return;
 			}
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_change_cipher_spec(buffer, next_send_seq, current_epoch);
-			next_send_seq++;
-			next_send_seq_copy = next_send_seq;
-			current_epoch++; //incrementing the epoch!
-			next_send_seq=0;
-			sha256_final(&ctx, (unsigned char*)handshake_hash);
+			create_change_cipher_spec(buffer, session->next_send_seq, session->current_epoch);
+			session->next_send_seq++;
+			session->next_send_seq_copy = session->next_send_seq;
+			session->current_epoch++; //incrementing the epoch!
+			session->next_send_seq=0;
+			sha256_final(&session->ctx, (unsigned char*)session->handshake_hash);
 			//create finished_clear
 			finished_clear[0] = 0x14; //msg_type = finished
 			finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
-			finished_clear[4] = (char)(((sent_message_seq_number+1)>>8)&0xFF); finished_clear[5] = (char)(((sent_message_seq_number+1)) & 0xFF);
+			finished_clear[4] = (char)(((session->sent_message_seq_number+1)>>8)&0xFF); finished_clear[5] = (char)(((session->sent_message_seq_number+1)) & 0xFF);
 			finished_clear[6] = 0x00; finished_clear[7] = 0x00; finished_clear[8] = 0x00; //frag_offset
 			finished_clear[9] = 0x00; finished_clear[10] = 0x00; finished_clear[11] = 0x0c; //frag_length
 
-			PRF(finished_clear+12, master_secret, 48, "server finished", handshake_hash, 32, 12);
+			PRF_keyed(finished_clear+12, &session->master_key, "server finished", session->handshake_hash, 32, 12);
 			for (i = 0; i < 4; i++){
-				nonce[i] = server_write_IV[i];
+				nonce[i] = session->server_write_IV[i];
 			}
-			nonce[4] = (char)((current_epoch >> 8) & 0xFF);
+			nonce[4] = (char)((session->current_epoch >> 8) & 0xFF);
 			additional_data[0] = nonce[4];
-			nonce[5] = (char)((current_epoch) & 0xFF);
+			nonce[5] = (char)((session->current_epoch) & 0xFF);
 			additional_data[1] = nonce[5];
 			for (i = 0; i < 6; i++){
-				nonce[11-i] = (char)((next_send_seq >> (8*i))&0xFF);
-				additional_data[7-i] = (char)((next_send_seq >> (8*i))&0xFF);
+				nonce[11-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
+				additional_data[7-i] = (char)((session->next_send_seq >> (8*i))&0xFF);
 			}
 			additional_data[8] = 0x16;
 			additional_data[9] = 0xfe;
@@ -795,27 +1254,28 @@ static void response_to_client_messages(int result){
 			additional_data[11] = 0x00;
 			additional_data[12] = 0x18;
 
-			if(!encrypt(buffer+14+21, server_write_key, nonce, finished_clear, 24, additional_data)){
-				mmem_free(&mmem);
+			if(!encrypt(buffer+14+21, &session->server_write_schedule, nonce, finished_clear, 24, additional_data)){
+				flight_free(session);
 				error(2,80);
 				return;
 			}
-			create_finished(buffer+14, next_send_seq, current_epoch);
-			send(buffer, 67);
-			next_send_seq++;
-			mmem_free(&mmem);
-			expected_message = APPLICATION_DATA;
+			create_finished(buffer+14, session->next_send_seq, session->current_epoch);
+			session->next_send_seq++;
+			flight_send_last();
+			session->expected_message = APPLICATION_DATA;
 
-			secParam->client_write_IV = client_write_IV;
-			secParam->server_write_IV = server_write_IV;
-			secParam->client_write_key = client_write_key;
-			secParam->server_write_key = server_write_key;
+			session->sec_param.client_write_IV = session->client_write_IV;
+			session->sec_param.server_write_IV = session->server_write_IV;
+			session->sec_param.client_write_key = session->client_write_key;
+			session->sec_param.server_write_key = session->server_write_key;
 
-			connection->securityParameters = secParam;
-			connection->conn = udp_conn;
-			dtls_event = process_alloc_event();
-			dtls_flags = DTLS_CONNECTED;
-			process_post(PROCESS_BROADCAST, dtls_event, (void*)connection);
+			session->connection->securityParameters = &session->sec_param;
+			session->connection->flags = DTLS_CONNECTED;
+			just_connected = 1;
+			process_post(PROCESS_BROADCAST, dtls_event, (void*)session->connection);
+			cache_store(session);
+			handshake_wipe(session);
+			SEC_STATS_HANDSHAKE_DONE(&session->stats);
 
 			break;
 		}
@@ -827,7 +1287,7 @@ static void response_to_client_messages(int result){
  */
 static int process_server_messages(char* message, int msg_length){
 	uint16_t position = 0;
-	switch(expected_message){
+	switch(session->expected_message){
 	case HELLO_VERIFY_REQUEST:
 		if ((unsigned char)message[position++] != 0xFE){
 			return 47;
@@ -852,7 +1312,10 @@ static int process_server_messages(char* message, int msg_length){
 		position++;
 
 		position += 32; //skip random for now
-		position += (message[position] + 1); //skip session id since we don't support it anyway (buffer[position] should always be 0)
+		if ((unsigned char)message[position] > 32){
+			return 47;
+		}
+		position += ((unsigned char)message[position] + 1); //session id is looked at once the message is accepted
 
 		if (message[position++] != (char)((TLS_PSK_WITH_AES_128_CCM_8 >> 8) & 0xFF)){ //server has to return TLS_PSK_WITH_AES_128_CCM_8
 			return 40;
@@ -881,8 +1344,7 @@ static int process_server_messages(char* message, int msg_length){
  */
 static int process_client_messages(char* message, int msg_length){
 	uint16_t position = 0;
-	int i;
-	switch(expected_message){
+	switch(session->expected_message){
 	case FIRST_CLIENT_HELLO:
 	case SECOND_CLIENT_HELLO:
 		if ((unsigned char)message[position++] != 0xFE){
@@ -892,40 +1354,40 @@ static int process_client_messages(char* message, int msg_length){
 			return 47;
 		position += 32; //skip random for now
 
-		position += (message[position] + 1); //skip session id since we don't support it anyway
-		if (position > msg_length){
+		if (msg_length <= position || position + 1 + (unsigned char)message[position] > msg_length){
 			return 50;
 		}
-		if (expected_message == FIRST_CLIENT_HELLO){
-			random_init(clock_time());
-			for (i = 0; i < 8; i++) {
-				cookie_secret[i] = (char) (random_rand() % 128 & 0xFF);
+		if ((unsigned char)message[position] > 32){
+			return 47;
+		}
+		session->resumed = 0;
+		if (session->expected_message == SECOND_CLIENT_HELLO){
+			struct cached_session* c = cache_find(message+position+1, (unsigned char)message[position]);
+			if (c != NULL){
+				//the client offers a session we still know, go for the abbreviated handshake
+				session->resumed = 1;
+				session->session_id_len = c->id_len;
+				memcpy(session->session_id, c->id, c->id_len);
+				memcpy(session->master_secret, c->master_secret, 48);
 			}
 		}
-		hmac_sha256_ctx cookie_ctx;
-		hmac_sha256_init(&cookie_ctx, cookie_secret, 8);
-		hmac_sha256_update(&cookie_ctx, (unsigned char*)message, 34+message[34]+1); //update hash with version, random, session id
+		position += ((unsigned char)message[position] + 1);
+		if (position > msg_length){
+			return 50;
+		}
 		if ((unsigned char)message[position]!=0x00 && (unsigned char)message[position]!=0x10){
 			return 47;
 		}
 		position++;
-		if (expected_message == FIRST_CLIENT_HELLO){
-			hmac_sha256_update(&cookie_ctx, (unsigned char*)message+position, msg_length - position);
-		} else if (expected_message == SECOND_CLIENT_HELLO){
-			hmac_sha256_update(&cookie_ctx, (unsigned char*)message+position+16, msg_length - position-16);
-		}
-		hmac_sha256_update(&cookie_ctx, (unsigned char*)&UDP_IP_BUF->srcipaddr,16);
-		if (mmem_alloc(&psk_mmem, 16)==0){
-			return 80;
-		}
-		//to save space psk_identity is now holding the cookie that is sent in the helloverify request
-		psk_identity = (char*)MMEM_PTR(&psk_mmem);
-		hmac_sha256_final(&cookie_ctx,(unsigned char*)psk_identity, 16);
-
-		if (expected_message == SECOND_CLIENT_HELLO){
-			if (strncmp(psk_identity, message+position, 16)!=0){
-				expected_message = FIRST_CLIENT_HELLO;
+		if (session->expected_message == FIRST_CLIENT_HELLO){
+			if (!create_cookie(hello_cookie, cookie_secret, &session->addr, session->port, message, msg_length)){
+				return 50;
 			}
+		} else if (!session->resumed && !cookie_valid(&session->addr, session->port, message, msg_length)){
+			if (!create_cookie(hello_cookie, cookie_secret, &session->addr, session->port, message, msg_length)){
+				return 50;
+			}
+			session->expected_message = FIRST_CLIENT_HELLO;
 		}
 		position += message[position-1];
 		uint16_t cs_length = (message[position] << 8) + (message[position + 1]);
@@ -977,13 +1439,17 @@ static int process_client_messages(char* message, int msg_length){
 
 static int act_on_full_message(char* message, int msg_length){
 	uint8_t i;
-	if (expected_message == APPLICATION_DATA){
+	if (session->expected_message == APPLICATION_DATA){
 #if CONTIKI_TARGET_MINIMAL_NET
 		PRINTF("APPLICATION DATA DETECTED\n");
 #endif
+		if (msg_length < 16){
+			rcvd_bad_mac = 1; //too short to carry explicit nonce and tag
+			return 0;
+		}
 		for (i = 0; i < 4; i++){
-			if (server)nonce[i] = client_write_IV[i];
-			else nonce[i] = server_write_IV[i];
+			if (server)nonce[i] = session->client_write_IV[i];
+			else nonce[i] = session->server_write_IV[i];
 		}
 		nonce[4] = (char)((rcvd_epoch >> 8) & 0xFF);
 		additional_data[0] = nonce[4];
@@ -998,64 +1464,70 @@ static int act_on_full_message(char* message, int msg_length){
 		additional_data[10] = 0xfd;
 		additional_data[11] = (char)(((msg_length-16)>>8)&0xFF);
 		additional_data[12] = (char)((msg_length-16)&0xFF);
-		if (!first_data)mmem_free(&data_mmem);
-		first_data = 0;
-		if (mmem_alloc(&data_mmem, msg_length-16)==0){
+		data_free(session);
+		//one byte more so the app can terminate the data
+		if (mmem_alloc(&session->data, msg_length-15)==0){
 			error(2,80);
 			return 0;
 		}
-		dtls_appdata = (char*)MMEM_PTR(&data_mmem);
+		session->data_kept = 1;
 #if CONTIKI_TARGET_MINIMAL_NET
 		PRINTF("DECRYPTING...");
 #endif
 		if (server){
-			if(!decrypt(dtls_appdata, client_write_key, nonce, message+8, msg_length-8, additional_data)){
-				mmem_free(&data_mmem);
-				error(2,20);
+			if(!decrypt((char*)MMEM_PTR(&session->data), &session->client_write_schedule, nonce, message+8, msg_length-8, additional_data)){
+				data_free(session);
+				rcvd_bad_mac = 1;
 				return 0;
 			}
 		} else {
-			if(!decrypt(dtls_appdata, server_write_key, nonce, message+8, msg_length-8, additional_data)){
-				mmem_free(&data_mmem);
-				error(2,20);
+			if(!decrypt((char*)MMEM_PTR(&session->data), &session->server_write_schedule, nonce, message+8, msg_length-8, additional_data)){
+				data_free(session);
+				rcvd_bad_mac = 1;
 				return 0;
 			}
 		}
 #if CONTIKI_TARGET_MINIMAL_NET
 		PRINTF("DECTYPTION SUCCEEDED!");
 #endif
-		dtls_applen = msg_length - 16;
-		dtls_flags = DTLS_NEWDATA;
-		dtls_event = process_alloc_event();
-		uint8_t res = process_post(calling_process, dtls_event, NULL);
+		session->data_length = msg_length - 16;
+		((char*)MMEM_PTR(&session->data))[session->data_length] = 0;
+		SEC_STATS_ADD(app_in, session->data_length);
+		if (just_connected){
+			//came with the peer's Finished, the DTLS_CONNECTED event already posted tells about it
+			session->connection->flags |= DTLS_NEWDATA;
+			return 1;
+		}
+		session->connection->flags = DTLS_NEWDATA;
 #if CONTIKI_TARGET_MINIMAL_NET
+		uint8_t res = process_post(calling_process, dtls_event, (void*)session->connection);
 		PRINTF("posting to %s resulted in %d\n", PROCESS_NAME_STRING(calling_process), res);
+#else
+		process_post(calling_process, dtls_event, (void*)session->connection);
 #endif
 		return 1;
 	}
 
 	if (server){
 		uint8_t result = process_client_messages(message, msg_length);
-		if(expected_message == SECOND_CLIENT_HELLO && result == 1){
+		if(session->expected_message == SECOND_CLIENT_HELLO && result == 1){
 			//save client_random
 			for (i = 0; i < 32; i++){
-				client_random[i] = message[2+i];
+				session->client_random[i] = message[2+i];
 			}
 		}
-		if(expected_message == CLIENT_KEY_EXCHANGE && result == 1){
-			psk_identity_length = (message[0]<<8)+message[1];
-			if (mmem_alloc(&psk_mmem, psk_identity_length)==0){
-				error(2,80);
+		if(session->expected_message == CLIENT_KEY_EXCHANGE && result == 1){
+			psk_identity_length = ((unsigned char)message[0]<<8)+(unsigned char)message[1];
+			if (msg_length < 2 || psk_identity_length > msg_length - 2){
+				error(2,50);
 				return 0;
 			}
-			psk_identity = (char*)MMEM_PTR(&psk_mmem);
-			for (i = 0; i < psk_identity_length; i++){
-				psk_identity[i] = message[2+i];
-			}
+			//the message stays put until response_to_client_messages() looked the identity up
+			psk_identity = message+2;
 		}
-		if (expected_message == FINISHED && result == 1){
+		if (session->expected_message == FINISHED && result == 1){
 			for (i = 0; i < 4; i++){
-				nonce[i] = client_write_IV[i];
+				nonce[i] = session->client_write_IV[i];
 			}
 			nonce[4] = (char)((rcvd_epoch >> 8) & 0xFF);
 			additional_data[0] = nonce[4];
@@ -1077,18 +1549,13 @@ static int act_on_full_message(char* message, int msg_length){
 			PRINTF("\nadditional data: ");
 			for (i = 0; i < 13; i++) PRINTF("%02X", (unsigned char)additional_data[i]);
 			PRINTF("\nkey: ");
-			for (i = 0; i < 16; i++) PRINTF("%02X", (unsigned char) client_write_key[i]);
+			for (i = 0; i < 16; i++) PRINTF("%02X", (unsigned char) session->client_write_key[i]);
 			PRINTF("\n");
 #endif
-			if (mmem_alloc(&mmem, 24)==0){
-				error(2,80);
-				return 0;
-			}
-			char* finished_clear = (char*)MMEM_PTR(&mmem);
+			char finished_clear[24];
 
-			if(!decrypt(finished_clear, client_write_key, nonce, message+8, 32, additional_data)){
-				mmem_free(&mmem);
-				error(2,20);
+			if(msg_length < 40 || !decrypt(finished_clear, &session->client_write_schedule, nonce, message+8, 32, additional_data)){
+				rcvd_bad_mac = 1;
 				return 0;
 			}
 #if CONTIKI_TARGET_MINIMAL_NET
@@ -1098,47 +1565,48 @@ static int act_on_full_message(char* message, int msg_length){
 			}
 			PRINTF("\n");
 #endif
-			sha256_ctx ctxCopy = ctx;
-			sha256_final(&ctxCopy, (unsigned char*)handshake_hash);
+			sha256_ctx ctxCopy = session->ctx;
+			sha256_final(&ctxCopy, (unsigned char*)session->handshake_hash);
 
 			if (check_finished_correctness(finished_clear)!=1){
 				error(2,40);
-				mmem_free(&mmem);
 				return 0;
 			}
 
-			sha256_update(&ctx, (unsigned char*)finished_clear, 24);
-			mmem_free(&mmem);
+			sha256_update(&session->ctx, (unsigned char*)finished_clear, 24);
 		}
 		response_to_client_messages(result);
 		if (result!=1) return 0;
 	} else {
 		uint8_t result = process_server_messages(message, msg_length);
 
-		if(expected_message == SERVER_HELLO && result == 1){
+		if(session->expected_message == SERVER_HELLO && result == 1){
 			//save server_random
 			for (i = 0; i < 32; i++){
-				server_random[i] = message[2+i];
+				session->server_random[i] = message[2+i];
+			}
+			//the server echoes the id we offered if it resumes, otherwise it hands out a new one
+			uint8_t id_len = (uint8_t)message[34];
+			session->resumed = id_len != 0 && id_len == session->session_id_len &&
+					memcmp(session->session_id, message+35, id_len) == 0;
+			if (!session->resumed){
+				session->session_id_len = id_len <= DTLS_SESSION_ID_LENGTH ? id_len : 0;
+				memcpy(session->session_id, message+35, session->session_id_len);
 			}
-			mmem_free(&psk_mmem);
 		}
-		if(expected_message == HELLO_VERIFY_REQUEST && result ==1){
-			psk_identity_length = message[2];
-			if (psk_identity_length > 0){
-				if (mmem_alloc(&psk_mmem, psk_identity_length)==0){
-					return 80;
-				}
-				//to save space psk_identity is now holding the cookie that is sent in the helloverify request
-				psk_identity = (char*)MMEM_PTR(&psk_mmem);
-				for (i = 0; i < psk_identity_length; i++){
-					psk_identity[i] = message[3+i];
-				}
+		if(session->expected_message == HELLO_VERIFY_REQUEST && result ==1){
+			//keep the cookie with the session, it is echoed in every retransmitted ClientHello
+			session->cookie_len = (uint8_t)message[2];
+			if (session->cookie_len > sizeof(session->cookie)){
+				session->cookie_len = 0;
+				return 0;
 			}
+			memcpy(session->cookie, message+3, session->cookie_len);
 		}
-		if (expected_message == FINISHED && result == 1){
+		if (session->expected_message == FINISHED && result == 1){
 
 			for (i = 0; i < 4; i++){
-				nonce[i] = server_write_IV[i];
+				nonce[i] = session->server_write_IV[i];
 			}
 			nonce[4] = (char)((rcvd_epoch >> 8) & 0xFF);
 			additional_data[0] = nonce[4];
@@ -1154,23 +1622,24 @@ static int act_on_full_message(char* message, int msg_length){
 			additional_data[11] = 0x00;
 			additional_data[12] = 0x18;
 
-			if (mmem_alloc(&mmem, 24)==0){
-				error(2,80);
-				return 0;
-			}
-			char* finished_clear = (char*)MMEM_PTR(&mmem);
+			char finished_clear[24];
 
-			if(!decrypt(finished_clear, server_write_key, nonce, message+8, 32, additional_data)){
-				mmem_free(&mmem);
-				error(2,20);
+			if(msg_length < 40 || !decrypt(finished_clear, &session->server_write_schedule, nonce, message+8, 32, additional_data)){
+				rcvd_bad_mac = 1;
 				return 0;
 			}
+			if (session->resumed){
+				//in an abbreviated handshake the server's Finished comes first and covers the hellos only
+				session->ctxCopy = session->ctx;
+				sha256_final(&session->ctxCopy, (unsigned char*)session->handshake_hash);
+			}
 			if (check_finished_correctness(finished_clear)!=1){
 				error(2,40);
-				mmem_free(&mmem);
 				return 0;
 			}
-			mmem_free(&mmem);
+			if (session->resumed){
+				sha256_update(&session->ctx, (unsigned char*)finished_clear, 24);
+			}
 		}
 		response_to_server_messages(result);
 		if (result!=1)return 0;
@@ -1178,135 +1647,232 @@ static int act_on_full_message(char* message, int msg_length){
 	return 1;
 }
 
+/*
+ * a complete handshake message (header with frag_offset 0 and frag_length = length, then the body)
+ * that is next in line. returns 1 if it was accepted
+ */
+static uint8_t deliver_message(char* message, uint32 length){
+	if ((session->expected_message == FIRST_CLIENT_HELLO && (message[0]!=((char)client_hello & 0xFF))) ||
+			(session->expected_message == CLIENT_KEY_EXCHANGE && (message[0]!=((char)client_key_exchange & 0xFF))) ||
+			(session->expected_message == HELLO_VERIFY_REQUEST && (message[0]!=((char)hello_verify_request & 0xFF)) && message[0]!=((char)server_hello & 0xFF)) ||
+			(session->expected_message == SECOND_CLIENT_HELLO && (message[0]!=((char)client_hello & 0xFF ))) ||
+			(session->expected_message == SERVER_HELLO && (message[0]!=((char)server_hello & 0xFF))) ||
+			(session->expected_message == SERVER_HELLO_DONE && (message[0]!=((char)server_hello_done & 0xFF)))){
+		if (session->alert_sent!=0){
+			error(2,session->alert_sent);
+		}
+		return 0;
+	}
+	etimer_stop(&session->retransmit_timer);
+	if (session->alert_sent!=0){
+		session->alert_sent = 0;
+	}
+	if (session->expected_message != FIRST_CLIENT_HELLO && session->sent_something == 1) {
+		session->sent_message_seq_number++;
+		session->sent_something = 0;
+	}
+
+	//in case cookie exchange isn't used we tell the client to expect server_hello
+	if (message[0]== ((char)server_hello & 0xFF)) session->expected_message = SERVER_HELLO;
+
+	//need to add it to the handshake hash if it isn't first client hello or hello verify request
+	if (session->expected_message != FIRST_CLIENT_HELLO && session->expected_message != HELLO_VERIFY_REQUEST && session->expected_message != CHANGE_CIPHER_SPEC){
+		sha256_update(&session->ctx, (unsigned char*)message, length+12);
+	}
+	if (act_on_full_message(message+12, length)!=1) {
+		return 0;
+	}
+	session->rcvd_message_seq_number++;
+	return 1;
+}
+
+/*
+ * the slot collecting message msg_seq, a new one is set up if there is room
+ */
+static dtls_reassembly* reassembly_slot(char* header, uint16_t msg_seq, uint32 length){
+	dtls_reassembly* r = NULL;
+	uint8_t i;
+	for (i = 0; i < DTLS_REASSEMBLY_SLOTS; i++){
+		if (session->reassembly[i].used && session->reassembly[i].msg_seq == msg_seq){
+			if (session->reassembly[i].length != length){
+				return NULL; //fragments disagree on the message length
+			}
+			return &session->reassembly[i];
+		}
+		if (!session->reassembly[i].used && r == NULL){
+			r = &session->reassembly[i];
+		}
+	}
+	if (r == NULL || mmem_alloc(&r->buf, 12+length+(length+7)/8)==0){
+		return NULL;
+	}
+	buffer = (char*)MMEM_PTR(&r->buf);
+	//change the header to have 0 frag_offset and frag_length = length
+	memcpy(buffer, header, 6);
+	buffer[6] = buffer[7] = buffer[8] = 0;
+	buffer[9] = header[1];
+	buffer[10] = header[2];
+	buffer[11] = header[3];
+	memset(buffer+12+length, 0, (length+7)/8);
+	r->length = length;
+	r->missing = length;
+	r->msg_seq = msg_seq;
+	r->used = 1;
+	return r;
+}
+
+/*
+ * hand over every buffered message that is complete and next in line,
+ * and forget the ones that were delivered in one piece meanwhile
+ */
+static void reassembly_flush(){
+	dtls_reassembly* r;
+	uint8_t i, delivered = 1;
+	while (delivered){
+		delivered = 0;
+		for (i = 0; i < DTLS_REASSEMBLY_SLOTS; i++){
+			r = &session->reassembly[i];
+			if (r->used && r->msg_seq < session->rcvd_message_seq_number){
+				mmem_free(&r->buf);
+				r->used = 0;
+			} else if (r->used && r->missing == 0 && r->msg_seq == session->rcvd_message_seq_number){
+				r->used = 0;
+				delivered = deliver_message((char*)MMEM_PTR(&r->buf), r->length)==1 && !session->send_error;
+				mmem_free(&r->buf);
+				break;
+			}
+		}
+	}
+}
+
 static void process_message(char* message, int msg_length){
 #if CONTIKI_TARGET_MINIMAL_NET
 	PRINTF("PROCESSING MESSAGE...\n");
 #endif
-	uint8_t i;
-	if (send_error){
+	if (session->send_error){
 		return;
 	}
-	if (alert_received){
-		alert_received = 0;
-		etimer_stop(&retransmit_timer);
+	if (session->alert_received){
+		session->alert_received = 0;
+		etimer_stop(&session->retransmit_timer);
 		if (message[1] == 0){
 			error(1,0);
 			return;
 		} else {
-			if (server) num_connected--;
-			send_error = 1;
+			session->send_error = 1;
 			return;
 		}
 	}
-	if (!server && handshake_done && message[0]==((char)hello_request & 0xFF) && msg_length == 12){
+	if (!server && session->handshake_done && message[0]==((char)hello_request & 0xFF) && msg_length == 12){
 		rehandshake();
 		return;
 	}
-	if (expected_message == APPLICATION_DATA || expected_message == FINISHED || expected_message == CHANGE_CIPHER_SPEC){
-		if (act_on_full_message(message, msg_length)==1)etimer_stop(&retransmit_timer);
+	if (session->expected_message == APPLICATION_DATA || session->expected_message == FINISHED || session->expected_message == CHANGE_CIPHER_SPEC){
+		if (act_on_full_message(message, msg_length)==1)etimer_stop(&session->retransmit_timer);
 		return;
 	}
-		//receive a fragment, check if it's what we expect
+	if (msg_length < 12){
+		return;
+	}
+	uint32 length = ((uint32)(unsigned char)message[1]<<16) + ((uint32)(unsigned char)message[2]<<8) + (unsigned char)message[3];
+	uint16_t msg_seq = ((unsigned char)message[4]<<8) + ((unsigned char)message[5]);
+	uint32 frag_offset = ((uint32)(unsigned char)message[6]<<16) + ((uint32)(unsigned char)message[7]<<8) + (unsigned char)message[8];
+	uint32 frag_length = ((uint32)(unsigned char)message[9]<<16) + ((uint32)(unsigned char)message[10]<<8) + (unsigned char)message[11];
+	if (length > DTLS_MAX_HANDSHAKE_LENGTH || frag_length > (uint32)msg_length - 12 || frag_offset > length || frag_length > length - frag_offset){
+		SEC_STATS_DROP(SEC_STATS_DROP_MALFORMED);
+		return; //malformed, the rest of the record can't be trusted either
+	}
 
-	if ((expected_message == FIRST_CLIENT_HELLO && (message[0]!=((char)client_hello & 0xFF))) ||
-			(expected_message == CLIENT_KEY_EXCHANGE && (message[0]!=((char)client_key_exchange & 0xFF))) ||
-			(expected_message == HELLO_VERIFY_REQUEST && (message[0]!=((char)hello_verify_request & 0xFF)) && message[0]!=((char)server_hello & 0xFF)) ||
-			(expected_message == SECOND_CLIENT_HELLO && (message[0]!=((char)client_hello & 0xFF ))) ||
-			(expected_message == SERVER_HELLO && (message[0]!=((char)server_hello & 0xFF))) ||
-			(expected_message == SERVER_HELLO_DONE && (message[0]!=((char)server_hello_done & 0xFF)))){
-		if (alert_sent!=0){
-			error(2,alert_sent);
+	if (msg_seq < session->rcvd_message_seq_number){
+		//the peer repeats its previous flight, so ours got lost: answer its last message with our flight
+		if (msg_seq + 1 == session->rcvd_message_seq_number && frag_offset + frag_length == length){
+			retransmit();
+		}
+	} else if (frag_offset == 0 && frag_length == length && msg_seq == session->rcvd_message_seq_number){
+		//the whole message in one fragment, the usual case: no copy needed
+		if (deliver_message(message, length)!=1) {
+			return;
+		}
+		reassembly_flush();
+	} else if (msg_seq >= session->rcvd_message_seq_number && msg_seq - session->rcvd_message_seq_number < DTLS_REASSEMBLY_SLOTS){
+		//a fragment, or a message ahead of its turn: keep it until the gaps are filled
+		dtls_reassembly* r = reassembly_slot(message, msg_seq, length);
+		if (r != NULL){
+			char* body = (char*)MMEM_PTR(&r->buf) + 12;
+			uint8_t* received = (uint8_t*)body + length;
+			uint32 i;
+			memcpy(body+frag_offset, message+12, frag_length);
+			for (i = frag_offset; i < frag_offset+frag_length; i++){
+				if (!(received[i>>3] & (1 << (i & 7)))){
+					received[i>>3] |= 1 << (i & 7);
+					r->missing--;
+				}
+			}
+			reassembly_flush();
 		}
-		return;
 	}
-	etimer_stop(&retransmit_timer);
-	if (alert_sent!=0){
-		alert_sent = 0;
+	if (session->send_error){
+		return;
 	}
-	if (expected_message != FIRST_CLIENT_HELLO && sent_something == 1) {
-		sent_message_seq_number++;
-		sent_something = 0;
+	//in case one record contained more than one message
+	if (msg_length - 12 > frag_length){
+		process_message(message+12+frag_length, msg_length-12-frag_length);
 	}
+}
 
-	//in case cookie exchange isn't used we tell the client to expect server_hello
-	if (message[0]== ((char)server_hello & 0xFF)) expected_message = SERVER_HELLO;
-
-	//get the MSN and check whether it's the right one. ignore if it isn't
-	uint16_t msg_seq = ((unsigned char)message[4]<<8) + ((unsigned char)message[5]);
+/*
+ * anti-replay window (RFC 6347 section 4.1.2.6), bit i of replay_bitmap stands
+ * for sequence number replay_top - i of epoch replay_epoch
+ * returns 1 if the record has not been seen yet. replay_epoch is the epoch the peer
+ * writes in, only a handshake in progress can take it to the next one
+ */
+static uint8_t replay_check(uint16_t epoch, uint64 seq){
+	uint64 diff;
+	if (epoch != session->replay_epoch){
+		return epoch == session->replay_epoch + 1 &&
+				(session->expected_message != APPLICATION_DATA || !session->handshake_done);
+	}
+	if (seq > session->replay_top){
+		return 1;
+	}
+	diff = session->replay_top - seq;
+	if (diff >= DTLS_REPLAY_WINDOW){
+		return 0;
+	}
+	return !(session->replay_bitmap[diff >> 3] & (1 << (diff & 7)));
+}
 
-	//if it's the first fragment get the length and allocate memory for the whole message
-	uint32 frag_length = 0;
-	unsigned char* ptr = (unsigned char*)&frag_length;
-	*ptr = message[11];
-	*(ptr+1) = message[10];
-	*(ptr+2) = message[9];
-
-	uint32 frag_offset = 0;
-	ptr = (unsigned char*)&frag_offset;
-	*ptr = message[8];
-	*(ptr+1) = message[7];
-	*(ptr+2) = message[6];
-
-	uint32 length =  0;
-	ptr = (unsigned char*)&length;
-	*ptr = message[3];
-	*(ptr+1) = message[2];
-	*(ptr+2) = message[1];
-
-	if (first_fragment){
-		if (frag_length < length){
-			if(mmem_alloc(&message_mmem, length)==0){
-				error(2, 80);
-				return;
-			}
-			buffer = (char*)MMEM_PTR(&message_mmem);
-			for (i = 0; i < frag_length; i++){
-				buffer[frag_offset+i] = message[12+i];
-			}
-			first_fragment = 0;
-			if (msg_length - 12 > frag_length){
-				process_message(message+12+frag_length, msg_length-12-frag_length);
-			}
+/*
+ * mark a record as received, only called once the record was accepted
+ */
+static void replay_update(uint16_t epoch, uint64 seq){
+	uint64 diff;
+	int16_t i;
+	uint8_t bytes, bits;
+	if (epoch != session->replay_epoch){
+		session->replay_epoch = epoch;
+		session->replay_top = seq;
+		memset(session->replay_bitmap, 0, sizeof(session->replay_bitmap));
+	} else if (seq > session->replay_top){
+		diff = seq - session->replay_top;
+		session->replay_top = seq;
+		if (diff >= DTLS_REPLAY_WINDOW){
+			memset(session->replay_bitmap, 0, sizeof(session->replay_bitmap));
 		} else {
-			//first (and the only) fragment. need to add it to the handshake hash if it isn't first client hello or hello verify request
-			if (expected_message != FIRST_CLIENT_HELLO && expected_message != HELLO_VERIFY_REQUEST && expected_message != CHANGE_CIPHER_SPEC){
-				sha256_update(&ctx, (unsigned char*)message, length+12);
-			}
-			if (act_on_full_message(message+12, length)!=1) {
-				return;
-			}
-			rcvd_message_seq_number++;
-			//in case one record contained more than one message
-			if (msg_length - 12 > length){
-				process_message(message+12+length, msg_length-12-length);
-			}
-		}
-	} else {
-		for (i = 0; i < frag_length; i++){
-			buffer[frag_offset+i] = message[12+i];
-		}
-		if (frag_length+frag_offset == length){
-			char header[12];
-			for (i = 0; i < 12; i++){
-				header[i] = message[i];
-			}
-			//change the header to have 0 frag_offset and frag_length = length
-			header[6] = header[7] = header[8] = 0;
-			header[9] = message[1];
-			header[10] = message[2];
-			header[11] = message[3];
-			sha256_update(&ctx, (unsigned char*)header, 12);
-			sha256_update(&ctx, (unsigned char*) buffer, length);
-			if (act_on_full_message(buffer, length)!=1) return;
-			rcvd_message_seq_number++;
-			mmem_free(&message_mmem);
-			if (msg_length > frag_length+12){
-				first_fragment = 1;
-				process_message(message+frag_length+12, msg_length-12-frag_length);
+			//slide the window towards the older numbers by diff bits
+			bytes = diff >> 3;
+			bits = diff & 7;
+			for (i = sizeof(session->replay_bitmap) - 1; i >= 0; i--){
+				uint8_t v = i >= bytes ? session->replay_bitmap[i - bytes] << bits : 0;
+				if (bits && i > bytes){
+					v |= session->replay_bitmap[i - bytes - 1] >> (8 - bits);
+				}
+				session->replay_bitmap[i] = v;
 			}
 		}
 	}
-
+	diff = session->replay_top - seq;
+	session->replay_bitmap[diff >> 3] |= 1 << (diff & 7);
 }
 
 static void process_input(char* input, int input_length){
@@ -1315,52 +1881,18 @@ static void process_input(char* input, int input_length){
 #if CONTIKI_TARGET_MINIMAL_NET
 	PRINTF("PROCESSING INPUT...\n");
 #endif
-	if (server && expected_message == APPLICATION_DATA && !handshake_done && input[0]==0x16){
-		retransmit();	//FIXME? - this is a hack to support retransmit of the last flight of messages in case it gets lost
+	//whoever sent the last flight repeats it when the peer's previous flight shows up again
+	if ((server ? !session->resumed : session->resumed) && session->expected_message == APPLICATION_DATA && !session->handshake_done && input[0]==0x16){
+		retransmit();
 		return;
 	}
-	if (input[0] == 0x15){
-		alert_received = 1;
-	} else {
-		if (expected_message!=CHANGE_CIPHER_SPEC && expected_message!=APPLICATION_DATA && input[0] != 0x16) {
-			//silently ignore invalid messages
-			return;
-		}
-		if (expected_message == CHANGE_CIPHER_SPEC && input[0] != 0x14) {
-			//silently ignore invalid messages
-			return;
-		}
-		if (expected_message == APPLICATION_DATA && input[0] != 0x17){
-			//silently ignore invalid messages (unless it's a client_hello or a hello_request)
-			if (server && input[0]==0x16){
-				expected_message = FIRST_CLIENT_HELLO;
-				sha256_init(&ctx);
-				sent_message_seq_number = 0;
-				rcvd_message_seq_number = 0;
-				mmem_free(&data_mmem);
-				if (!first_data_sent) mmem_free(&mmem);
-				first_data_sent = 1;
-				first_data = 1;
-				handshake_done = 0;
-				sent_something = 0;
-			} else if (!server && input[0]==0x16){
-
-			} else
-			return;
-		} else if (expected_message == APPLICATION_DATA && input[0]==0x17){
-			handshake_done = 1;
-		}
+	if (input_length < 13){
+		return;
 	}
 	unsigned char* ptr = (unsigned char*)&rcvd_epoch;
 	*ptr = input[4];
 	*(ptr+1) = input[3];
 
-	if (rcvd_epoch != current_epoch){
-		//ignore
-		//return; <<ok this was wrong  //FIXME
-	}
-	//get the seq_number, check with next_received_seq, if smaller or greater then discard, else process
-
 	ptr = (unsigned char*)&rcvd_seq;
 	*ptr = input[10];
 	*(ptr+1) = input[9];
@@ -1368,12 +1900,78 @@ static void process_input(char* input, int input_length){
 	*(ptr+3) = input[7];
 	*(ptr+4) = input[6];
 	*(ptr+5) = input[5];
-	//TODO process record seq number using a sliding window
 
 	//get the length, process the message inside
 	uint16_t msg_length = ((unsigned char)input[11]<<8)+((unsigned char)input[12]);
 
+	//a fresh ClientHello in epoch 0 starts the association over, anything else has to pass the replay window
+	uint8_t restart = server && rcvd_epoch == 0 && input[0] == 0x16 &&
+			input_length > 13 && input[13] == ((char)client_hello & 0xFF);
+	if (!restart && !replay_check(rcvd_epoch, rcvd_seq)){
+		//duplicate or too old, drop it before it costs any crypto
+		SEC_STATS_DROP(SEC_STATS_DROP_REPLAY);
+		if (msg_length < input_length - 13){
+			process_input(input+13+msg_length, input_length-13-msg_length);
+		}
+		return;
+	}
+	if (restart){
+		session->replay_epoch = 0;
+		session->replay_top = 0;
+		memset(session->replay_bitmap, 0, sizeof(session->replay_bitmap));
+	}
+	if (input[0] == 0x15){
+		session->alert_received = 1;
+	} else {
+		if (session->expected_message!=CHANGE_CIPHER_SPEC && session->expected_message!=APPLICATION_DATA && input[0] != 0x16) {
+			//silently ignore invalid messages
+			SEC_STATS_DROP(SEC_STATS_DROP_UNEXPECTED);
+			return;
+		}
+		if (session->expected_message == CHANGE_CIPHER_SPEC && input[0] != 0x14) {
+			//silently ignore invalid messages
+			SEC_STATS_DROP(SEC_STATS_DROP_UNEXPECTED);
+			return;
+		}
+		if (session->expected_message == APPLICATION_DATA && input[0] != 0x17){
+			//silently ignore invalid messages (unless it's a client_hello or a hello_request)
+			if (server && input[0]==0x16){
+				session->expected_message = FIRST_CLIENT_HELLO;
+				sha256_init(&session->ctx);
+				reassembly_clear(session);
+				session->sent_message_seq_number = 0;
+				session->rcvd_message_seq_number = 0;
+				data_free(session);
+				session->handshake_done = 0;
+				session->sent_something = 0;
+			} else if (!server && input[0]==0x16){
+
+			} else {
+				SEC_STATS_DROP(SEC_STATS_DROP_UNEXPECTED);
+				return;
+			}
+		}
+		if (input[0] != 0x17){
+			//a handshake record or ChangeCipherSpec answers the flight we sent
+			SEC_STATS_FLIGHT_ANSWERED(&session->stats);
+		}
+	}
+	rcvd_bad_mac = 0;
 	process_message(input+13, msg_length);
+	if (session->send_error){
+		return;
+	}
+	if (rcvd_bad_mac){
+		//RFC 6347 4.1.2.7: dropped without an alert, a forged record must not end the session
+		SEC_STATS_DROP(SEC_STATS_DROP_MAC);
+	} else {
+		if (input[0] == 0x17 && !session->handshake_done){
+			//the peer got our last flight
+			session->handshake_done = 1;
+			flight_free(session);
+		}
+		replay_update(rcvd_epoch, rcvd_seq);
+	}
 	if (msg_length < input_length - 13){
 		process_input(input+13+msg_length, input_length-13-msg_length);
 	}
@@ -1382,7 +1980,11 @@ static void process_input(char* input, int input_length){
 
 
 static void handshake_event_handler(process_event_t ev, process_data_t data) {
-	if (ev == tcpip_event) {
+	if (ev == connection_release_event){
+		//the app has seen DTLS_CLOSED for it
+		memb_free(&connections_memb, data);
+		connections_used--;
+	} else if (ev == tcpip_event) {
 		if (server)process_post(calling_process, ev, data);
 
 		if (uip_newdata()) {
@@ -1396,16 +1998,36 @@ static void handshake_event_handler(process_event_t ev, process_data_t data) {
 		}
 #endif
 
-			if (server){
-					uip_ipaddr_copy(&udp_conn->ripaddr, &UDP_IP_BUF->srcipaddr);
-					udp_conn->rport = UDP_IP_BUF->srcport;
+			session = session_lookup(&UDP_IP_BUF->srcipaddr, UDP_IP_BUF->srcport);
+			if (server && (session == NULL || session->expected_message == APPLICATION_DATA) && uip_datalen() > 13 &&
+					((char*)uip_appdata)[0] == 0x16 && ((char*)uip_appdata)[3] == 0 && ((char*)uip_appdata)[4] == 0 &&
+					((char*)uip_appdata)[13] == ((char)client_hello & 0xFF)){
+				//a new peer (or a known one starting over), nothing is committed before the cookie checks out
+				if (!accept_client_hello((char*)uip_appdata, uip_datalen())){
+					return;
+				}
+			}
+			if (session == NULL){
+				SEC_STATS_DROP(SEC_STATS_DROP_NO_SESSION);
+				return;
 			}
+			SEC_STATS_ADD(wire_in, uip_datalen());
+			just_connected = 0;
 			process_input((char*)uip_appdata, uip_datalen());
+			if (just_connected && session != NULL && !session->send_error){
+				//records behind the Finished are read from uip_buf, so the queued writes wait for the whole datagram
+				pending_flush(0);
+			}
 
 
 		}
-	} else if (ev == PROCESS_EVENT_TIMER && etimer_expired(&retransmit_timer)){
-		if (server && expected_message == APPLICATION_DATA){}
+	} else if (ev == PROCESS_EVENT_TIMER){
+		for (session = list_head(sessions); session != NULL; session = list_item_next(session)){
+			if (data == &session->retransmit_timer){
+				break;
+			}
+		}
+		if (session == NULL || session->expected_message == APPLICATION_DATA){}
 		else retransmit();
 
 	}
@@ -1430,35 +2052,44 @@ PROCESS_BEGIN();
 	PRINTF(" on port %d\n",port);
 #endif
 	udp_conn = udp_new(addr, UIP_HTONS(port), NULL);
-	current_epoch = 0;
-	next_send_seq = 0;
-	sent_message_seq_number = 0;
-	rcvd_message_seq_number = 0;
-	handshake_done = 0;
-	sha256_init(&ctx);
-	if (mmem_alloc(&mmem,67)==1){
-			buffer = (char*)MMEM_PTR(&mmem);
-			create_first_client_hello(buffer, next_send_seq, current_epoch, sent_message_seq_number);
-			next_send_seq++;
+	session = session_new(addr, UIP_HTONS(port));
+	if (session != NULL){
+		struct cached_session* c = cache_find_peer(addr, UIP_HTONS(port));
+		if (c != NULL){
+			//we talked to this server before, ask for an abbreviated handshake
+			session->session_id_len = c->id_len;
+			memcpy(session->session_id, c->id, c->id_len);
+			memcpy(session->master_secret, c->master_secret, 48);
+		}
+	}
+	if (session != NULL && (buffer = flight_alloc(67+session->session_id_len)) != NULL){
+			create_first_client_hello(buffer, session->session_id, session->session_id_len, session->next_send_seq, session->current_epoch, session->sent_message_seq_number);
+			session->next_send_seq++;
 			//save client_random
 			uint8_t i;
 			for (i = 0; i < 32; i++){
-				client_random[i] = buffer[27+i];
+				session->client_random[i] = buffer[27+i];
 			}
+			//hashed in case the server answers without a HelloVerifyRequest
+			sha256_update(&session->ctx, (unsigned char*)buffer+13, 54+session->session_id_len);
 
-			send(buffer, 67);
-			mmem_free(&mmem);
+			flight_send();
 			/*  done  */
 
 			while (1) {
 				PROCESS_YIELD();
-				if (send_error){
-					send_error = 0;
+				handshake_event_handler(ev, data);
+				session = list_head(sessions);
+				if (session != NULL && session->send_error){
+					session_remove(session);
+				}
+				//stay until the connection handle is given back, see connection_close()
+				if (list_head(sessions) == NULL && connections_used == 0){
 					break;
 				}
-				handshake_event_handler(ev, data);
 			}
 		}
+	uip_udp_remove(udp_conn);
 PROCESS_END();
 }
 
@@ -1468,32 +2099,22 @@ PROCESS_THREAD(dtls_server_listen, ev, data) {
 	PRINTF("server started\n");
 #endif
 	cur_process = PROCESS_CURRENT();
-	uint16_t port = *(uint16_t*) data;
 	udp_conn = udp_new(NULL,UIP_HTONS(0),NULL);
-	udp_bind(udp_conn, UIP_HTONS(443));
-	sha256_init(&ctx); //initialize the context for the hashing function
+	udp_bind(udp_conn, UIP_HTONS(listen_port));
+	cookie_secret_rotate();
+	cookie_secret_rotate();
+	etimer_set(&cookie_timer, CLOCK_SECOND*DTLS_COOKIE_SECRET_LIFETIME);
 	while (1) {
 		PROCESS_YIELD();
+			if (ev == PROCESS_EVENT_TIMER && data == &cookie_timer){
+				cookie_secret_rotate();
+				etimer_reset(&cookie_timer);
+				continue;
+			}
 			handshake_event_handler(ev, data);
-			if (send_error==1){
-				send_error = 0;
-				expected_message = FIRST_CLIENT_HELLO;
-				sent_message_seq_number = 0;
-				rcvd_message_seq_number = 0;
-				current_epoch = 0;
-				sent_something = 0;
-				next_send_seq = 0;
-				first_data = 1;
-				first_data_sent = 1;
-				handshake_done = 0;
-				alert_received = 0;
-				alert_sent = 0;
-				if (!first_data)mmem_free(&data_mmem);
-				first_data = 1;
-				sha256_init(&ctx);
-				memset(&udp_conn->ripaddr, 0, sizeof(udp_conn->ripaddr));
-				udp_conn->rport = 0;
-
+			if (session != NULL && session->send_error==1){
+				//the peer failed or closed, give its slot back
+				session_remove(session);
 			}
 	}
 	PROCESS_END();
@@ -12,13 +12,68 @@
 #include <contiki-net.h>
 #include <contiki-lib.h>
 #include "util.h"
+#include "sha2.h"
+#include "aes.h"
+#include "sec-stats.h"
 /***************************************************************/
 /* 	    		      Defines			       */
 /***************************************************************/
 #define VERSION_MAJOR 254
 #define VERSION_MINOR 253 //DTLS 1.2
 #define TLS_PSK_WITH_AES_128_CCM_8 0x00fd //TBD13 from draft-mcgrew-tls-aes-ccm-02 (http://tools.ietf.org/html/draft-mcgrew-tls-aes-ccm-01#page-4)
-#define MAX_CONNECTIONS 1
+#ifdef DTLS_CONF_MAX_SESSIONS
+#define MAX_CONNECTIONS DTLS_CONF_MAX_SESSIONS
+#else
+#define MAX_CONNECTIONS 2
+#endif
+#ifdef DTLS_CONF_REPLAY_WINDOW
+#define DTLS_REPLAY_WINDOW DTLS_CONF_REPLAY_WINDOW //number of records, multiple of 8
+#else
+#define DTLS_REPLAY_WINDOW 64
+#endif
+#ifdef DTLS_CONF_COOKIE_SECRET_LIFETIME
+#define DTLS_COOKIE_SECRET_LIFETIME DTLS_CONF_COOKIE_SECRET_LIFETIME //seconds until the server picks a new cookie secret
+#else
+#define DTLS_COOKIE_SECRET_LIFETIME 300
+#endif
+#define DTLS_COOKIE_SECRET_LENGTH 12
+#define DTLS_COOKIE_LENGTH 16
+#ifdef DTLS_CONF_SESSION_CACHE
+#define DTLS_SESSION_CACHE DTLS_CONF_SESSION_CACHE //master secrets kept for abbreviated handshakes
+#else
+#define DTLS_SESSION_CACHE 2
+#endif
+#ifdef DTLS_CONF_SESSION_LIFETIME
+#define DTLS_SESSION_LIFETIME DTLS_CONF_SESSION_LIFETIME //seconds a cached session can be resumed
+#else
+#define DTLS_SESSION_LIFETIME 3600
+#endif
+#define DTLS_SESSION_ID_LENGTH 16
+#ifdef DTLS_CONF_REASSEMBLY_SLOTS
+#define DTLS_REASSEMBLY_SLOTS DTLS_CONF_REASSEMBLY_SLOTS //handshake messages reassembled at once: the next one and those after it
+#else
+#define DTLS_REASSEMBLY_SLOTS 2
+#endif
+#ifdef DTLS_CONF_MAX_HANDSHAKE_LENGTH
+#define DTLS_MAX_HANDSHAKE_LENGTH DTLS_CONF_MAX_HANDSHAKE_LENGTH //longest handshake message body accepted, longer ones are dropped
+#else
+#define DTLS_MAX_HANDSHAKE_LENGTH UIP_BUFSIZE
+#endif
+#ifdef DTLS_CONF_RETRANSMIT_INITIAL
+#define DTLS_RETRANSMIT_INITIAL DTLS_CONF_RETRANSMIT_INITIAL //clock ticks before a flight is sent again the first time
+#else
+#define DTLS_RETRANSMIT_INITIAL CLOCK_SECOND
+#endif
+#ifdef DTLS_CONF_RETRANSMIT_MAX
+#define DTLS_RETRANSMIT_MAX DTLS_CONF_RETRANSMIT_MAX //the timeout doubles with every retransmission up to this
+#else
+#define DTLS_RETRANSMIT_MAX (60*CLOCK_SECOND)
+#endif
+#ifdef DTLS_CONF_PENDING_WRITE
+#define DTLS_PENDING_WRITE DTLS_CONF_PENDING_WRITE //bytes of writes queued per session during a handshake, 2 more per write, 0 refuses them
+#else
+#define DTLS_PENDING_WRITE 64
+#endif
 #define RECORD_READY 0
 #define HELLO_REQUEST 0x00
 #define SERVER_HELLO 0x01
@@ -48,8 +103,80 @@ typedef struct SecurityParameters {
 typedef struct Connection {
 	SecurityParameters* securityParameters;
 	struct uip_udp_conn* conn;
+	struct dtls_session* session; //NULL once the session is closed
+	uint8_t flags; //DTLS_CONNECTED etc. of the last dtls_event posted for this connection
 } Connection;
 
+/*
+ * a handshake message put together from its fragments
+ */
+typedef struct dtls_reassembly {
+	struct mmem buf; //12 byte message header, the body and one bit per body byte received
+	uint32 length;
+	uint32 missing; //body bytes not received yet
+	uint16_t msg_seq;
+	uint8_t used;
+} dtls_reassembly;
+
+/*
+	Per-peer state. One slot per remote address/port is taken from a memb pool
+	when the first handshake message of that peer is accepted and given back
+	when the session is closed or fails.
+*/
+typedef struct dtls_session {
+	struct dtls_session* next;
+	uip_ipaddr_t addr;
+	uint16_t port; //network byte order, as in the uIP headers
+	uint8_t expected_message;
+	uint8_t handshake_done;
+	uint8_t sent_something;
+	uint8_t alert_received;
+	uint8_t alert_sent;
+	uint8_t send_error;
+	uint8_t resumed; //abbreviated handshake on a cached master_secret
+	uint16_t current_epoch;
+	uint16_t sent_message_seq_number;
+	uint16_t rcvd_message_seq_number;
+	uint16_t overall_sent_data;
+	uint64 next_send_seq;
+	uint64 next_send_seq_copy;
+	uint64 replay_top; //highest sequence number received in replay_epoch
+	uint16_t replay_epoch;
+	uint8_t replay_bitmap[DTLS_REPLAY_WINDOW/8];
+	char server_random[32];
+	char client_random[32];
+	char master_secret[48];
+	hmac_sha256_key master_key; //master_secret prepared for the PRF
+	char handshake_hash[32];
+	char client_write_key[16];
+	char server_write_key[16];
+	char client_write_IV[4];
+	char server_write_IV[4];
+	AES_KEY client_write_schedule; //expanded once per epoch in generate_keying_material()
+	AES_KEY server_write_schedule;
+	char session_id[DTLS_SESSION_ID_LENGTH];
+	uint8_t session_id_len;
+	char cookie[32]; //client only: cookie from the HelloVerifyRequest
+	uint8_t cookie_len;
+	sha256_ctx ctx;
+	sha256_ctx ctxCopy;
+	dtls_reassembly reassembly[DTLS_REASSEMBLY_SLOTS]; //fragmented or early handshake messages
+	struct mmem flight; //the records of the last flight sent, as they went out
+	uint16_t flight_length; //0 if no flight is kept
+	struct mmem pending; //writes made during the handshake, sent once it is complete
+	uint16_t pending_length; //0 if nothing is queued
+	struct mmem data; //the application data last received, see dtls_appdata()
+	uint16_t data_length;
+	uint8_t data_kept; //1 if data holds an allocation
+	clock_time_t retransmit_interval;
+	struct etimer retransmit_timer;
+#if SEC_STATS_ENABLED
+	struct sec_stats_session stats;
+#endif
+	SecurityParameters sec_param;
+	Connection* connection; //the app's handle, kept apart so it can outlive the session
+} dtls_session;
+
 typedef struct ProtocolVersion {
 	uint8_t major;
 	uint8_t minor;
@@ -85,24 +212,37 @@ typedef struct Data {
 	uint16_t port;
 } Data;
 
-uint8_t dtls_flags;
-
-#define dtls_connected() (dtls_flags & DTLS_CONNECTED)
-#define dtls_newdata() (dtls_flags & DTLS_NEWDATA)
-#define dtls_closed() (dtls_flags & DTLS_CLOSED)
-#define dtls_rehandshake() (dtls_flags & DTLS_REHANDSHAKE)
+/*
+	What a dtls_event is about, c is the Connection the event was posted with.
+	DTLS_CLOSED is posted when the session ended, by either side or on an error. The
+	Connection must not be used any more once the app has seen it
+*/
+#define dtls_flags(c) (((Connection*)(c))->flags)
+#define dtls_connected(c) (dtls_flags(c) & DTLS_CONNECTED)
+#define dtls_newdata(c) (dtls_flags(c) & DTLS_NEWDATA) //also set with DTLS_CONNECTED if the peer's first data came with its Finished
+#define dtls_closed(c) (dtls_flags(c) & DTLS_CLOSED)
+#define dtls_rehandshake(c) (dtls_flags(c) & DTLS_REHANDSHAKE)
+/*
+	The data that came with DTLS_NEWDATA, 0-terminated. It stays valid until the next
+	data of the same connection arrives or the connection is closed, NULL after that
+*/
+#define dtls_appdata(c) (((Connection*)(c))->session != NULL ? \
+		(char*)MMEM_PTR(&((Connection*)(c))->session->data) : NULL)
+#define dtls_applen(c) (((Connection*)(c))->session != NULL ? ((Connection*)(c))->session->data_length : 0)
 
 /*
 	API function to use when establishing a connection with the server (used by a client)
 	ripaddr - IP address of the server
 	port - port to connect to
-	returns a connection to be used for later communication
+	returns a connection to be used for later communication, NULL if the handshake could not start.
+	It can be written to right away, see dtls_write
 */
-void dtls_connect(uip_ipaddr_t *ripaddr, uint16_t port);
+Connection* dtls_connect(uip_ipaddr_t *ripaddr, uint16_t port);
 
 /*
 	Starting to listen for incoming connections (used by a server)
 	port - port to listen on
+	max_conn - number of peers served concurrently, at most MAX_CONNECTIONS
 */
 int dtls_listen(uint16_t port, uint8_t max_conn);
 
@@ -110,6 +250,9 @@ int dtls_listen(uint16_t port, uint8_t max_conn);
 	Send data over the connection
 	conn - connection over which to send the data
 	toWrite - data to send
+	While a handshake (the first one or a rekeying) runs, up to DTLS_PENDING_WRITE bytes are queued
+	and sent when it is complete, in the same datagram as our last flight if we send one.
+	returns 0 if the data was sent or queued, -1 otherwise
 */
 int dtls_write(Connection* conn, char* toWrite, int length);
 
@@ -119,8 +262,6 @@ int dtls_write(Connection* conn, char* toWrite, int length);
 void dtls_close(Connection* conn);
 
 process_event_t dtls_event;
-char* dtls_appdata;
-int dtls_applen;
 PROCESS_NAME(dtls_client_handshake_process);
 PROCESS_NAME(dtls_server_listen);
 
@@ -1,6 +1,6 @@
 #include "util.h"
 #include "dtls.h"
-#include "random.h"
+#include "crypto_random.h"
 #include "ntpd.h"
 #include "hmac_sha2.h"
 #if CONIKI_TARGET_AVR_RAVEN
@@ -57,9 +57,9 @@ void create_helloverify_request(char* buffer, unsigned char* cookie, unsigned lo
 	}
 
 }
-void create_server_hello(char* buffer, char* random, uint64 seq_num, uint16_t epoch, uint16_t msn) {
-	char* ptr = add_record_header(buffer, handshake, seq_num, epoch, 50);
-	ptr = add_message_header(ptr, server_hello, msn, 38);
+void create_server_hello(char* buffer, char* random, char* session_id, uint8_t session_id_len, uint64 seq_num, uint16_t epoch, uint16_t msn) {
+	char* ptr = add_record_header(buffer, handshake, seq_num, epoch, 50+session_id_len);
+	ptr = add_message_header(ptr, server_hello, msn, 38+session_id_len);
 	*ptr = (char) (VERSION_MAJOR & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MINOR & 0xFF);	ptr++;
 	uint8_t i;
@@ -69,37 +69,39 @@ void create_server_hello(char* buffer, char* random, uint64 seq_num, uint16_t ep
 		*ptr = (char) ((current_time >> 16) & 0xFF);	ptr++;
 		*ptr = (char) ((current_time >> 8) & 0xFF);	ptr++;
 		*ptr = (char) ((current_time) & 0xFF);	ptr++;
-		random_init(clock_time());
-		for (i = 0; i < 28; i++) {
-			*ptr = (char) (random_rand() % 128 & 0xFF);
-			ptr++;
-		}
+		crypto_random(ptr, 28);
+		ptr += 28;
 	} else {
 		for (i = 0; i < 32; i++){
 			*ptr = random[i];
 			ptr++;
 		}
 	}
-	*ptr = 0x00;	ptr++; //session id is null so the length is 0
+	*ptr = (char) session_id_len;	ptr++;
+	for (i = 0; i < session_id_len; i++){
+		*ptr = session_id[i]; ptr++;
+	}
 	*ptr = (char) ((TLS_PSK_WITH_AES_128_CCM_8 >> 8) & 0xFF);	ptr++;
 	*ptr = (char) ((TLS_PSK_WITH_AES_128_CCM_8) & 0xFF);	ptr++;
 	*ptr = 0x00;	ptr++; //null compression only (length 1 null 0)
-	/* SERVER_HELLO_DONE */
-	ptr = add_record_header(ptr, handshake, seq_num+1, epoch, 12);
-	add_message_header(ptr, server_hello_done, 2, 0);
 }
 
-void create_first_server_hello(char* buffer, uint64 seq_num, uint16_t epoch, uint16_t msn){
-	create_server_hello(buffer, NULL, seq_num, epoch, msn);
+void create_first_server_hello(char* buffer, char* session_id, uint8_t session_id_len, uint64 seq_num, uint16_t epoch, uint16_t msn){
+	create_server_hello(buffer, NULL, session_id, session_id_len, seq_num, epoch, msn);
+	/* SERVER_HELLO_DONE */
+	char* ptr = add_record_header(buffer+63+session_id_len, handshake, seq_num+1, epoch, 12);
+	add_message_header(ptr, server_hello_done, msn+1, 0);
 }
 
-void create_next_server_hello(char* buffer, char* random, uint64 seq_num, uint16_t epoch, uint16_t msn){
-	create_server_hello(buffer, random, seq_num, epoch, msn);
+void create_next_server_hello(char* buffer, char* random, char* session_id, uint8_t session_id_len, uint64 seq_num, uint16_t epoch, uint16_t msn){
+	create_server_hello(buffer, random, session_id, session_id_len, seq_num, epoch, msn);
+	char* ptr = add_record_header(buffer+63+session_id_len, handshake, seq_num+1, epoch, 12);
+	add_message_header(ptr, server_hello_done, msn+1, 0);
 }
 
-void create_client_hello(char* buffer, char* random, char* cookie, uint8_t cookie_len, uint64 seq_num, uint16_t epoch, uint16_t message_seq) {
-	char* ptr = add_record_header(buffer, handshake, seq_num, epoch, 54+cookie_len);
-	ptr = add_message_header(ptr, client_hello, message_seq, 42+cookie_len );
+void create_client_hello(char* buffer, char* random, char* session_id, uint8_t session_id_len, char* cookie, uint8_t cookie_len, uint64 seq_num, uint16_t epoch, uint16_t message_seq) {
+	char* ptr = add_record_header(buffer, handshake, seq_num, epoch, 54+session_id_len+cookie_len);
+	ptr = add_message_header(ptr, client_hello, message_seq, 42+session_id_len+cookie_len );
 
 	*ptr = (char) (VERSION_MAJOR & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MINOR & 0xFF);	ptr++;
@@ -111,18 +113,18 @@ void create_client_hello(char* buffer, char* random, char* cookie, uint8_t cooki
 		*ptr = (char) ((current_time >> 8) & 0xFF);	ptr++;
 		*ptr = (char) ((current_time) & 0xFF);	ptr++;
 
-		random_init(clock_time());
-		for (i = 0; i < 28; i++) {
-			*ptr = (char) (random_rand() % 128 & 0xFF);
-			ptr++;
-		}
+		crypto_random(ptr, 28);
+		ptr += 28;
 	} else {
 		for (i = 0; i < 32; i++) {
 			*ptr = random[i];
 			ptr++;
 		}
 	}
-	*ptr = 0x00;	ptr++; //session id is null so the length is 0
+	*ptr = (char) session_id_len;	ptr++; //a cached session the client wants to resume
+	for (i = 0; i < session_id_len; i++){
+		*ptr = session_id[i]; ptr++;
+	}
 	//cookie goes here
 	*ptr = (char) (cookie_len & 0xFF); ptr++;
 	if (cookie!=NULL){
@@ -139,11 +141,11 @@ void create_client_hello(char* buffer, char* random, char* cookie, uint8_t cooki
 	*ptr = 0x00;	ptr++; //null compression only (length 1 null 0)
 }
 
-void create_first_client_hello(char* buffer, uint64 seq_num, uint16_t epoch, uint16_t msn){
-	create_client_hello(buffer, NULL, NULL, 0, seq_num, epoch, msn);
+void create_first_client_hello(char* buffer, char* session_id, uint8_t session_id_len, uint64 seq_num, uint16_t epoch, uint16_t msn){
+	create_client_hello(buffer, NULL, session_id, session_id_len, NULL, 0, seq_num, epoch, msn);
 }
-void create_second_client_hello(char* buffer, char* random, char* cookie, uint8_t cookie_len, uint64 seq_num, uint16_t epoch, uint16_t msn){
-	create_client_hello(buffer, random, cookie, cookie_len, seq_num, epoch, msn);
+void create_second_client_hello(char* buffer, char* random, char* session_id, uint8_t session_id_len, char* cookie, uint8_t cookie_len, uint64 seq_num, uint16_t epoch, uint16_t msn){
+	create_client_hello(buffer, random, session_id, session_id_len, cookie, cookie_len, seq_num, epoch, msn);
 }
 void create_client_key_exchange(char* buffer, char* psk_identity, uint16_t psk_identity_length, uint64 seq_num, uint16_t epoch, uint16_t msn){
 
@@ -193,28 +195,3 @@ void create_alert(char* buffer, uint64 seq_num, uint16_t epoch, uint8_t level, u
 	*ptr = (char) (level & 0xFF);	ptr++;
 	*ptr = (char) (type & 0xFF);	ptr++;
 }
-
-int PRF(char* output,  char* key, int key_length, char* label, char* seed, int seed_length, int output_length){
-	char A[32];
-	hmac_sha256_ctx c;
-	hmac_sha256_init(&c, key, key_length);
-	hmac_sha256_update(&c, label, strlen(label));
-	hmac_sha256_update(&c, seed, seed_length);
-	hmac_sha256_final(&c, A, 32);
-	int current_length = 0;
-	while (current_length < output_length){
-		hmac_sha256_reinit(&c);
-		hmac_sha256_update(&c, A, 32);
-		hmac_sha256_update(&c, label, strlen(label));
-		hmac_sha256_update(&c, seed, seed_length);
-		int min = output_length - current_length < 32 ? output_length - current_length : 32;
-		hmac_sha256_final(&c, output+current_length, min);
-		//change A
-		hmac_sha256_reinit(&c);
-		hmac_sha256_update(&c, A, 32);
-		hmac_sha256_final(&c, A, 32);
-		current_length+=32;
-	}
-
-	return 1;
-}
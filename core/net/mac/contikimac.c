@@ -72,6 +72,9 @@
 #ifndef WITH_FAST_SLEEP
 #define WITH_FAST_SLEEP              1
 #endif
+#ifndef WITH_BURST
+#define WITH_BURST                   1
+#endif
 
 #if NETSTACK_RDC_CHANNEL_CHECK_RATE >= 64
 #undef WITH_PHASE_OPTIMIZATION
@@ -246,6 +249,23 @@ static volatile rtimer_clock_t stream_until;
 
 #define DEFAULT_STREAM_TIME (4 * CYCLE_TIME)
 
+/* A unicast frame with the pending bit set (e.g. a 6lowpan fragment
+   that is not the last one) announces that more frames to the same
+   receiver follow right away. The receiver keeps its radio on until
+   a frame without the pending bit arrives or BURST_TIME has passed,
+   so the sender strobes only for the first frame of the burst and
+   sends the others without CCA and phase lock. */
+#ifdef CONTIKIMAC_CONF_BURST_TIME
+#define BURST_TIME CONTIKIMAC_CONF_BURST_TIME
+#else
+#define BURST_TIME                         RTIMER_ARCH_SECOND / 32
+#endif
+
+static rimeaddr_t burst_to;
+static volatile rtimer_clock_t burst_until;
+static volatile uint8_t is_receiving_burst;
+static volatile rtimer_clock_t receive_burst_until;
+
 #ifndef MIN
 #define MIN(a, b) ((a) < (b)? (a) : (b))
 #endif /* MIN */
@@ -277,11 +297,28 @@ on(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+static uint8_t
+receiving_burst(void)
+{
+  if(WITH_BURST && is_receiving_burst) {
+#if NURTIMER
+    if(RTIMER_CLOCK_LT(RTIMER_NOW(), RTIMER_NOW(), receive_burst_until))
+#else
+    if(RTIMER_CLOCK_LT(RTIMER_NOW(), receive_burst_until))
+#endif
+      {
+        return 1;
+      }
+    is_receiving_burst = 0;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
 static void
 off(void)
 {
   if(contikimac_is_on && radio_is_on != 0 && /*is_streaming == 0 &&*/
-     contikimac_keep_radio_on == 0
+     contikimac_keep_radio_on == 0 && !receiving_burst()
      /* && is_snooping == 0*/) {
     radio_is_on = 0;
     NETSTACK_RADIO.off();
@@ -593,6 +630,8 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr)
   uint8_t is_broadcast = 0;
   uint8_t is_reliable = 0;
   uint8_t is_known_receiver = 0;
+  uint8_t is_burst = 0;
+  uint8_t more_follow;
   uint8_t collisions;
   int transmit_len;
   int i;
@@ -636,6 +675,19 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr)
   is_reliable = packetbuf_attr(PACKETBUF_ATTR_RELIABLE) ||
     packetbuf_attr(PACKETBUF_ATTR_ERELIABLE);
 
+  /* The upper layer sets the pending flag when more frames to the
+     same receiver follow. If the previous frame had it set and was
+     acked, the receiver is still listening for this one. */
+  more_follow = !is_broadcast && packetbuf_attr(PACKETBUF_ATTR_PENDING);
+  if(WITH_BURST && !is_broadcast &&
+     rimeaddr_cmp(&burst_to, packetbuf_addr(PACKETBUF_ADDR_RECEIVER))) {
+#if NURTIMER
+    is_burst = RTIMER_CLOCK_LT(RTIMER_NOW(), RTIMER_NOW(), burst_until);
+#else
+    is_burst = RTIMER_CLOCK_LT(RTIMER_NOW(), burst_until);
+#endif
+  }
+
   if(WITH_STREAMING) {
     if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
        PACKETBUF_ATTR_PACKET_TYPE_STREAM) {
@@ -711,7 +763,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr)
   /* Remove the MAC-layer header since it will be recreated next time around. */
   packetbuf_hdr_remove(hdrlen);
 
-  if(!is_broadcast && !is_streaming) {
+  if(!is_broadcast && !is_streaming && !is_burst) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(&phase_list, packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
                      CYCLE_TIME, GUARD_TIME,
@@ -761,7 +813,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr)
   contikimac_was_on = contikimac_is_on;
   contikimac_is_on = 1;
   
-  if(is_streaming == 0) {
+  if(is_streaming == 0 && is_burst == 0) {
     /* Check if there are any transmissions by others. */
     for(i = 0; i < CCA_COUNT_MAX; ++i) {
       t0 = RTIMER_NOW();
@@ -903,7 +955,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr)
   }
 
   if(!is_broadcast) {
-    if(collisions == 0 && is_streaming == 0) {
+    if(collisions == 0 && is_streaming == 0 && is_burst == 0) {
       phase_update(&phase_list, packetbuf_addr(PACKETBUF_ADDR_RECEIVER), encounter_time,
                    ret);
     }
@@ -917,6 +969,15 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr)
     }
   }
 
+  if(WITH_BURST) {
+    if(more_follow && got_strobe_ack) {
+      rimeaddr_copy(&burst_to, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+      burst_until = RTIMER_NOW() + BURST_TIME;
+    } else {
+      rimeaddr_copy(&burst_to, &rimeaddr_null);
+    }
+  }
+
   return ret;
 }
 /*---------------------------------------------------------------------------*/
@@ -962,6 +1023,20 @@ input_packet(void)
       /* This is a regular packet that is destined to us or to the
          broadcast address. */
 
+      if(WITH_BURST &&
+         rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                      &rimeaddr_node_addr)) {
+        if(packetbuf_attr(PACKETBUF_ATTR_PENDING)) {
+          /* The sender has more frames for us, stay awake for them. */
+          receive_burst_until = RTIMER_NOW() + BURST_TIME;
+          is_receiving_burst = 1;
+          on();
+        } else if(is_receiving_burst) {
+          is_receiving_burst = 0;
+          off();
+        }
+      }
+
 #if CONTIKIMAC_CONF_ANNOUNCEMENTS
       {
         struct announcement_msg *hdr = packetbuf_dataptr();
@@ -977,8 +1052,10 @@ input_packet(void)
 #if WITH_PHASE_OPTIMIZATION
       /* If the sender has set its pending flag, it has its radio
          turned on and we should drop the phase estimation that we
-         have from before. */
-      if(packetbuf_attr(PACKETBUF_ATTR_PENDING)) {
+         have from before. A burst sender does not keep its radio on,
+         so its phase is still valid. */
+      if((WITH_STREAMING || !WITH_BURST) &&
+         packetbuf_attr(PACKETBUF_ATTR_PENDING)) {
         phase_remove(&phase_list, packetbuf_addr(PACKETBUF_ADDR_SENDER));
       }
 #endif /* WITH_PHASE_OPTIMIZATION */
@@ -76,25 +76,61 @@
 #error Change CSMA_CONF_MAX_MAC_TRANSMISSIONS in contiki-conf.h or in your Makefile.
 #endif /* CSMA_CONF_MAX_MAC_TRANSMISSIONS < 1 */
 
+/* Packets queued for all neighbors together */
+#ifdef CSMA_CONF_MAX_QUEUED_PACKETS
+#define CSMA_MAX_QUEUED_PACKETS CSMA_CONF_MAX_QUEUED_PACKETS
+#else
+#define CSMA_MAX_QUEUED_PACKETS 6
+#endif /* CSMA_CONF_MAX_QUEUED_PACKETS */
+
+/* Neighbors that can have packets queued at the same time */
+#ifdef CSMA_CONF_MAX_NEIGHBOR_QUEUES
+#define CSMA_MAX_NEIGHBOR_QUEUES CSMA_CONF_MAX_NEIGHBOR_QUEUES
+#else
+#define CSMA_MAX_NEIGHBOR_QUEUES 4
+#endif /* CSMA_CONF_MAX_NEIGHBOR_QUEUES */
+
+/* Packets one neighbor may hold, so that an unreachable neighbor
+   cannot use up the whole budget */
+#ifdef CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR
+#define CSMA_MAX_PACKETS_PER_NEIGHBOR CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR
+#else
+#define CSMA_MAX_PACKETS_PER_NEIGHBOR 4
+#endif /* CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR */
+
 struct queued_packet {
   struct queued_packet *next;
   struct queuebuf *buf;
-  /*  struct ctimer retransmit_timer;*/
   mac_callback_t sent;
   void *cptr;
   uint8_t transmissions, max_transmissions;
   uint8_t collisions, deferrals;
 };
 
-#define MAX_QUEUED_PACKETS 6
-MEMB(packet_memb, struct queued_packet, MAX_QUEUED_PACKETS);
-LIST(queued_packet_list);
+/* Every neighbor with packets queued has its own queue and backoff
+   timer, so that a neighbor that does not answer only delays its
+   own packets. When the RDC layer is busy as a timer fires, the
+   neighbor is marked as waiting and the neighbors are then served
+   in round-robin order. */
+struct neighbor_queue {
+  struct neighbor_queue *next;
+  rimeaddr_t addr;
+  struct ctimer transmit_timer;
+  uint8_t waiting;
+  uint8_t length;
+  LIST_STRUCT(queued_packet_list);
+};
+
+MEMB(packet_memb, struct queued_packet, CSMA_MAX_QUEUED_PACKETS);
+MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
+LIST(neighbor_list);
 
-static struct ctimer transmit_timer;
+struct csma_stats csma_stats;
 
 static uint8_t rdc_is_transmitting;
 
 static void packet_sent(void *ptr, int status, int num_transmissions);
+static void transmit_packet_list(void *ptr);
 
 /*---------------------------------------------------------------------------*/
 static clock_time_t
@@ -114,63 +150,91 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+static struct neighbor_queue *
+neighbor_queue_from_addr(const rimeaddr_t *addr)
+{
+  struct neighbor_queue *n;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(rimeaddr_cmp(&n->addr, addr)) {
+      return n;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 static void
-transmit_queued_packet(void *ptr)
+transmit_packet_list(void *ptr)
 {
-  /*  struct queued_packet *q = ptr;*/
+  struct neighbor_queue *n = ptr;
   struct queued_packet *q;
 
   /* Don't transmit a packet if the RDC is still transmitting the
-     previous one. */
+     previous one, packet_sent() comes back to this neighbor. */
   if(rdc_is_transmitting) {
+    n->waiting = 1;
     return;
   }
-  
-  //  printf("q %d\n", list_length(queued_packet_list));
+  n->waiting = 0;
 
-  q = list_head(queued_packet_list);
+  q = list_head(n->queued_packet_list);
 
   if(q != NULL) {
     queuebuf_to_packetbuf(q->buf);
     PRINTF("csma: sending number %d %p, queue len %d\n", q->transmissions, q,
-           list_length(queued_packet_list));
-    //    printf("s %d\n", packetbuf_addr(PACKETBUF_ADDR_RECEIVER)->u8[0]);
+           n->length);
     rdc_is_transmitting = 1;
     NETSTACK_RDC.send(packet_sent, q);
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Starts the next neighbor after n that was held back by a busy RDC */
 static void
-start_transmission_timer(void)
+transmit_next_waiting(struct neighbor_queue *n)
+{
+  struct neighbor_queue *m;
+
+  if(n == NULL) {
+    return;
+  }
+  m = n;
+  do {
+    m = list_item_next(m);
+    if(m == NULL) {
+      m = list_head(neighbor_list);
+    }
+    if(m != NULL && m->waiting) {
+      transmit_packet_list(m);
+      return;
+    }
+  } while(m != NULL && m != n);
+}
+/*---------------------------------------------------------------------------*/
+static struct neighbor_queue *
+neighbor_of_packet(struct queued_packet *q)
 {
-  PRINTF("csma: start_transmission_timer, queue len %d\n",
-         list_length(queued_packet_list));
-  if(list_length(queued_packet_list) > 0) {
-    if(ctimer_expired(&transmit_timer)) {
-      ctimer_set(&transmit_timer, 0,
-                 transmit_queued_packet, NULL);
+  struct neighbor_queue *n;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(list_head(n->queued_packet_list) == q) {
+      return n;
     }
   }
+  return NULL;
 }
 /*---------------------------------------------------------------------------*/
 static void
-free_queued_packet(void)
+free_first_packet(struct neighbor_queue *n)
 {
   struct queued_packet *q;
 
-  //  printf("q %d\n", list_length(queued_packet_list));
-
-  q = list_head(queued_packet_list);
-
+  q = list_pop(n->queued_packet_list);
   if(q != NULL) {
     queuebuf_free(q->buf);
-    list_remove(queued_packet_list, q);
     memb_free(&packet_memb, q);
-    PRINTF("csma: free_queued_packet, queue length %d\n",
-           list_length(queued_packet_list));
-    if(list_length(queued_packet_list) > 0) {
-      ctimer_set(&transmit_timer, default_timebase(), transmit_queued_packet, NULL);
-    }
+    n->length--;
+    csma_stats.queued--;
+    PRINTF("csma: free_first_packet, queue length %d\n", n->length);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -178,6 +242,7 @@ static void
 packet_sent(void *ptr, int status, int num_transmissions)
 {
   struct queued_packet *q = ptr;
+  struct neighbor_queue *n;
   clock_time_t time = 0;
   mac_callback_t sent;
   void *cptr;
@@ -185,7 +250,13 @@ packet_sent(void *ptr, int status, int num_transmissions)
   int backoff_transmissions;
 
   rdc_is_transmitting = 0;
-  
+
+  n = neighbor_of_packet(q);
+  if(n == NULL) {
+    transmit_next_waiting(list_head(neighbor_list));
+    return;
+  }
+
   switch(status) {
   case MAC_TX_OK:
   case MAC_TX_NOACK:
@@ -203,8 +274,9 @@ packet_sent(void *ptr, int status, int num_transmissions)
   cptr = q->cptr;
   num_tx = q->transmissions;
   
-  if(status == MAC_TX_COLLISION ||
-     status == MAC_TX_NOACK) {
+  if((status == MAC_TX_COLLISION ||
+      status == MAC_TX_NOACK) &&
+     q->transmissions < q->max_transmissions) {
 
     /* If the transmission was not performed because of a collision or
        noack, we must retransmit the packet. */
@@ -230,40 +302,57 @@ packet_sent(void *ptr, int status, int num_transmissions)
     backoff_transmissions = q->transmissions + 1;
 
     /* Clamp the number of backoffs so that we don't get a too long
-       timeout here, since that will delay all packets in the
-       queue. */
+       timeout here, since that will delay all packets to this
+       neighbor. */
     if(backoff_transmissions > 3) {
       backoff_transmissions = 3;
     }
     time = time + (random_rand() % (backoff_transmissions * time));
 
-    if(q->transmissions < q->max_transmissions) {
-      PRINTF("csma: retransmitting with time %lu %p\n", time, q);
-      ctimer_set(&transmit_timer, time,
-                 transmit_queued_packet, NULL);
-    } else {
-      PRINTF("csma: drop with status %d after %d transmissions, %d collisions\n",
-             status, q->transmissions, q->collisions);
-      /*      queuebuf_to_packetbuf(q->buf);*/
-      free_queued_packet();
-      mac_call_sent_callback(sent, cptr, status, num_tx);
-    }
+    PRINTF("csma: retransmitting with time %lu %p\n", time, q);
+    ctimer_set(&n->transmit_timer, time, transmit_packet_list, n);
   } else {
-    if(status == MAC_TX_OK) {
+    if(status == MAC_TX_NOACK) {
+      PRINTF("csma: drop after %d transmissions, %d collisions\n",
+             q->transmissions, q->collisions);
+      csma_stats.drop_noack++;
+    } else if(status == MAC_TX_COLLISION) {
+      PRINTF("csma: drop after %d transmissions, %d collisions\n",
+             q->transmissions, q->collisions);
+      csma_stats.drop_collision++;
+    } else if(status == MAC_TX_OK) {
       PRINTF("csma: rexmit ok %d\n", q->transmissions);
     } else {
       PRINTF("csma: rexmit failed %d: %d\n", q->transmissions, status);
+      csma_stats.drop_error++;
+    }
+    free_first_packet(n);
+    if(list_head(n->queued_packet_list) != NULL) {
+      /* Only a failed packet waits for the backoff, the next one to
+         this neighbor goes right away. */
+      ctimer_set(&n->transmit_timer, status == MAC_TX_OK ? 0 : default_timebase(),
+                 transmit_packet_list, n);
+    } else {
+      ctimer_stop(&n->transmit_timer);
+      list_remove(neighbor_list, n);
+      memb_free(&neighbor_memb, n);
+      n = NULL;
     }
-    /*    queuebuf_to_packetbuf(q->buf);*/
-    free_queued_packet();
     mac_call_sent_callback(sent, cptr, status, num_tx);
   }
+
+  /* Hand the RDC to the next neighbor in line, unless the callback
+     already started a transmission. */
+  if(!rdc_is_transmitting) {
+    transmit_next_waiting(n != NULL ? n : (struct neighbor_queue *)list_head(neighbor_list));
+  }
 }
 /*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
   struct queued_packet *q;
+  struct neighbor_queue *n;
   static uint16_t seqno;
   
   packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, seqno++);
@@ -273,8 +362,32 @@ send_packet(mac_callback_t sent, void *ptr)
   if(!rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
                    &rimeaddr_null)) {
 
+    n = neighbor_queue_from_addr(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+    if(n == NULL) {
+      n = memb_alloc(&neighbor_memb);
+      if(n != NULL) {
+        rimeaddr_copy(&n->addr, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+        n->waiting = 0;
+        n->length = 0;
+        LIST_STRUCT_INIT(n, queued_packet_list);
+        list_add(neighbor_list, n);
+      } else {
+        csma_stats.no_neighbor++;
+      }
+    }
+
     /* Remember packet for later. */
-    q = memb_alloc(&packet_memb);
+    if(n != NULL && n->length >= CSMA_MAX_PACKETS_PER_NEIGHBOR) {
+      csma_stats.neighbor_full++;
+      q = NULL;
+    } else if(n != NULL) {
+      q = memb_alloc(&packet_memb);
+      if(q == NULL) {
+        csma_stats.no_packet++;
+      }
+    } else {
+      q = NULL;
+    }
     if(q != NULL) {
       q->buf = queuebuf_new_from_packetbuf();
       if(q->buf != NULL) {
@@ -291,18 +404,34 @@ send_packet(mac_callback_t sent, void *ptr)
         q->sent = sent;
         q->cptr = ptr;
         if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
-           PACKETBUF_ATTR_PACKET_TYPE_ACK) {
-          list_push(queued_packet_list, q);
+           PACKETBUF_ATTR_PACKET_TYPE_ACK &&
+           list_head(n->queued_packet_list) != NULL) {
+          /* ACKs go next, but not ahead of the packet that may be in
+             the RDC right now. */
+          list_insert(n->queued_packet_list,
+                      list_head(n->queued_packet_list), q);
         } else {
-          list_add(queued_packet_list, q);
+          list_add(n->queued_packet_list, q);
+        }
+        n->length++;
+        csma_stats.queued++;
+        if(csma_stats.queued > csma_stats.queued_max) {
+          csma_stats.queued_max = csma_stats.queued;
+        }
+        if(n->length == 1) {
+          ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
         }
-        start_transmission_timer();
         return;
       }
       memb_free(&packet_memb, q);
+      csma_stats.no_packet++;
       PRINTF("csma: could not allocate queuebuf, will drop if collision or noack\n");
     }
-    PRINTF("csma: could not allocate memb, will drop if collision or noack\n");
+    if(n != NULL && n->length == 0) {
+      list_remove(neighbor_list, n);
+      memb_free(&neighbor_memb, n);
+    }
+    PRINTF("csma: could not queue packet, will drop if collision or noack\n");
   } else {
     PRINTF("csma: send broadcast (%d) or without retransmissions (%d)\n",
            !rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
@@ -343,6 +472,8 @@ static void
 init(void)
 {
   memb_init(&packet_memb);
+  memb_init(&neighbor_memb);
+  list_init(neighbor_list);
   rdc_is_transmitting = 0;
 }
 /*---------------------------------------------------------------------------*/
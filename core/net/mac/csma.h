@@ -47,6 +47,21 @@
 
 extern const struct mac_driver csma_driver;
 
+/* Queue lengths and the reasons why packets were dropped or sent
+   without retransmissions */
+struct csma_stats {
+  uint16_t queued;         /* packets in the neighbor queues right now */
+  uint16_t queued_max;     /* highest value of queued */
+  uint16_t drop_noack;     /* no ACK after the last transmission */
+  uint16_t drop_collision; /* collision at the last transmission */
+  uint16_t drop_error;     /* the RDC layer failed to send */
+  uint16_t no_neighbor;    /* all neighbor queues in use, sent unqueued */
+  uint16_t neighbor_full;  /* neighbor queue full, sent unqueued */
+  uint16_t no_packet;      /* packet budget or queuebufs used up, sent unqueued */
+};
+
+extern struct csma_stats csma_stats;
+
 const struct mac_driver *csma_init(const struct mac_driver *r);
 
 #endif /* __CSMA_H__ */
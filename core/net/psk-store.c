@@ -0,0 +1,192 @@
+/*
+ * psk-store.c
+ *
+ * Binary search over the sorted index of PSK_STORE_FILE with an LRU cache
+ * in front of it, see psk-store.h for the file layout.
+ */
+
+#include "psk-store.h"
+#include "cfs/cfs.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include <string.h>
+
+struct psk_cache_entry {
+	struct psk_cache_entry* next;
+	uint8_t identity_length;
+	uint8_t key_length;
+	char identity[PSK_STORE_MAX_IDENTITY];
+	char key[PSK_STORE_MAX_KEY];
+};
+
+MEMB(cache_memb, struct psk_cache_entry, PSK_STORE_CACHE_SIZE);
+LIST(cache); //most recently used first
+
+/***************************************************************/
+/*                      Helper functions                       */
+/***************************************************************/
+
+static struct psk_cache_entry* cache_find(const char* identity, uint8_t length){
+	struct psk_cache_entry* e;
+	for (e = list_head(cache); e != NULL; e = e->next){
+		if (e->identity_length == length && memcmp(e->identity, identity, length) == 0){
+			list_remove(cache, e);
+			list_push(cache, e);
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void cache_store(const char* identity, uint8_t length, char* key, uint8_t key_length){
+	struct psk_cache_entry* e;
+	if (length > PSK_STORE_MAX_IDENTITY || key_length > PSK_STORE_MAX_KEY){
+		return;
+	}
+	e = memb_alloc(&cache_memb);
+	if (e == NULL){
+		//evict the least recently used identity
+		e = list_chop(cache);
+	}
+	e->identity_length = length;
+	e->key_length = key_length;
+	memcpy(e->identity, identity, length);
+	memcpy(e->key, key, key_length);
+	list_push(cache, e);
+}
+
+static uint32_t get_uint32(uint8_t* p){
+	return ((uint32_t)p[0]<<24) | ((uint32_t)p[1]<<16) | ((uint32_t)p[2]<<8) | p[3];
+}
+
+static uint8_t read_entry(int fd, uint16_t i, uint8_t* entry){
+	cfs_seek(fd, PSK_STORE_HEADER_LENGTH + (cfs_offset_t)i*PSK_STORE_ENTRY_LENGTH, CFS_SEEK_SET);
+	return cfs_read(fd, entry, PSK_STORE_ENTRY_LENGTH) == PSK_STORE_ENTRY_LENGTH;
+}
+
+/*
+ * compares the identity stored at offset with identity in chunks,
+ * identities are not limited to PSK_STORE_MAX_IDENTITY in the file
+ */
+static uint8_t match_identity(int fd, uint16_t offset, const char* identity, uint8_t length){
+	char buf[16];
+	uint8_t pos = 0;
+	uint8_t n;
+	cfs_seek(fd, offset, CFS_SEEK_SET);
+	while (pos < length){
+		n = length - pos < sizeof(buf) ? length - pos : sizeof(buf);
+		if (cfs_read(fd, buf, n) != n || memcmp(buf, identity + pos, n) != 0){
+			return 0;
+		}
+		pos += n;
+	}
+	return 1;
+}
+
+/*
+ * whether the file a node was provisioned with lists keys, then the
+ * missing keystore must not let the built-in key through
+ */
+static uint8_t legacy_keys(){
+	char buf[16+4];
+	uint8_t kept = 0;
+	int n;
+	int fd = cfs_open(PSK_STORE_LEGACY_FILE, CFS_READ);
+	if (fd < 0){
+		return 0;
+	}
+	while ((n = cfs_read(fd, buf+kept, sizeof(buf)-kept)) > 0){
+		n += kept;
+		for (kept = 0; kept + 5 <= n; kept++){
+			if (memcmp(buf+kept, "<psk>", 5) == 0){
+				cfs_close(fd);
+				return 1;
+			}
+		}
+		//the tag may continue in the next chunk
+		kept = n < 4 ? n : 4;
+		memmove(buf, buf+n-kept, kept);
+	}
+	cfs_close(fd);
+	return 0;
+}
+
+/***************************************************************/
+/*                     Keystore functions                      */
+/***************************************************************/
+
+uint32_t psk_store_hash(const char* identity, uint8_t length){
+	uint32_t hash = 2166136261UL;
+	uint8_t i;
+	for (i = 0; i < length; i++){
+		hash ^= (uint8_t)identity[i];
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+int psk_store_lookup(const char* identity, uint8_t length, char* key, uint8_t key_size){
+	struct psk_cache_entry* e;
+	uint8_t entry[PSK_STORE_ENTRY_LENGTH];
+	uint32_t hash;
+	uint16_t count, low, high, mid, offset;
+	int fd;
+
+	e = cache_find(identity, length);
+	if (e != NULL){
+		if (e->key_length > key_size){
+			return 0;
+		}
+		memcpy(key, e->key, e->key_length);
+		return e->key_length;
+	}
+
+	if ((fd = cfs_open(PSK_STORE_FILE, CFS_READ)) < 0){
+		return legacy_keys() ? 0 : -1;
+	}
+	if (cfs_read(fd, entry, PSK_STORE_HEADER_LENGTH) != PSK_STORE_HEADER_LENGTH
+			|| memcmp(entry, PSK_STORE_MAGIC, 4) != 0){
+		//a broken keystore is still a keystore, it must not open the door to the built-in key
+		cfs_close(fd);
+		return 0;
+	}
+	count = (entry[4]<<8) | entry[5];
+
+	//first index entry whose hash is not below the one we look for
+	hash = psk_store_hash(identity, length);
+	low = 0;
+	high = count;
+	while (low < high){
+		mid = low + (high-low)/2;
+		if (!read_entry(fd, mid, entry)){
+			break;
+		}
+		if (get_uint32(entry) < hash){
+			low = mid+1;
+		} else {
+			high = mid;
+		}
+	}
+	//identities with colliding hashes sit next to each other
+	for (; low < count && read_entry(fd, low, entry) && get_uint32(entry) == hash; low++){
+		offset = (entry[4]<<8) | entry[5];
+		if (entry[6] != length || !match_identity(fd, offset, identity, length)){
+			continue;
+		}
+		if (entry[7] > key_size || cfs_read(fd, key, entry[7]) != entry[7]){
+			break;
+		}
+		cfs_close(fd);
+		cache_store(identity, length, key, entry[7]);
+		return entry[7];
+	}
+	cfs_close(fd);
+	return 0;
+}
+
+void psk_store_flush(){
+	struct psk_cache_entry* e;
+	while ((e = list_pop(cache)) != NULL){
+		memb_free(&cache_memb, e);
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * psk-store.h
+ *
+ * Pre-shared keys of the DTLS and TLS handshakes, looked up by identity in
+ * a binary keystore on CFS. tools/psk-compile turns the <psk> section of
+ * config.xml into that file. The layout, all numbers big-endian:
+ *
+ *   "PSKS" | count (2) | count index entries | identities and keys
+ *
+ * An index entry is hash (4) | offset (2) | identity length (1) | key length (1),
+ * the entries are sorted by the FNV-1a hash of the identity and offset points
+ * at the identity, which is directly followed by its key. A lookup is a binary
+ * search over the index, so it reads O(log n) entries from flash. Recently used
+ * identities are kept in a small LRU cache in RAM.
+ */
+
+#ifndef PSK_STORE_H_
+#define PSK_STORE_H_
+
+#include "contiki.h"
+
+#ifdef PSK_STORE_CONF_FILE
+#define PSK_STORE_FILE PSK_STORE_CONF_FILE
+#else
+#define PSK_STORE_FILE "/psk.bin"
+#endif
+#ifdef PSK_STORE_CONF_LEGACY_FILE
+#define PSK_STORE_LEGACY_FILE PSK_STORE_CONF_LEGACY_FILE //keys in the config.xml a node was provisioned with
+#else
+#define PSK_STORE_LEGACY_FILE "/config.xml"
+#endif
+#ifdef PSK_STORE_CONF_CACHE_SIZE
+#define PSK_STORE_CACHE_SIZE PSK_STORE_CONF_CACHE_SIZE //identities kept in RAM
+#else
+#define PSK_STORE_CACHE_SIZE 2
+#endif
+#ifdef PSK_STORE_CONF_MAX_IDENTITY
+#define PSK_STORE_MAX_IDENTITY PSK_STORE_CONF_MAX_IDENTITY //longer identities are found but not cached
+#else
+#define PSK_STORE_MAX_IDENTITY 16
+#endif
+#ifdef PSK_STORE_CONF_MAX_KEY
+#define PSK_STORE_MAX_KEY PSK_STORE_CONF_MAX_KEY
+#else
+#define PSK_STORE_MAX_KEY 32
+#endif
+
+#define PSK_STORE_MAGIC "PSKS"
+#define PSK_STORE_HEADER_LENGTH 6
+#define PSK_STORE_ENTRY_LENGTH 8
+
+/*
+ * FNV-1a of the identity, the sort key of the index.
+ * tools/psk-compile.c has to use the same function.
+ */
+uint32_t psk_store_hash(const char* identity, uint8_t length);
+
+/*
+ * Copies the key of identity into key (at most key_size bytes).
+ * Returns the length of the key, 0 if the keystore does not know identity
+ * and -1 if there is no keystore, so the caller can fall back to its
+ * built-in identity and key. A node that still carries a <psk> section in
+ * PSK_STORE_LEGACY_FILE but no PSK_STORE_FILE, or a PSK_STORE_FILE that
+ * cannot be read, knows no identity at all: run tools/psk-compile on it.
+ */
+int psk_store_lookup(const char* identity, uint8_t length, char* key, uint8_t key_size);
+
+/*
+ * Empties the cache. Has to be called after PSK_STORE_FILE was rewritten.
+ */
+void psk_store_flush();
+
+#endif /* PSK_STORE_H_ */
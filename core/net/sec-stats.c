@@ -0,0 +1,76 @@
+/*
+ * sec-stats.c
+ *
+ * Counters of the DTLS and TLS engines, see sec-stats.h
+ */
+
+#include "sec-stats.h"
+#include "sys/energest.h"
+#include <string.h>
+
+#if SEC_STATS_ENABLED
+struct sec_stats sec_stats;
+TIMETABLE_NONSTATIC(sec_stats_timetable);
+rtimer_clock_t sec_stats_ccm_start;
+
+static unsigned long radio_time(){
+	return energest_type_time(ENERGEST_TYPE_TRANSMIT) + energest_type_time(ENERGEST_TYPE_LISTEN);
+}
+
+static void histogram_add(uint16_t* histogram, clock_time_t ticks){
+	unsigned long ms = (unsigned long)ticks * 1000 / CLOCK_SECOND;
+	uint8_t i;
+	for (i = 0; i < SEC_STATS_BUCKETS-1 && ms >= ((unsigned long)SEC_STATS_BUCKET_MS << i); i++);
+	histogram[i]++;
+}
+
+void sec_stats_reset(){
+	memset(&sec_stats, 0, sizeof(sec_stats));
+	timetable_clear(&sec_stats_timetable);
+}
+
+void sec_stats_handshake_start(struct sec_stats_session* s){
+	energest_flush();
+	s->handshake_start = clock_time();
+	s->waiting = 0;
+	s->flight = 0;
+	s->cpu = energest_type_time(ENERGEST_TYPE_CPU);
+	s->radio = radio_time();
+	s->retransmissions = 0;
+	TIMETABLE_TIMESTAMP(sec_stats_timetable, "handshake");
+}
+
+void sec_stats_handshake_done(struct sec_stats_session* s){
+	energest_flush();
+	sec_stats.handshakes++;
+	histogram_add(sec_stats.handshake_time, clock_time() - s->handshake_start);
+	sec_stats.handshake_cpu += energest_type_time(ENERGEST_TYPE_CPU) - s->cpu;
+	sec_stats.handshake_radio += radio_time() - s->radio;
+	TIMETABLE_TIMESTAMP(sec_stats_timetable, "done");
+}
+
+void sec_stats_flight_sent(struct sec_stats_session* s){
+	//more records before the answer belong to the same flight
+	if (!s->waiting && s->flight < SEC_STATS_FLIGHTS){
+		s->flight++;
+	}
+	s->flight_sent = clock_time();
+	s->waiting = 1;
+	TIMETABLE_TIMESTAMP(sec_stats_timetable, "flight");
+}
+
+void sec_stats_flight_answered(struct sec_stats_session* s){
+	if (!s->waiting){
+		return;
+	}
+	histogram_add(sec_stats.flight_time[s->flight - 1], clock_time() - s->flight_sent);
+	s->waiting = 0;
+	TIMETABLE_TIMESTAMP(sec_stats_timetable, "answer");
+}
+
+void sec_stats_retransmit(struct sec_stats_session* s){
+	s->retransmissions++;
+	sec_stats.retransmissions++;
+	TIMETABLE_TIMESTAMP(sec_stats_timetable, "retransmit");
+}
+#endif /* SEC_STATS_ENABLED */
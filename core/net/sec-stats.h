@@ -0,0 +1,122 @@
+/*
+ * sec-stats.h
+ *
+ * Where the DTLS and TLS engines spend time, radio and bytes. Off unless
+ * SEC_STATS_CONF_ENABLED is set (SEC_STATS=1 in the Makefile), the hooks
+ * compile to nothing then.
+ *
+ * Handshakes are measured per session from the first flight to the last
+ * Finished: wall clock time into a histogram, CPU and radio time from
+ * energest. Every flight is timed until the peer answers it, into one
+ * histogram per flight of the handshake, retransmissions are counted. On
+ * the record layer the cost of AES-CCM (rtimer ticks per byte), PRF
+ * invocations, bytes on the wire against application bytes and dropped
+ * records by reason are counted. The last few handshake events are kept
+ * with their rtimer time in sec_stats_timetable.
+ *
+ * All counters are totals over the sessions of both engines, a session only
+ * keeps what it needs while its handshake runs (struct sec_stats_session).
+ *
+ * The "secstats" shell command (apps/shell/shell-sec-stats.c) and the CoAP
+ * resources of apps/sec-stats print them.
+ */
+
+#ifndef SEC_STATS_H_
+#define SEC_STATS_H_
+
+#include "contiki.h"
+#include "sys/timetable.h"
+
+#ifdef SEC_STATS_CONF_ENABLED
+#define SEC_STATS_ENABLED SEC_STATS_CONF_ENABLED
+#else
+#define SEC_STATS_ENABLED 0
+#endif
+#ifdef SEC_STATS_CONF_TIMETABLE_SIZE
+#define SEC_STATS_TIMETABLE_SIZE SEC_STATS_CONF_TIMETABLE_SIZE
+#else
+#define SEC_STATS_TIMETABLE_SIZE 16
+#endif
+
+/* bucket i counts durations below SEC_STATS_BUCKET_MS << i ms, the last one everything above */
+#define SEC_STATS_BUCKETS 8
+#define SEC_STATS_BUCKET_MS 32
+/* flights a node sends in a handshake that get their own flight_time histogram, later ones count with the last */
+#define SEC_STATS_FLIGHTS 4
+
+enum sec_stats_drop {
+	SEC_STATS_DROP_REPLAY, //duplicate or outside the replay window
+	SEC_STATS_DROP_MAC, //CCM tag did not verify
+	SEC_STATS_DROP_UNEXPECTED, //record type not expected in this state
+	SEC_STATS_DROP_MALFORMED, //lengths do not add up
+	SEC_STATS_DROP_NO_SESSION, //no session for the sender
+	SEC_STATS_DROP_MAX
+};
+
+struct sec_stats {
+	uint16_t handshakes;
+	uint16_t handshakes_failed;
+	uint16_t handshake_time[SEC_STATS_BUCKETS]; //first flight to last Finished
+	uint16_t flight_time[SEC_STATS_FLIGHTS][SEC_STATS_BUCKETS]; //flight sent to answer received, by our flight number - 1
+	uint32_t handshake_cpu; //energest ticks
+	uint32_t handshake_radio; //energest ticks, transmit and listen
+	uint16_t retransmissions;
+	uint16_t prf_calls;
+	uint32_t ccm_bytes;
+	uint32_t ccm_ticks; //rtimer ticks spent in encrypt() and decrypt()
+	uint32_t wire_out; //datagrams / segments including record headers
+	uint32_t wire_in;
+	uint32_t app_out; //application data
+	uint32_t app_in;
+	uint16_t dropped[SEC_STATS_DROP_MAX];
+};
+
+/* kept with the engine's session state */
+struct sec_stats_session {
+	clock_time_t handshake_start;
+	clock_time_t flight_sent;
+	uint8_t waiting; //flight_sent is of a flight the peer hasn't answered yet
+	uint8_t flight; //flights sent in this handshake
+	unsigned long cpu; //energest at handshake_start
+	unsigned long radio;
+	uint8_t retransmissions;
+};
+
+extern struct sec_stats sec_stats;
+#define sec_stats_timetable_size SEC_STATS_TIMETABLE_SIZE
+TIMETABLE_DECLARE(sec_stats_timetable);
+
+void sec_stats_reset(void);
+void sec_stats_handshake_start(struct sec_stats_session* s);
+void sec_stats_handshake_done(struct sec_stats_session* s);
+void sec_stats_flight_sent(struct sec_stats_session* s);
+void sec_stats_flight_answered(struct sec_stats_session* s);
+void sec_stats_retransmit(struct sec_stats_session* s);
+
+#if SEC_STATS_ENABLED
+extern rtimer_clock_t sec_stats_ccm_start;
+#define SEC_STATS_ADD(field, n) (sec_stats.field += (n))
+#define SEC_STATS_DROP(reason) (sec_stats.dropped[reason]++)
+#define SEC_STATS_HANDSHAKE_START(s) sec_stats_handshake_start(s)
+#define SEC_STATS_HANDSHAKE_DONE(s) sec_stats_handshake_done(s)
+#define SEC_STATS_FLIGHT_SENT(s) sec_stats_flight_sent(s)
+#define SEC_STATS_FLIGHT_ANSWERED(s) sec_stats_flight_answered(s)
+#define SEC_STATS_RETRANSMIT(s) sec_stats_retransmit(s)
+#define SEC_STATS_CCM_START() (sec_stats_ccm_start = RTIMER_NOW())
+#define SEC_STATS_CCM_STOP(bytes) do { \
+	sec_stats.ccm_ticks += (rtimer_clock_t)(RTIMER_NOW() - sec_stats_ccm_start); \
+	sec_stats.ccm_bytes += (bytes); \
+} while(0)
+#else
+#define SEC_STATS_ADD(field, n)
+#define SEC_STATS_DROP(reason)
+#define SEC_STATS_HANDSHAKE_START(s)
+#define SEC_STATS_HANDSHAKE_DONE(s)
+#define SEC_STATS_FLIGHT_SENT(s)
+#define SEC_STATS_FLIGHT_ANSWERED(s)
+#define SEC_STATS_RETRANSMIT(s)
+#define SEC_STATS_CCM_START()
+#define SEC_STATS_CCM_STOP(bytes)
+#endif
+
+#endif /* SEC_STATS_H_ */
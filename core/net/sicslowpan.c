@@ -215,20 +215,15 @@ static u8_t uncomp_hdr_len;
  *  @{
  */
 
-static uint16_t sicslowpan_len;
-
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * The buffer the received packet is uncompressed into: uip_buf for a
+ * packet that came in one piece, the buffer of its reassembly slot for
+ * a fragment.
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
-
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+static uint8_t *sicslowpan_buf;
 
 /**
- * length of the ip packet already sent / received.
+ * length of the ip packet already sent.
  * It includes IP and transport headers.
  */
 static uint16_t processed_ip_len;
@@ -236,14 +231,29 @@ static uint16_t processed_ip_len;
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+/**
+ * A datagram being reassembled, identified by sender, tag and size as
+ * in RFC 4944. Fragments may come in any order, one bit per 8 byte
+ * block of the datagram tells which were received.
+ */
+struct reass_slot {
+  /** 0 while the slot is free */
+  uint16_t size;
+  uint16_t tag;
+  rimeaddr_t sender;
+  /** bytes of size received so far */
+  uint16_t received;
+  uint8_t bitmap[(UIP_BUFSIZE - UIP_LLH_LEN + 63) / 64];
+  /** started by the first fragment that arrives */
+  struct timer timer;
+  /** The IPv6 packet, at UIP_LLH_LEN as in uip_buf */
+  uip_buf_t buf;
+};
 
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+static struct reass_slot reass_slots[SICSLOWPAN_REASS_SLOTS];
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+struct sicslowpan_reass_stats sicslowpan_reass_stats[SICSLOWPAN_REASS_SLOTS];
+uint16_t sicslowpan_reass_dropped;
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -1385,6 +1395,10 @@ output(uip_lladdr_t *localdest)
     memcpy(rime_ptr + rime_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, rime_payload_len);
     packetbuf_set_datalen(rime_payload_len + rime_hdr_len);
+#if SICSLOWPAN_FRAG_BURST
+    /* More fragments follow, let the receiver keep its radio on */
+    packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 1);
+#endif /* SICSLOWPAN_FRAG_BURST */
     q = queuebuf_new_from_packetbuf();
     if(q == NULL) {
       PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
@@ -1414,9 +1428,12 @@ output(uip_lladdr_t *localdest)
       RIME_FRAG_PTR[RIME_FRAG_OFFSET] = processed_ip_len >> 3;
       
       /* Copy payload and send */
-      if(uip_len - processed_ip_len < rime_payload_len) {
+      if(uip_len - processed_ip_len <= rime_payload_len) {
         /* last fragment */
         rime_payload_len = uip_len - processed_ip_len;
+#if SICSLOWPAN_FRAG_BURST
+        packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 0);
+#endif /* SICSLOWPAN_FRAG_BURST */
       }
       PRINTFO("(offset %d, len %d, tag %d)\n",
              processed_ip_len >> 3, rime_payload_len, my_tag);
@@ -1456,18 +1473,89 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the slot of the datagram a fragment belongs to
+ *
+ * Slots whose datagram timed out are freed on the way. If the datagram
+ * is new it gets a free slot. Returns NULL if there is none or the
+ * datagram does not fit into uip_buf.
+ */
+static struct reass_slot *
+reass_lookup(uint16_t size, uint16_t tag, const rimeaddr_t *sender)
+{
+  struct reass_slot *s, *found = NULL, *free = NULL;
+  uint8_t i;
+
+  for(i = 0; i < SICSLOWPAN_REASS_SLOTS; i++) {
+    s = &reass_slots[i];
+    if(s->size != 0 && timer_expired(&s->timer)) {
+      PRINTFI("sicslowpan input: reassembly of tag %d timed out\n", s->tag);
+      sicslowpan_reass_stats[i].timeouts++;
+      s->size = 0;
+    }
+    if(s->size == 0) {
+      if(free == NULL) {
+        free = s;
+      }
+    } else if(s->size == size && s->tag == tag &&
+              rimeaddr_cmp(&s->sender, sender)) {
+      found = s;
+    }
+  }
+  if(found != NULL) {
+    return found;
+  }
+  if(free == NULL || size > UIP_BUFSIZE - UIP_LLH_LEN) {
+    sicslowpan_reass_dropped++;
+    return NULL;
+  }
+  free->size = size;
+  free->tag = tag;
+  rimeaddr_copy(&free->sender, sender);
+  free->received = 0;
+  memset(free->bitmap, 0, sizeof(free->bitmap));
+  timer_set(&free->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+          size, tag);
+  return free;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Note bytes start to end of the datagram as received
+ *
+ * Returns 0 if one of their 8 byte blocks had already been received,
+ * RFC 4944 has overlapping fragments discarded.
+ */
+static uint8_t
+reass_mark(struct reass_slot *s, uint16_t start, uint16_t end)
+{
+  uint16_t block;
+
+  for(block = start >> 3; block < (end + 7) >> 3; block++) {
+    if(s->bitmap[block >> 3] & (1 << (block & 7))) {
+      return 0;
+    }
+  }
+  for(block = start >> 3; block < (end + 7) >> 3; block++) {
+    s->bitmap[block >> 3] |= 1 << (block & 7);
+  }
+  s->received += end - start;
+  return 1;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
  *
- *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
- *  a non-fragmented packet we first uncompress the IP header. The
- *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
- *
- * \note We do not check for overlapping sicslowpan fragments
- * (it is a SHALL in the RFC 4944 and should never happen)
+ *  The 6lowpan packet is put in packetbuf by the MAC. A packet that is
+ *  not fragmented is uncompressed straight into uip_buf. A fragment goes
+ *  into the reassembly slot of its datagram (the IP header is
+ *  uncompressed there for a frag1), several datagrams can be put
+ *  together at once. When the last missing fragment arrives the packet
+ *  is copied to uip_buf and the IP layer is called.
  */
 static void
 input(void)
@@ -1480,7 +1568,8 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0;
+  /* the datagram the fragment belongs to */
+  struct reass_slot *slot = NULL;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1491,11 +1580,6 @@ input(void)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_len = 0;
-  }
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1511,8 +1595,6 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
-      first_fragment = 1;
       break;
     case SICSLOWPAN_DISPATCH_FRAGN:
       /*
@@ -1528,39 +1610,20 @@ input(void)
       rime_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
       break;
     default:
-    	processed_ip_len=0; //Added by /js and vp to work around contiki thinking that it needs to reassable whatever comes in...
       break;
   }
   before++;
-  if(processed_ip_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(frag_size > 0) {
+    slot = reass_lookup(frag_size, frag_tag,
+                        packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    if(slot == NULL) {
+      PRINTFI("sicslowpan input: no reassembly slot for tag %d\n", frag_tag);
       dumped++;
       return;
     }
+    sicslowpan_buf = slot->buf.u8;
   } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if(frag_size > 0) {
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
-    }
+    sicslowpan_buf = uip_buf;
   }
 
   if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1619,56 +1682,66 @@ input(void)
     return;
   }
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
-  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
-  
-  /* update processed_ip_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_len += uncomp_hdr_len;
+  if(slot != NULL) {
+    /* the bytes of the datagram this fragment carries */
+    uint16_t start = (uint16_t)frag_offset << 3;
+    uint16_t end = start + uncomp_hdr_len + rime_payload_len;
+
+    if(end > slot->size) {
+      PRINTFI("sicslowpan input: fragment beyond datagram size %d\n", slot->size);
+      sicslowpan_reass_stats[slot - reass_slots].oversized++;
+      return;
     }
-    processed_ip_len += rime_payload_len;
-  } else {
+    if(!reass_mark(slot, start, end)) {
+      PRINTFI("sicslowpan input: overlapping fragment at %d\n", start);
+      sicslowpan_reass_stats[slot - reass_slots].overlaps++;
+      return;
+    }
+  }
 #endif /* SICSLOWPAN_CONF_FRAG */
-    sicslowpan_len = rime_payload_len + uncomp_hdr_len;
+  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
+  
 #if SICSLOWPAN_CONF_FRAG
+  if(slot == NULL) {
+    /* not fragmented, the packet is in uip_buf already */
+    uip_len = rime_payload_len + uncomp_hdr_len;
+  } else if(slot->received == slot->size) {
+    /*
+     * The last missing fragment arrived, deliver the datagram to the
+     * IP stack. The slot is free before uIP gets to answer it.
+     */
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n", slot->size);
+    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, slot->size);
+    uip_len = slot->size;
+    slot->size = 0;
+    sicslowpan_reass_stats[slot - reass_slots].delivered++;
+  } else {
+    /* more fragments to come */
+    return;
   }
-
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  if(processed_ip_len == 0 || (processed_ip_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_len = 0;
+#else /* SICSLOWPAN_CONF_FRAG */
+  sicslowpan_len = rime_payload_len + uncomp_hdr_len;
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 #if DEBUG
-    {
-      uint8_t tmp;
-      PRINTF("after decompression: ");
-      for (tmp = 0; tmp < SICSLOWPAN_IP_BUF->len[1] + 40; tmp++) {
-	uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[tmp];
-	PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint8_t tmp;
+    PRINTF("after decompression: ");
+    for (tmp = 0; tmp < SICSLOWPAN_IP_BUF->len[1] + 40; tmp++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[tmp];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
 #if SICSLOWPAN_CONF_NEIGHBOR_INFO
-    neighbor_info_packet_received();
+  neighbor_info_packet_received();
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
 
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
-  }
-#endif /* SICSLOWPAN_CONF_FRAG */
+  tcpip_input();
 }
 /** @} */
 
@@ -319,6 +319,29 @@ struct sicslowpan_nh_compressor {
 };
 
 
+/**
+ * Counters of a reassembly slot, see SICSLOWPAN_REASS_SLOTS.
+ */
+struct sicslowpan_reass_stats {
+  /** datagrams completed and passed to uIP */
+  uint16_t delivered;
+  /** datagrams given up after SICSLOWPAN_REASS_MAXAGE seconds */
+  uint16_t timeouts;
+  /** fragments dropped as their bytes had been received before */
+  uint16_t overlaps;
+  /** fragments dropped as they reach beyond the datagram size */
+  uint16_t oversized;
+};
+
+/** Counters per reassembly slot, only kept with SICSLOWPAN_CONF_FRAG */
+extern struct sicslowpan_reass_stats sicslowpan_reass_stats[SICSLOWPAN_REASS_SLOTS];
+
+/**
+ * Fragments of new datagrams dropped as all slots were busy or the
+ * datagram would not fit into uip_buf
+ */
+extern uint16_t sicslowpan_reass_dropped;
+
 extern const struct network_driver sicslowpan_driver;
 
 extern const struct mac_driver *sicslowpan_mac;
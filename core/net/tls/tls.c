@@ -1,9 +1,11 @@
 #include "tls.h"
 #include "ntpd.h"
-#include "random.h"
-#include "cfs-coffee.h"
+#include "crypto_random.h"
+#include "psk-store.h"
 #include "hmac_sha2.h"
 #include "aes_ccm.h"
+#include "crypto_util.h"
+#include "sec-stats.h"
 #include "string.h"
 #include "lib/mmem.h"
 /***************************************************************/
@@ -21,13 +23,14 @@ static struct process* calling_process;
 static uint8_t num_connected = 0;
 static uint8_t max_connections = 0;
 static char* buffer;
-static char* record_buffer;
-static unsigned long message_length = 0;
-static unsigned long message_recv_length = 0;
+static char* record_buffer; //body of a handshake message split across records, in record_mmem
+static char message_header[4]; //handshake message header split across records
+static uint32 message_length = 0;
+static uint32 message_recv_length = 0;
 static uint16_t record_length = 0;
-static uint16_t recv_length = 0;
+static uint16_t recv_length = 0; //bytes of a record split across segments collected in record_in
+static char record_in[5+TLS_MAX_RECORD];
 static uint16_t overall_sent_data = 65535;
-static uint8_t state = READY; //internal state for message processing, one of READY, RECV_HEADER, RECV_MSG
 static uint8_t record_state = RECORD_READY;
 static uint8_t expected_message; //specifies which message should come next during the handshake
 static uint8_t send_error = 0;
@@ -35,53 +38,279 @@ static uint8_t handshake_done = 0;
 static uint8_t server = 0;
 static uint8_t alert_received = 0;
 static uint8_t wait_for_ack = 0;
-static uint8_t first_data = 1;
-static uint8_t first_data_sent = 1;
 static char server_random[32];
 static char client_random[32];
 static char handshake_hash[32];
 static sha256_ctx ctx;
-static char* premaster_secret;
 static char master_secret[48];
+static hmac_sha256_key master_key; //master_secret prepared for the PRF
 static char client_write_key[16];
 static char client_write_IV[4];
 static char server_write_key[16];
 static char server_write_IV[4];
+static AES_KEY client_write_schedule; //expanded once per handshake in generate_keying_material()
+static AES_KEY server_write_schedule;
 static uint64 seq_num;
 static char psk[33] = "abcdefghijklmnopqrstuvwxyz123456\0";
-static char* psk_identity = "thisisme";
+#define BUILTIN_PSK_IDENTITY "thisisme" //the only identity psk is good for when there is no keystore
+static char psk_identity[TLS_MAX_PSK_IDENTITY] = BUILTIN_PSK_IDENTITY; //ours as a client, the peer's as a server
 static uint16_t psk_identity_length = 8;
 static Connection* connection;
 static SecurityParameters* secParam;
 static struct mmem mmem;
-static struct mmem pskmmem;
-static struct mmem datammem;
 static struct mmem process_mmem;
 static struct mmem record_mmem;
+#if SEC_STATS_ENABLED
+static struct sec_stats_session handshake_stats; //of the one connection
+#endif
 static struct mmem conn_mmem;
 static struct mmem sec_mmem;
 static char internal_error[] = { (char) 0x15, (char) 0x03, (char) 0x03,
 		(char) 0x00, (char) 0x02, (char) 0x02, (char) 0x50 };
+static char session_id[TLS_SESSION_ID_LENGTH];
+static uint8_t session_id_len = 0;
+static uint8_t resumed = 0; //abbreviated handshake on a cached master_secret
+static uint16_t client_hello_length = 50;
+/*
+ * master secrets of finished handshakes. a server finds them by session id,
+ * a client by the address of the server it talked to
+ */
+static struct cached_session {
+	uip_ipaddr_t addr;
+	uint16_t port;
+	uint8_t id_len; //0 if the slot is free
+	char id[TLS_SESSION_ID_LENGTH];
+	char master_secret[48];
+	unsigned long stored;
+} session_cache[TLS_SESSION_CACHE];
+
 
 
+/*
+ * records wait in out_queue until the peer acknowledged them: out_unacked bytes from out_head
+ * are in flight and sent again as they are when uIP asks for a retransmission, whatever is
+ * queued behind them goes out in the next segment, up to uip_mss() at a time
+ */
+static char out_queue[TLS_OUTPUT_QUEUE];
+static uint16_t out_head = 0;
+static uint16_t out_length = 0;
+static uint16_t out_unacked = 0;
+
+static void out_queue_reset(){
+	out_head = 0;
+	out_length = 0;
+	out_unacked = 0;
+}
+
+static void out_queue_reverse(uint16_t from, uint16_t to){
+	char c;
+	while (from + 1 < to){
+		to--;
+		c = out_queue[from];
+		out_queue[from] = out_queue[to];
+		out_queue[to] = c;
+		from++;
+	}
+}
+
+/*
+ * length bytes of free space in one piece behind the queued ones, for a record to be sealed
+ * in place. if the free space is split by the end of out_queue the queued bytes are rotated
+ * to the start first. returns NULL if it doesn't fit
+ */
+static char* out_queue_reserve(uint16_t length){
+	uint16_t end = out_head + out_length;
+	if (length > TLS_OUTPUT_QUEUE - out_length){
+		return NULL;
+	}
+	if (end >= TLS_OUTPUT_QUEUE){
+		//the queued bytes wrap, all free space lies between them
+		return out_queue + end - TLS_OUTPUT_QUEUE;
+	}
+	if (TLS_OUTPUT_QUEUE - end < length){
+		//rotated left by out_head
+		out_queue_reverse(0, out_head);
+		out_queue_reverse(out_head, TLS_OUTPUT_QUEUE);
+		out_queue_reverse(0, TLS_OUTPUT_QUEUE);
+		out_head = 0;
+		end = out_length;
+	}
+	return out_queue + end;
+}
 
-static void tcp_send(char* toSend, int length){
-	uip_send(toSend, length);
+/*
+ * append the length bytes written behind the queued ones, they are sent from the next
+ * callback of the connection
+ */
+static void out_queue_push(uint16_t length){
+	out_length += length;
+	if (!handshake_done){
+		SEC_STATS_FLIGHT_SENT(&handshake_stats);
+	}
 	tcpip_poll_tcp(client_conn);
 }
 
+/*
+ * queue a record. returns 0 if it doesn't fit
+ */
+static uint8_t tcp_send(char* toSend, int length){
+	uint16_t tail = (out_head + out_length) % TLS_OUTPUT_QUEUE;
+	uint16_t first = TLS_OUTPUT_QUEUE - tail;
+	if (length > TLS_OUTPUT_QUEUE - out_length){
+		return 0;
+	}
+	if (first > length){
+		first = length;
+	}
+	memcpy(out_queue+tail, toSend, first);
+	memcpy(out_queue, toSend+first, length-first);
+	out_queue_push(length);
+	return 1;
+}
 
-static void error(uint8_t level, uint8_t type){
-	if (server) num_connected--;
-	state = READY;
+/*
+ * copy length bytes from the head of the queue into the outgoing segment
+ */
+static void out_queue_send(uint16_t length){
+	char* out = (char*)uip_appdata;
+	uint16_t first = TLS_OUTPUT_QUEUE - out_head;
+	if (first > length){
+		first = length;
+	}
+	memcpy(out, out_queue+out_head, first);
+	memcpy(out+first, out_queue, length-first);
+	SEC_STATS_ADD(wire_out, length);
+	uip_send(out, length);
+}
+
+/*
+ * called at the end of every callback of the connection, after any input was processed
+ */
+static void tcp_output(){
+	if (uip_rexmit()){
+		if (out_unacked > 0){
+			SEC_STATS_RETRANSMIT(&handshake_stats);
+			out_queue_send(out_unacked);
+		}
+		return;
+	}
+	if (out_unacked == 0 && out_length > 0 &&
+			(uip_poll() || uip_acked() || uip_newdata() || uip_connected())){
+		out_unacked = out_length < uip_mss() ? out_length : uip_mss();
+		out_queue_send(out_unacked);
+	}
+}
+
+/*
+ * forget what the peer acknowledged
+ */
+static void tcp_acked(){
+	if (uip_acked() && out_unacked > 0){
+		out_head = (out_head + out_unacked) % TLS_OUTPUT_QUEUE;
+		out_length -= out_unacked;
+		out_unacked = 0;
+	}
+}
+
+
+static uint8_t cache_expired(struct cached_session* c){
+	return c->id_len == 0 || clock_seconds() - c->stored > TLS_SESSION_LIFETIME;
+}
+
+static struct cached_session* cache_find(char* id, uint8_t id_len){
+	uint8_t i;
+	if (id_len == 0 || id_len > TLS_SESSION_ID_LENGTH){
+		return NULL;
+	}
+	for (i = 0; i < TLS_SESSION_CACHE; i++){
+		if (!cache_expired(&session_cache[i]) && session_cache[i].id_len == id_len &&
+				memcmp(session_cache[i].id, id, id_len) == 0){
+			return &session_cache[i];
+		}
+	}
+	return NULL;
+}
+
+static struct cached_session* cache_find_peer(uip_ipaddr_t* addr, uint16_t port){
+	uint8_t i;
+	for (i = 0; i < TLS_SESSION_CACHE; i++){
+		if (!cache_expired(&session_cache[i]) && session_cache[i].port == port &&
+				uip_ipaddr_cmp(&session_cache[i].addr, addr)){
+			return &session_cache[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * remember the session that just finished a full handshake, replacing the same peer or id,
+ * a free or expired slot, or else the oldest entry
+ */
+static void cache_store(){
+	struct cached_session* c;
+	uint8_t i;
+	if (session_id_len == 0){
+		return;
+	}
+	c = server ? cache_find(session_id, session_id_len) : cache_find_peer(&client_conn->ripaddr, client_conn->rport);
+	for (i = 0; c == NULL && i < TLS_SESSION_CACHE; i++){
+		if (cache_expired(&session_cache[i])){
+			c = &session_cache[i];
+		}
+	}
+	if (c == NULL){
+		c = &session_cache[0];
+		for (i = 1; i < TLS_SESSION_CACHE; i++){
+			if (session_cache[i].stored < c->stored){
+				c = &session_cache[i];
+			}
+		}
+	}
+	uip_ipaddr_copy(&c->addr, &client_conn->ripaddr);
+	c->port = client_conn->rport;
+	c->id_len = session_id_len;
+	memcpy(c->id, session_id, session_id_len);
+	memcpy(c->master_secret, master_secret, 48);
+	c->stored = clock_seconds();
+}
+
+static void cache_remove(){
+	struct cached_session* c = cache_find(session_id, session_id_len);
+	if (c != NULL){
+		crypto_wipe(c, sizeof(struct cached_session));
+	}
+}
+
+/*
+ * forget partially received records and handshake messages
+ */
+static void input_reset(){
+	if (record_state == RECORD_RECV_MSG){
+		mmem_free(&record_mmem);
+	}
 	record_state = RECORD_READY;
 	recv_length = 0;
 	message_recv_length = 0;
-	sha256_init(&ctx);
-	if(!first_data){
-		mmem_free(&datammem);
+}
+
+static void error(uint8_t level, uint8_t type){
+	if (type == 20){
+		SEC_STATS_DROP(SEC_STATS_DROP_MAC);
+	} else if (type == 10){
+		SEC_STATS_DROP(SEC_STATS_DROP_UNEXPECTED);
+	} else if (type == 50){
+		SEC_STATS_DROP(SEC_STATS_DROP_MALFORMED);
+	}
+	if (level == 2 && expected_message != APPLICATION_DATA){
+		SEC_STATS_ADD(handshakes_failed, 1);
+	}
+	if (level == 2){
+		//a session that ended in a fatal alert must not be resumed
+		cache_remove();
 	}
-	first_data =1;
+	if (server) num_connected--;
+	input_reset();
+	sha256_init(&ctx);
 	if (type == 80){
 		tcp_send(internal_error, 7);
 	}
@@ -99,11 +328,8 @@ static void error(uint8_t level, uint8_t type){
 }
 
 static void rehandshake(){
+	SEC_STATS_HANDSHAKE_START(&handshake_stats);
 	overall_sent_data = 0;
-	if(!first_data_sent)mmem_free(&mmem);
-	first_data_sent = 1;
-	if (!first_data)mmem_free(&datammem);
-	first_data = 1;
 	sha256_init(&ctx);
 	if (server){
 		if (mmem_alloc(&mmem,9)==0){
@@ -119,18 +345,19 @@ static void rehandshake(){
 	} else {
 
 		handshake_done = 0;
-		if (mmem_alloc(&mmem, 50)==0){
+		if (mmem_alloc(&mmem, 50+session_id_len)==0){
 			error(2,80);
 			return;
 		}
 		buffer = (char*)MMEM_PTR(&mmem);
-		create_client_hello(buffer);
+		//offer the current session, the server may renegotiate on the same master_secret
+		create_client_hello(buffer, session_id, session_id_len);
 		uint8_t i;
 		for (i = 0; i < 32; i++){
 			client_random[i] = buffer[11+i];
 		}
-		sha256_update(&ctx, (unsigned char*)buffer+5, 45);
-		tcp_send(buffer, 50);
+		sha256_update(&ctx, (unsigned char*)buffer+5, 45+session_id_len);
+		tcp_send(buffer, 50+session_id_len);
 		mmem_free(&mmem);
 		expected_message = SERVER_HELLO;
 	}
@@ -147,6 +374,7 @@ void tls_connect(uip_ipaddr_t *ripaddr, uint16_t port) {
 
 	server = 0;
 	expected_message = SERVER_HELLO;
+	SEC_STATS_HANDSHAKE_START(&handshake_stats);
 	Data data = { ripaddr, port };
 	if(mmem_alloc(&sec_mmem, sizeof(SecurityParameters))==0){
 		return;
@@ -156,6 +384,7 @@ void tls_connect(uip_ipaddr_t *ripaddr, uint16_t port) {
 		return;
 	}
 	connection = (Connection*)MMEM_PTR(&conn_mmem);
+	calling_process = PROCESS_CURRENT();
 	process_start(&tls_client_handshake_process, (void*) &data);
 }
 
@@ -184,10 +413,18 @@ int tls_write(Connection* conn, char* toWrite, int length){
 	if (expected_message != APPLICATION_DATA){
 		return -1;
 	}
+	if (length+21 > TLS_OUTPUT_QUEUE){
+		//would never fit, not even into an empty queue
+		return -1;
+	}
 	if(overall_sent_data<length){
 		rehandshake();
 		return 0;
 	}
+	if (length+21 > TLS_OUTPUT_QUEUE - out_length){
+		//the peer hasn't acknowledged enough yet, try again later
+		return 0;
+	}
 	overall_sent_data-=length;
 	client_conn = conn->conn;
 	uint8_t i;
@@ -203,25 +440,15 @@ int tls_write(Connection* conn, char* toWrite, int length){
 	char version[2] = {0x03, 0x03}; //version 3.3
 	memcpy(additional_data+9, version, 2);
 	memcpy(additional_data+11, &length, 2);
-	char* encrypted;
-	if (!first_data_sent){
-		mmem_free(&mmem);
-	}
-	first_data_sent = 0;
-	if(mmem_alloc(&mmem, length+21)==0){
-		error(2, 80);
-		return -1;
-	}
-	encrypted = (char*)MMEM_PTR(&mmem);
+	//sealed where it is sent from
+	char* encrypted = out_queue_reserve(length+21);
 	if (server) {
-		if(!encrypt(encrypted+13, server_write_key, nonce, toWrite, length, additional_data)) {
-			mmem_free(&mmem);
+		if(!encrypt(encrypted+13, &server_write_schedule, nonce, toWrite, length, additional_data)) {
 			return -1;
 		}
 	}
 	else {
-		if(!encrypt(encrypted+13, client_write_key, nonce, toWrite, length, additional_data)) {
-			mmem_free(&mmem);
+		if(!encrypt(encrypted+13, &client_write_schedule, nonce, toWrite, length, additional_data)) {
 			return -1;
 		}
 	}
@@ -240,8 +467,8 @@ int tls_write(Connection* conn, char* toWrite, int length){
 	encrypted[11] = (char) ((seq_num >> 8) & 0xFF);
 	encrypted[12] = (char) (seq_num & 0xFF);
 	seq_num++;
-	tcp_send(encrypted, length+21);
-	mmem_free(&mmem);
+	SEC_STATS_ADD(app_out, length);
+	out_queue_push(length+21);
 	return 1;
 }
 
@@ -255,21 +482,20 @@ void tls_close(Connection* conn){
 /*                      Helper functions                       */
 /***************************************************************/
 
-static void generate_premaster_secret(char* ps, char* localpsk){
-	uint16_t n = strlen(psk);
-	uint8_t i;
-	premaster_secret[0]=(char)((n>>8) & 0xFF);
-	premaster_secret[1]=(char)(n & 0xFF);
+static void generate_premaster_secret(char* ps, char* localpsk, uint16_t n){
+	uint16_t i;
+	ps[0]=(char)((n>>8) & 0xFF);
+	ps[1]=(char)(n & 0xFF);
 	for (i = 0; i < n; i++){
-		premaster_secret[2+i] = 0x00;
-		premaster_secret[n+4+i] = localpsk[i];
+		ps[2+i] = 0x00;
+		ps[n+4+i] = localpsk[i];
 	}
-	premaster_secret[n+2]=(char)((n>>8) & 0xFF);
-	premaster_secret[n+3]=(char)(n & 0xFF);
+	ps[n+2]=(char)((n>>8) & 0xFF);
+	ps[n+3]=(char)(n & 0xFF);
 
 }
 
-static void generate_master_secret(){
+static void generate_master_secret(char* premaster_secret, uint16_t premaster_length){
 	/*
 	 * calculate master secret
 	 * RFC5246 section 8.1
@@ -279,7 +505,7 @@ static void generate_master_secret(){
 	char seed[64];
 	memcpy(seed, client_random, 32);
 	memcpy(seed+32, server_random, 32);
-	PRF(master_secret, premaster_secret,2*strlen(psk)+4, "master secret", seed, 64, 48);
+	PRF(master_secret, premaster_secret, premaster_length, "master secret", seed, 64, 48);
 }
 
 static void generate_keying_material(){
@@ -288,11 +514,37 @@ static void generate_keying_material(){
 	memcpy(seed, server_random, 32);
 	memcpy(seed+32, client_random, 32);
 	char out[40];
-	PRF(out, master_secret, 48, "key expansion", seed, 64, 40);
+	//the Finished messages are derived under the same key, prepare it once for all of them
+	PRF_key(&master_key, master_secret, 48);
+	PRF_keyed(out, &master_key, "key expansion", seed, 64, 40);
 	memcpy(client_write_key, out, 16);
 	memcpy(server_write_key, out+16, 16);
 	memcpy(client_write_IV, out+32, 4);
 	memcpy(server_write_IV, out+36, 4);
+	AES_set_encrypt_key((unsigned char*)client_write_key, &client_write_schedule);
+	AES_set_encrypt_key((unsigned char*)server_write_key, &server_write_schedule);
+	crypto_wipe(out, sizeof(out));
+}
+
+/*
+ * once both Finished are through nothing derives from the master secret
+ * any more, a resumption takes it from session_cache
+ */
+static void handshake_wipe(){
+	crypto_wipe(master_secret, sizeof(master_secret));
+	crypto_wipe(&master_key, sizeof(master_key));
+	crypto_wipe(handshake_hash, sizeof(handshake_hash));
+}
+
+/*
+ * the connection is gone, so are its keys
+ */
+static void keys_wipe(){
+	handshake_wipe();
+	crypto_wipe(client_write_key, sizeof(client_write_key));
+	crypto_wipe(server_write_key, sizeof(server_write_key));
+	crypto_wipe(&client_write_schedule, sizeof(client_write_schedule));
+	crypto_wipe(&server_write_schedule, sizeof(server_write_schedule));
 }
 
 static uint8_t check_finished_correctness(char* finished){
@@ -302,112 +554,44 @@ static uint8_t check_finished_correctness(char* finished){
 		return 0;
 	}
 	char out[12];
-	if (server){
-		PRF(out, master_secret, 48, "client finished", handshake_hash, 32, 12);
-		if (strncmp(finished+4,out,12)!=0){
-			return 0;
-		}
-	} else {
-		PRF(out, master_secret, 48, "server finished", handshake_hash, 32, 12);
-		if (strncmp(finished+4, out, 12)!=0){
+	uint8_t ok;
+	PRF_keyed(out, &master_key, server ? "client finished" : "server finished", handshake_hash, 32, 12);
+	ok = crypto_equal(finished+4, out, 12);
+	crypto_wipe(out, sizeof(out));
+	return ok;
+}
+
+/*
+ * key of psk_identity from the keystore, the built-in psk for the built-in identity if there
+ * is no keystore. returns the length of the key, 0 if psk_identity is unknown
+ */
+static int lookup_psk(char* key){
+	int n = psk_store_lookup(psk_identity, psk_identity_length, key, PSK_STORE_MAX_KEY);
+	if (n < 0){
+		if (psk_identity_length != strlen(BUILTIN_PSK_IDENTITY) ||
+				memcmp(psk_identity, BUILTIN_PSK_IDENTITY, psk_identity_length) != 0){
 			return 0;
 		}
+		n = strlen(psk);
+		memcpy(key, psk, n);
 	}
-	return 1;
+	return n;
 }
 
-static int findpsk(int fd, char* psk_id){
-	uint8_t pos = 0;
-	uint8_t used = 0;
-	char buf[4];
-	cfs_seek(fd,pos,CFS_SEEK_SET);
-	cfs_read(fd,buf,1);
-	while(1){
-		while(buf[0]!='<'){
-			if(buf[0]=='\0') {
-				if(used){
-					return 0;
-				}
-				return -1;
-			}
-			pos++;
-			cfs_seek(fd,pos,CFS_SEEK_SET);
-			cfs_read(fd,buf,1);
-		}
-		pos++;
-		cfs_seek(fd,pos,CFS_SEEK_SET);
-		cfs_read(fd,buf,4);
-		if(!strcmp(buf,"psk>")){
-			used = 1;
-			pos+=4; //jump over 'psk>'
-			cfs_seek(fd,pos,CFS_SEEK_SET);
-			cfs_read(fd, buf, 1);
-			while(1){
-				while(buf[0]!='<'){
-					if(buf[0]=='\0') {
-						if(used){
-							return 0;
-						}
-						return -1;
-					}
-					pos++;
-					cfs_seek(fd,pos,CFS_SEEK_SET);
-					cfs_read(fd, buf, 1);
-				}
-				pos++;
-				cfs_seek(fd,pos,CFS_SEEK_SET);
-				cfs_read(fd,buf,4);
-				if(!strcmp(buf,"psk-")){
-					pos+=13;
-					uint8_t id_pos = 0;
-					uint8_t found = 1;
-					cfs_seek(fd,pos,CFS_SEEK_SET);
-					cfs_read(fd,buf,1);
-					while(buf[0]!='<'){
-						if(buf[0]!=psk_id[id_pos]){
-							found = 0;
-							break;
-						}
-						pos++;
-						id_pos++;
-						cfs_seek(fd,pos,CFS_SEEK_SET);
-						cfs_read(fd,buf,1);
-					}
-					if(found){
-						while(1){
-							do{
-								pos++;
-								cfs_seek(fd,pos,CFS_SEEK_SET);
-								cfs_read(fd,buf,1);
-							}while(buf[0]!='<');
-							pos++;
-							cfs_seek(fd,pos,CFS_SEEK_SET);
-							cfs_read(fd,buf,4);
-							if(!strcmp(buf,"key>")){
-								pos+=4;
-								uint8_t key_start = pos;
-								cfs_seek(fd,pos,CFS_SEEK_SET);
-								cfs_read(fd,buf,1);
-								while(buf[0]!='<'){
-									pos++;
-									cfs_seek(fd,pos,CFS_SEEK_SET);
-									cfs_read(fd,buf,1);
-								}
-								if(mmem_alloc(&pskmmem,pos-key_start)==0){
-									return -2;
-								}
-								char* p = (char*)MMEM_PTR(&pskmmem);
-								cfs_seek(fd,key_start,CFS_SEEK_SET);
-								cfs_read(fd,p,pos-key_start);
-								return pos-key_start;
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-	return -1;
+static void server_connected(){
+	handshake_done = 1;
+	secParam->client_write_IV = client_write_IV;
+	secParam->server_write_IV = server_write_IV;
+	secParam->client_write_key = client_write_key;
+	secParam->server_write_key = server_write_key;
+	connection->securityParameters = secParam;
+	connection->conn = client_conn;
+	tls_event = process_alloc_event();
+	tls_flags = TLS_CONNECTED;
+	process_post(calling_process, tls_event, (void*)connection);
+	expected_message = APPLICATION_DATA;
+	handshake_wipe();
+	SEC_STATS_HANDSHAKE_DONE(&handshake_stats);
 }
 
 static void response_to_client_messages(uint8_t result) {
@@ -415,67 +599,96 @@ static void response_to_client_messages(uint8_t result) {
 		char finished_clear[16];
 		char nonce[12];
 		char additional_data[13];
-		int fd;
-		char* localpsk = psk;
+		char localpsk[PSK_STORE_MAX_KEY];
+		char premaster_secret[2*PSK_STORE_MAX_KEY+4]; //RFC 4279 section 2
+		int psk_length;
 		switch(expected_message){
 		case CLIENT_HELLO:
-
-			if(mmem_alloc(&mmem, 56)==0){
+			if (resumed){
+				//abbreviated handshake: ServerHello, ChangeCipherSpec and Finished go out together
+				if(mmem_alloc(&mmem, 47+session_id_len+6+37)==0){
+					error(2, 80);
+					return;
+				}
+				buffer = (char*)MMEM_PTR(&mmem);
+				create_server_hello(buffer, session_id, session_id_len, 0);
+				memcpy(server_random,buffer+11,32);
+				sha256_update(&ctx, (unsigned char*)buffer+5, 42+session_id_len);
+				generate_keying_material();
+				create_change_cipher_spec(buffer, 47+session_id_len);
+				//the server's Finished covers ClientHello and ServerHello
+				sha256_ctx ctxCopy = ctx;
+				sha256_final(&ctxCopy, (unsigned char*)handshake_hash);
+				finished_clear[0] = 0x14; //msg_type = finished
+				finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
+				PRF_keyed(finished_clear+4, &master_key, "server finished", handshake_hash, 32, 12);
+				seq_num = 0;
+				memcpy(nonce, server_write_IV, 4);
+				memcpy(nonce+4, &seq_num, 8);
+				memcpy(additional_data, &seq_num, 8);
+				char type = 0x16; //handshake
+				memcpy(additional_data+8, &type ,1);
+				char version[2] = {0x03, 0x03}; //version 3.3
+				memcpy(additional_data+9, version, 2);
+				uint16_t length = 16; //length of the finished record
+				memcpy(additional_data+11, &length, 2);
+				if(!encrypt(buffer+47+session_id_len+6+13, &server_write_schedule, nonce, finished_clear, 16, additional_data)){
+					mmem_free(&mmem);
+					error(2, 80);
+					return;
+				}
+				create_finished(buffer, 47+session_id_len+6, seq_num, "");
+				sha256_update(&ctx, (unsigned char*)finished_clear, 16);
+				tcp_send(buffer, 47+session_id_len+6+37);
+				mmem_free(&mmem);
+				seq_num++;
+				expected_message = CHANGE_CIPHER_SPEC;
+				break;
+			}
+			//a fresh id under which the session can be resumed later
+			crypto_random(session_id, TLS_SESSION_ID_LENGTH);
+			session_id_len = TLS_SESSION_ID_LENGTH;
+			if(mmem_alloc(&mmem, 56+session_id_len)==0){
 				error(2, 80);
 				return;
 			}
 			buffer = (char*)MMEM_PTR(&mmem);
-			create_server_hello(buffer);
+			create_server_hello(buffer, session_id, session_id_len, 1);
 			//save server_random
 			memcpy(server_random,buffer+11,32);
 			//update the hash
-			sha256_update(&ctx, (unsigned char*)buffer+5, 42);
-			sha256_update(&ctx, (unsigned char*)buffer+52, 4);
+			sha256_update(&ctx, (unsigned char*)buffer+5, 42+session_id_len);
+			sha256_update(&ctx, (unsigned char*)buffer+52+session_id_len, 4);
 			expected_message = CLIENT_KEY_EXCHANGE;
-			uip_send(buffer, 56);
+			tcp_send(buffer, 56+session_id_len);
 			mmem_free(&mmem);
 			break;
 		case CLIENT_KEY_EXCHANGE:
 			//lookup PSK based on the psk_identity
-			if ((fd=cfs_open("/config.xml",CFS_READ))<0){
-				//no config found, using default (hardcoded) values for psk
-				mmem_alloc(&pskmmem, 1); //dummy
-			} else {
-				int found = findpsk(fd, psk_identity );
-				if(found == -1){
-					//no psk list found, use default
-					mmem_alloc(&pskmmem, 1);
-				} else if(found == 0){
-					//not a known psk_identity - deny access and send unknown_psk_identity alert
-					error(2,115);
-					return;
-				} else if(found == -2){
-					//run out of memory - internal error
-					error(2,80);
-					return;
-				} else {
-					//psk is stored at pskmmem
-					localpsk = (char*)MMEM_PTR(&pskmmem);
-				}
-			}
-			//generate premaster secret
-
-			if(mmem_alloc(&mmem, 2*strlen(localpsk)+4)==0){
-				error(2, 80);
+			psk_length = lookup_psk(localpsk);
+			if (psk_length == 0){
+				//not a known psk_identity - deny access and send unknown_psk_identity alert
+				error(2,115);
 				return;
 			}
-			premaster_secret = (char*)MMEM_PTR(&mmem);
-			generate_premaster_secret(premaster_secret, localpsk);
-			generate_master_secret();
-			mmem_free(&pskmmem);
-			mmem_free(&mmem);
+			generate_premaster_secret(premaster_secret, localpsk, psk_length);
+			generate_master_secret(premaster_secret, 2*psk_length+4);
+			crypto_wipe(localpsk, sizeof(localpsk));
+			crypto_wipe(premaster_secret, sizeof(premaster_secret));
 			expected_message = CHANGE_CIPHER_SPEC;
 			break;
 		case CHANGE_CIPHER_SPEC:
-			generate_keying_material();
+			if (!resumed){
+				generate_keying_material();
+			}
 			expected_message = FINISHED;
 			break;
 		case FINISHED:
+			if (resumed){
+				//our ChangeCipherSpec and Finished went out with the ServerHello
+				server_connected();
+				break;
+			}
 			//send ChangeCipherSpec and Finished
 			if(mmem_alloc(&mmem, 6+37)==0){
 					error(2, 80);
@@ -487,7 +700,7 @@ static void response_to_client_messages(uint8_t result) {
 			sha256_final(&ctx, (unsigned char*)handshake_hash);
 			finished_clear[0] = 0x14; //msg_type = finished
 			finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
-			PRF(finished_clear+4, master_secret, 48, "server finished", handshake_hash, 32, 12);
+			PRF_keyed(finished_clear+4, &master_key, "server finished", handshake_hash, 32, 12);
 			seq_num = 0;
 			memcpy(nonce, server_write_IV, 4);
 			memcpy(nonce+4, &seq_num, 8);
@@ -498,7 +711,7 @@ static void response_to_client_messages(uint8_t result) {
 			memcpy(additional_data+9, version, 2);
 			uint16_t length = 16; //length of the finished record
 			memcpy(additional_data+11, &length, 2);
-			if(!encrypt(buffer+6+13, server_write_key, nonce, finished_clear, 16, additional_data)){
+			if(!encrypt(buffer+6+13, &server_write_schedule, nonce, finished_clear, 16, additional_data)){
 
 				mmem_free(&mmem);
 				error(2, 80);
@@ -509,6 +722,7 @@ static void response_to_client_messages(uint8_t result) {
 			tcp_send(buffer, 6+37);
 			mmem_free(&mmem);
 			seq_num++;
+			cache_store();
 			break;
 		}
 	} else {
@@ -521,21 +735,31 @@ static void response_to_server_messages(uint8_t result) {
 		char finished_clear[16];
 		char nonce[12];
 		char additional_data[13];
+		char localpsk[PSK_STORE_MAX_KEY];
+		char premaster_secret[2*PSK_STORE_MAX_KEY+4]; //RFC 4279 section 2
+		int psk_length;
 		switch(expected_message){
 		case SERVER_HELLO:
+			if (resumed){
+				//the server accepted our session id, the cached master_secret is all we need
+				generate_keying_material();
+				expected_message = CHANGE_CIPHER_SPEC;
+				break;
+			}
 			/*
 			 * generate premaster secret
 			 * RFC4279 section 2
 			 */
-			if(mmem_alloc(&mmem, 2*strlen(psk)+4)==0){
+			psk_length = lookup_psk(localpsk);
+			if (psk_length == 0){
+				//the keystore has no key for our own identity
 				error(2, 80);
 				return;
 			}
-			premaster_secret = (char*)MMEM_PTR(&mmem);
-			generate_premaster_secret(premaster_secret, psk);
-			generate_master_secret();
-
-			mmem_free(&mmem);
+			generate_premaster_secret(premaster_secret, localpsk, psk_length);
+			generate_master_secret(premaster_secret, 2*psk_length+4);
+			crypto_wipe(localpsk, sizeof(localpsk));
+			crypto_wipe(premaster_secret, sizeof(premaster_secret));
 			expected_message = SERVER_HELLO_DONE;
 			break;
 		case SERVER_HELLO_DONE:
@@ -551,6 +775,8 @@ static void response_to_server_messages(uint8_t result) {
 			buffer = (char*)MMEM_PTR(&mmem);
 			create_client_key_exchange(buffer, psk_identity, psk_identity_length);
 			sha256_update(&ctx, (unsigned char*)buffer+5, psk_identity_length+6);
+			//generate keying material, this also prepares master_secret for the Finished
+			generate_keying_material();
 			create_change_cipher_spec(buffer, psk_identity_length+11);
 			//copy a sha256 context so that it can be used later for verifying the hash received from the server
 			sha256_ctx ctxCopy = ctx;
@@ -558,10 +784,7 @@ static void response_to_server_messages(uint8_t result) {
 			sha256_final(&ctx, (unsigned char*)handshake_hash);
 			finished_clear[0] = 0x14; //msg_type = finished
 			finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
-			PRF(finished_clear+4, master_secret, 48, "client finished", handshake_hash, 32, 12);
-
-			//generate keying material
-			generate_keying_material();
+			PRF_keyed(finished_clear+4, &master_key, "client finished", handshake_hash, 32, 12);
 
 			seq_num = 0;
 			memcpy(nonce, client_write_IV, 4);
@@ -574,7 +797,7 @@ static void response_to_server_messages(uint8_t result) {
 			uint16_t length = 16; //length of the finished record
 			memcpy(additional_data+11, &length, 2);
 
-			if(!encrypt(buffer+psk_identity_length+6+11+13, client_write_key, nonce, finished_clear, 16, additional_data)){
+			if(!encrypt(buffer+psk_identity_length+6+11+13, &client_write_schedule, nonce, finished_clear, 16, additional_data)){
 				mmem_free(&mmem);
 				error(2,80);
 				return;
@@ -594,6 +817,40 @@ static void response_to_server_messages(uint8_t result) {
 			expected_message = FINISHED;
 			break;
 		case FINISHED:
+			if (resumed){
+				//send ChangeCipherSpec and our Finished, which covers the server's as well
+				if(mmem_alloc(&mmem, 6+37)==0){
+					error(2, 80);
+					return;
+				}
+				buffer = (char*)MMEM_PTR(&mmem);
+				create_change_cipher_spec(buffer, 0);
+				sha256_final(&ctx, (unsigned char*)handshake_hash);
+				finished_clear[0] = 0x14; //msg_type = finished
+				finished_clear[1] = 0x00; finished_clear[2] = 0x00; finished_clear[3] = 0x0c; //length
+				PRF_keyed(finished_clear+4, &master_key, "client finished", handshake_hash, 32, 12);
+				seq_num = 0;
+				memcpy(nonce, client_write_IV, 4);
+				memcpy(nonce+4, &seq_num, 8);
+				memcpy(additional_data, &seq_num, 8);
+				char type = 0x16; //handshake
+				memcpy(additional_data+8, &type ,1);
+				char version[2] = {0x03, 0x03}; //version 3.3
+				memcpy(additional_data+9, version, 2);
+				uint16_t length = 16; //length of the finished record
+				memcpy(additional_data+11, &length, 2);
+				if(!encrypt(buffer+6+13, &client_write_schedule, nonce, finished_clear, 16, additional_data)){
+					mmem_free(&mmem);
+					error(2,80);
+					return;
+				}
+				create_finished(buffer, 6, seq_num, "");
+				tcp_send(buffer, 6+37);
+				mmem_free(&mmem);
+				seq_num++;
+			} else {
+				cache_store();
+			}
 			handshake_done = 1;
 
 			secParam->client_write_IV = client_write_IV;
@@ -607,6 +864,8 @@ static void response_to_server_messages(uint8_t result) {
 			tls_flags = TLS_CONNECTED;
 			process_post(PROCESS_BROADCAST, tls_event, (void*)connection);
 			expected_message = APPLICATION_DATA;
+			handshake_wipe();
+			SEC_STATS_HANDSHAKE_DONE(&handshake_stats);
 
 			break;
 		}
@@ -630,7 +889,10 @@ uint8_t process_server_messages(char* buffer, uint16_t msg_length, uint8_t offse
 			return 47;
 		}
 		position += 32; //skip random for now
-		position += (buffer[position] + 1); //skip session id since we don't support it anyway (buffer[position] should always be 0)
+		if ((unsigned char)buffer[position] > 32){
+			return 47;
+		}
+		position += ((unsigned char)buffer[position] + 1); //session id is looked at once the message is accepted
 
 		if (buffer[position++] != (char)((TLS_PSK_WITH_AES_128_CCM_8 >> 8) & 0xFF)){ //server has to return TLS_PSK_WITH_AES_128_CCM_8
 			return 40;
@@ -669,7 +931,10 @@ uint8_t process_client_messages(char* buffer, uint16_t msg_length, uint8_t offse
 		if (buffer[position++] != 0x03) //TLS version has to be 1.2
 			return 47;
 		position += 32; //skip random for now
-		position += (buffer[position] + 1); //skip session id since we don't support it anyway
+		if ((unsigned char)buffer[position] > 32){
+			return 47;
+		}
+		position += ((unsigned char)buffer[position] + 1); //session id is looked at once the message is accepted
 		uint16_t length = (buffer[position] << 8) + (buffer[position + 1]);
 		position += 2;
 
@@ -741,33 +1006,16 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 		uint16_t length = msg_length-16; //length of the data
 		memcpy(additional_data+11, &length, 2);
 
-		if (!first_data)mmem_free(&datammem);
-		first_data = 0;
-		if(mmem_alloc(&datammem, msg_length - 16)==0){
-			error(2, 80);
+		//decrypted right where the ciphertext is, so the application has to look at it before we return
+		tls_appdata = input+offset+8;
+		if(!decrypt(tls_appdata, server ? &client_write_schedule : &server_write_schedule, nonce, tls_appdata, msg_length-8, additional_data)){
+			error(2,20);
 			return 0;
 		}
-		tls_appdata = (char*)MMEM_PTR(&datammem);
-
-		if (server) {
-			if(!decrypt(tls_appdata, client_write_key, nonce, input+offset+8, msg_length-8, additional_data)){
-
-				mmem_free(&datammem);
-				error(2,20);
-				return 0;
-			}
-		}
-		else {
-			if(!decrypt(tls_appdata, server_write_key, nonce, input+offset+8, msg_length-8, additional_data)){
-
-				mmem_free(&datammem);
-				error(2,20);
-				return 0;
-			}
-		}
 		tls_applen = msg_length - 16;
+		SEC_STATS_ADD(app_in, tls_applen);
 		tls_flags = TLS_NEWDATA;
-		process_post(calling_process, tls_event, NULL);
+		process_post_synch(calling_process, tls_event, NULL);
 		return 1;
 	}
 	if (server) {
@@ -776,9 +1024,20 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 		if(expected_message == CLIENT_HELLO && result == 1){
 			//save client_random
 			memcpy(client_random, input+offset+2, 32);
+			//resume if the client offers a session we still know
+			struct cached_session* c = cache_find(input+offset+35, (uint8_t)input[offset+34]);
+			resumed = c != NULL;
+			if (resumed){
+				session_id_len = c->id_len;
+				memcpy(session_id, c->id, c->id_len);
+				memcpy(master_secret, c->master_secret, 48);
+			}
 		}
 		if(expected_message == CLIENT_KEY_EXCHANGE && result == 1){
 			psk_identity_length = (input[offset]<<8)+input[offset+1];
+			if (psk_identity_length > TLS_MAX_PSK_IDENTITY){
+				psk_identity_length = 0; //cannot be ours, the keystore lookup rejects it
+			}
 			memcpy(psk_identity, input+offset+2, psk_identity_length);
 		}
 
@@ -794,14 +1053,8 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 			memcpy(additional_data+9, version, 2);
 			uint16_t length = 16; //length of the finished record
 			memcpy(additional_data+11, &length, 2);
-			char* finished_clear;
-			if(mmem_alloc(&mmem, msg_length - 16)==0){
-				error(2, 80);
-				return 0;
-			}
-			finished_clear = (char*)MMEM_PTR(&mmem);
-			if(!decrypt(finished_clear, client_write_key, nonce, input+offset+8, msg_length-8, additional_data)){
-				mmem_free(&mmem);
+			char* finished_clear = input+offset+8;
+			if(!decrypt(finished_clear, &client_write_schedule, nonce, finished_clear, msg_length-8, additional_data)){
 				error(2,20);
 				return 0;
 			}
@@ -810,11 +1063,8 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 
 			if (check_finished_correctness(finished_clear)!=1){
 				error(2,40);
-
-				mmem_free(&mmem);
 				return 0;
 			}
-			mmem_free(&mmem);
 			sha256_update(&ctx, (unsigned char*)finished_clear, 16);
 		}
 		response_to_client_messages(result);
@@ -826,6 +1076,14 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 		if(expected_message == SERVER_HELLO && result == 1){
 			//save server_random
 			memcpy(server_random, input+offset+2, 32);
+			//the server echoes the id we offered if it resumes, otherwise it hands out a new one
+			uint8_t id_len = (uint8_t)input[offset+34];
+			resumed = id_len != 0 && id_len == session_id_len &&
+					memcmp(session_id, input+offset+35, id_len) == 0;
+			if (!resumed){
+				session_id_len = id_len <= TLS_SESSION_ID_LENGTH ? id_len : 0;
+				memcpy(session_id, input+offset+35, session_id_len);
+			}
 		}
 		if (result == 1 && expected_message == FINISHED){
 			char nonce[12];
@@ -839,29 +1097,24 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 			memcpy(additional_data+9, version, 2);
 			uint16_t length = 16; //length of the finished record
 			memcpy(additional_data+11, &length, 2);
-			char* finished_clear;
-
-			if(mmem_alloc(&mmem, msg_length - 16)==0){
-				error(2, 80);
-				return 0;
-			}
-			finished_clear = (char*)MMEM_PTR(&mmem);
-
-			if(!decrypt(finished_clear, server_write_key, nonce, input+offset+8, msg_length-8, additional_data)){
-
-				mmem_free(&mmem);
+			char* finished_clear = input+offset+8;
+			if(!decrypt(finished_clear, &server_write_schedule, nonce, finished_clear, msg_length-8, additional_data)){
 				error(2,20);
 				return 0;
 			}
+			if (resumed){
+				//in an abbreviated handshake the server's Finished comes first and covers the hellos only
+				sha256_ctx ctxCopy = ctx;
+				sha256_final(&ctxCopy, (unsigned char*)handshake_hash);
+			}
 
 			if (check_finished_correctness(finished_clear)!=1){
 				error(2,40);
-
-				mmem_free(&mmem);
 				return 0;
 			}
-
-			mmem_free(&mmem);
+			if (resumed){
+				sha256_update(&ctx, (unsigned char*)finished_clear, 16);
+			}
 		}
 		response_to_server_messages(result);
 		if (result!=1)return 0;
@@ -872,8 +1125,32 @@ static int act_on_full_message(char* input, int msg_length, int offset){
 /***************************************************************/
 /*                      Handler functions                      */
 /***************************************************************/
+/*
+ * the 4 byte header of a handshake message is complete, make room for its body
+ */
+static uint8_t message_start(){
+	message_length = ((uint32)(unsigned char)message_header[1] << 16) +
+			((uint32)(unsigned char)message_header[2] << 8) + (unsigned char)message_header[3];
+	if (message_length > TLS_MAX_HANDSHAKE_LENGTH){
+		error(2, 50);
+		return 0;
+	}
+	if(mmem_alloc(&record_mmem, message_length)==0){
+		error(2, 80);
+		return 0;
+	}
+	record_buffer = (char*)MMEM_PTR(&record_mmem);
+	message_recv_length = 0;
+	record_state = RECORD_RECV_MSG;
+	return 1;
+}
+
+/*
+ * hand the handshake messages of one record to act_on_full_message(), one that continues
+ * in the next record is collected in record_mmem. returns 1 if all good
+ */
 static int process_record(char* record, int record_length){
-	uint8_t i,j;
+	uint32 n;
 	if (alert_received){
 		alert_received = 0;
 		if (record[1] == 0){
@@ -881,10 +1158,7 @@ static int process_record(char* record, int record_length){
 			return 0;
 		} else {
 			if (server) num_connected--;
-			state = READY;
-			record_state = RECORD_READY;
-			recv_length = 0;
-			message_recv_length = 0;
+			input_reset();
 			sha256_init(&ctx);
 			send_error = 1;
 			return 0;
@@ -899,273 +1173,155 @@ static int process_record(char* record, int record_length){
 		return 1;
 	}
 	if (expected_message != CHANGE_CIPHER_SPEC) sha256_update(&ctx, (unsigned char*)record, record_length);
-	switch (record_state){
-	case RECORD_RECV_MSG: //we are in this state when the message is arbitrary fragmented
-			if (message_recv_length + record_length >= message_length) { //we have all we need plus maybe more
-				j = message_recv_length;
-				for (i = 0; j < message_length; i++) {
-					record_buffer[j++] = record[i];
-				}
-				if (act_on_full_message(record_buffer, message_length, 0)!=1) return 0;
-
-				mmem_free(&record_mmem);
-				state = READY;
-				if (record_length>i) process_record(record+i, record_length-i);
-			} else {
-				j = message_recv_length;
-				for (i = 0; i < record_length; i++) {
-					record_buffer[j++] = record[i];
-				}
-				message_recv_length = j; //still didn't get the whole message
+	//an empty message body is complete as soon as its header is
+	while (record_length > 0 || (record_state == RECORD_RECV_MSG && message_recv_length == message_length)){
+		switch (record_state){
+		case RECORD_RECV_HEADER: //the message header itself was split
+			n = 4 - message_recv_length;
+			if (n > record_length) n = record_length;
+			memcpy(message_header+message_recv_length, record, n);
+			message_recv_length += n;
+			record += n;
+			record_length -= n;
+			if (message_recv_length < 4){
 				return 1;
-
 			}
+			if (!message_start()) return 0;
 			break;
-	case RECORD_RECV_HEADER:
-		if ((record_length + message_recv_length) < 4){  //this is super unlikely
-			for (i = 0; i < record_length; i++) {
-				record_buffer[message_recv_length + i] = record[i];
-			}
-			message_recv_length += record_length;
-			return 1;
-		}else {
-			for (i = 0; message_recv_length < 4; i++) {
-				record_buffer[message_recv_length + i] = record[i];
-				message_recv_length++;
-			}
-			j = i;
-
-			memset(&message_length, (unsigned char)record[3],1);
-			memset(&message_length+1, (unsigned char)record[2],1);
-			memset(&message_length+2,(unsigned char)record[1],1);
-			//message_length = ((unsigned char)record[1] << 16) + ((unsigned char)record[2] << 8) + (unsigned char)record[3];
-			mmem_free(&record_mmem);
-			if (record_length - i < message_length) { //message fragmented
-
-				if (mmem_alloc(&record_mmem, message_length) == 0){
-					error(2, 80);
-					return 0;
-				}
-				record_buffer = (char*)MMEM_PTR(&record_mmem);
-				for (; i < record_length; i++) {
-					record_buffer[i - j] = record[i]; //copy the message to the buffer
-				}
-				message_recv_length = i - j;
-				state = RECV_MSG;
+		case RECORD_RECV_MSG: //the message continues in this record
+			n = message_length - message_recv_length;
+			if (n > record_length) n = record_length;
+			memcpy(record_buffer+message_recv_length, record, n);
+			message_recv_length += n;
+			record += n;
+			record_length -= n;
+			if (message_recv_length < message_length){
 				return 1;
-			} else {
-				//ok i have the whole message (or more), pass it to a function that will parse it
-				//also give an offset j
-				if (act_on_full_message(record, message_length, j)!=1) return 0;
-				if (record_length - j > message_length) {
-					record_state=RECORD_READY;
-					process_record(record+j+message_length, record_length-j-message_length);
-				}
 			}
-		}
-		break;
-	case RECORD_READY:
-		if ((expected_message == CLIENT_HELLO && (record[0]!=((char)client_hello & 0xFF))) ||
-				(expected_message == CLIENT_KEY_EXCHANGE && (record[0]!=((char)client_key_exchange & 0xFF))) ||
-				(expected_message == SERVER_HELLO && (record[0]!=((char)server_hello & 0xFF))) ||
-				(expected_message == SERVER_HELLO_DONE && (record[0]!=((char)server_hello_done & 0xFF)))){
-			error(2, 10);
-			return 0;
-		}
-		if (expected_message == CHANGE_CIPHER_SPEC){
-			if (act_on_full_message(record, 1, 0)!=1) return 0;
-
-			if (record_length > 1) {
-				//we have more to process, pass it back to the function
-				process_record(record+1, record_length-1);
-			}
-			return 1;
-		}
-		if(record_length < 4){
-			//message was fragmented by the record protocol, need to get the next record
-			//save what we got to the record_buffer
-			record_state = RECORD_RECV_HEADER;
-
-			if(mmem_alloc(&record_mmem, 4)==0){
-				error(2, 80);
+			record_state = RECORD_READY;
+			n = act_on_full_message(record_buffer, message_length, 0);
+			mmem_free(&record_mmem);
+			if (n != 1) return 0;
+			break;
+		case RECORD_READY:
+			if ((expected_message == CLIENT_HELLO && (record[0]!=((char)client_hello & 0xFF))) ||
+					(expected_message == CLIENT_KEY_EXCHANGE && (record[0]!=((char)client_key_exchange & 0xFF))) ||
+					(expected_message == SERVER_HELLO && (record[0]!=((char)server_hello & 0xFF))) ||
+					(expected_message == SERVER_HELLO_DONE && (record[0]!=((char)server_hello_done & 0xFF)))){
+				error(2, 10);
 				return 0;
 			}
-			record_buffer = (char*)MMEM_PTR(&record_mmem);
-			for (i = 0; i < record_length; i++) {
-				record_buffer[i] = record[i];
+			if (expected_message == CHANGE_CIPHER_SPEC){
+				if (act_on_full_message(record, 1, 0)!=1) return 0;
+				record++;
+				record_length--;
+				break;
 			}
-			message_recv_length = record_length;
-			return 1;
-		}
-
-		memset(&message_length, (unsigned char)record[3],1);
-		memset(&message_length+1, (unsigned char)record[2],1);
-		memset(&message_length+2,(unsigned char)record[1],1);
-		//message_length = ((unsigned char)record[1] << 16) + ((unsigned char)record[2] << 8) + (unsigned char)record[3];
-		if (record_length < 4 + message_length) {
-			//received fragment doesn't contain the complete sent message
-
-			if(mmem_alloc(&record_mmem, message_length)==0){
-				error(2, 80);
-				return 0;
+			if (record_length < 4){
+				//message was fragmented by the record protocol, the header continues in the next record
+				memcpy(message_header, record, record_length);
+				message_recv_length = record_length;
+				record_state = RECORD_RECV_HEADER;
+				return 1;
 			}
-			record_buffer = (char*)MMEM_PTR(&record_mmem);
-			for (i = 4; i < record_length; i++) {
-				record_buffer[i - 4] = record[i];
+			message_length = ((uint32)(unsigned char)record[1] << 16) +
+					((uint32)(unsigned char)record[2] << 8) + (unsigned char)record[3];
+			if (record_length - 4 < message_length){
+				//the rest of the message is in the next records
+				memcpy(message_header, record, 4);
+				record += 4;
+				record_length -= 4;
+				if (!message_start()) return 0;
+				break;
 			}
-			message_recv_length = record_length - 4;
-			record_state = RECORD_RECV_MSG;
-			return 1;
-		} else {
-			//
 			if (act_on_full_message(record, message_length, 4)!=1) return 0;
-
-			if (record_length > 4 + message_length) {
-				//we have more to process, pass it back to the function
-				process_record(record+message_length+4, record_length-message_length-4);
-			}
+			record += 4 + message_length;
+			record_length -= 4 + message_length;
+			break;
 		}
-		break;
 	}
 	return 1;
 }
-static void process_input(char* input, int input_length){
-	uint8_t i, j;
-	switch (state) {
-	case RECV_MSG: //we are in this state when the message is arbitrary fragmented
-		if (recv_length + input_length >= record_length) { //we have all we need plus maybe more
-			j = recv_length;
-			for (i = 0; j < record_length; i++) {
-				buffer[j++] = input[i];
-			}
-		//	if (act_on_full_message(buffer, record_length, 0)!=1) return;
-			if (process_record(buffer, record_length)!=1) return;
-			mmem_free(&process_mmem);
-			state = READY;
-			if (input_length>i) process_input(input+i, input_length-i);
-		} else {
-			j = recv_length;
-			for (i = 0; i < input_length; i++) {
-				buffer[j++] = input[i];
-			}
-			recv_length = j; //still didn't get the whole message
-			return;
 
-		}
-		break;
-	case RECV_HEADER:
-		if ((input_length + recv_length) < 5) {
-			//still didn't get the header...jeez
-			for (i = 0; i < input_length; i++) {
-				buffer[recv_length + i] = input[i];
-			}
-			recv_length += input_length;
-			return;
+/*
+ * look at the header of a new record before its body is processed. returns 0 on errors
+ */
+static uint8_t record_start(char* header){
+	if (header[0] == 0x15){
+		alert_received = 1;
+		return 1;
+	}
+	if (!handshake_done && (header[0] == 0x16 || header[0] == 0x14)){
+		//the peer answers the flight we sent
+		SEC_STATS_FLIGHT_ANSWERED(&handshake_stats);
+	}
+	if (expected_message!=CHANGE_CIPHER_SPEC && expected_message!=APPLICATION_DATA && header[0] != 0x16) { //have to get a handshake message first (type 22)
+		//unexpected message error (fatal)
+		error(2, 10);
+		return 0;
+	}
+	if (expected_message == CHANGE_CIPHER_SPEC && header[0] != 0x14) {
+		//unexpected message error (fatal)
+		error(2, 10);
+		return 0;
+	}
+	if (expected_message == APPLICATION_DATA && header[0] != 0x17){
+		if (server && header[0]==0x16){
+			expected_message = CLIENT_HELLO;
+			sha256_init(&ctx);
+			handshake_done = 0;
 		} else {
-			for (i = 0; recv_length < 5; i++) {
-				buffer[recv_length + i] = input[i];
-				recv_length++;
-			}
-			j = i;
-			record_length = ((unsigned char)buffer[3] << 8) + ((unsigned char)buffer[4]);
-
-			mmem_free(&process_mmem);
-			if (input_length - i < record_length) { //message fragmented
-
-				if (mmem_alloc(&process_mmem, record_length) == 0){
-					error(2, 80);
-					return;
-				}
-				buffer = (char*)MMEM_PTR(&process_mmem);
-				for (; i < input_length; i++) {
-					buffer[i - j] = input[i]; //copy the message to the buffer
-				}
-				recv_length = i - j;
-				state = RECV_MSG;
-				return;
-			} else {
-				//ok i have the whole message (or more), pass it to a function that will parse it
-				//also give an offset j
-				if (process_record(input+j, record_length)!=1) return;
-				//if (act_on_full_message(input, record_length, j)!=1) return;
-				if (input_length - j > record_length) {
-					state=READY;
-					process_input(input+j+record_length, input_length-j-record_length);
-				}
-			}
+			error(2, 10);
+			return 0;
 		}
-		break;
-	case READY: //initial state after TCP connection was established
+	}
+	return 1;
+}
 
-		if (input[0] == 0x15){
-			alert_received = 1;
-		} else {
-			if (expected_message!=CHANGE_CIPHER_SPEC && expected_message!=APPLICATION_DATA && input[0] != 0x16) { //have to get a handshake message first (type 22)
-				//unexpected message error (fatal)
-				error(2, 10);
-				return;
-			}
-			if (expected_message == CHANGE_CIPHER_SPEC && input[0] != 0x14) {
-				//unexpected message error (fatal)
-				error(2, 10);
-				return;
-			}
-			if (expected_message == APPLICATION_DATA && input[0] != 0x17){
-				if (server && input[0]==0x16){
-					expected_message = CLIENT_HELLO;
-					sha256_init(&ctx);
-					mmem_free(&datammem);
-					if (!first_data_sent) mmem_free(&mmem);
-					first_data_sent = 1;
-					first_data = 1;
-					handshake_done = 0;
-				} else {
-					error(2, 10);
-					return;
-				}
+/*
+ * record layer. a record that lies within the segment is processed (and decrypted) where it is,
+ * only one that spans segments is collected in record_in first
+ */
+static void process_input(char* input, int input_length){
+	uint16_t n;
+	while (input_length > 0 && !send_error){
+		if (recv_length == 0 && input_length >= 5){
+			record_length = ((unsigned char)input[3] << 8) + ((unsigned char)input[4]);
+			if (input_length - 5 >= record_length){
+				if (!record_start(input) || process_record(input+5, record_length)!=1) return;
+				input += 5 + record_length;
+				input_length -= 5 + record_length;
+				continue;
 			}
 		}
-
-		if (input_length < 5) { //didn't get enough to see how big the message is
-			state = RECV_HEADER;
-			//store what we received in a buffer
-
-			if(mmem_alloc(&process_mmem, 5)==0){
-				error(2, 80);
-				return;
+		if (recv_length < 5){
+			n = 5 - recv_length;
+			if (n > input_length) n = input_length;
+			memcpy(record_in+recv_length, input, n);
+			recv_length += n;
+			input += n;
+			input_length -= n;
+			if (recv_length < 5){
+				return; //still didn't get the header
 			}
-			buffer = (char*)MMEM_PTR(&process_mmem);
-			for (i = 0; i < input_length; i++) {
-				buffer[i] = input[i];
-			}
-			recv_length = input_length;
-			return;
-		}
-
-		record_length = ((unsigned char)input[3] << 8) + ((unsigned char)input[4]);
-		if (input_length < 5 + record_length) {
-			//received message doesn't contain the complete sent record (was fragmented)
-
-			if(mmem_alloc(&process_mmem, record_length)==0){
-				error(2, 80);
+			record_length = ((unsigned char)record_in[3] << 8) + ((unsigned char)record_in[4]);
+			if (record_length > TLS_MAX_RECORD){
+				error(2, 22); //record_overflow, we can't put it together
 				return;
 			}
-			buffer = (char*)MMEM_PTR(&process_mmem);
-			for (i = 5; i < input_length; i++) {
-				buffer[i - 5] = input[i];
-			}
-			recv_length = input_length - 5;
-			state = RECV_MSG;
+			if (!record_start(record_in)) return;
+		}
+		n = 5 + record_length - recv_length;
+		if (n > input_length) n = input_length;
+		memcpy(record_in+recv_length, input, n);
+		recv_length += n;
+		input += n;
+		input_length -= n;
+		if (recv_length < 5 + record_length){
 			return;
-		} else {
-			if (process_record(input+5, record_length)!=1) return;
-
-			if (input_length > 5 + record_length) {
-				//we have more to process, pass it back to the function
-				process_input(input+record_length+5, input_length-record_length-5);
-			}
 		}
-		break;
+		recv_length = 0;
+		if (process_record(record_in+5, record_length)!=1) return;
 	}
 }
 
@@ -1174,26 +1330,18 @@ static void handshake_event_handler(process_event_t ev, process_data_t data) {
 
 	if (ev == tcpip_event) {
 		if (server)process_post(calling_process, ev, data);
-		if (wait_for_ack){
-			handshake_done = 1;
-			secParam->client_write_IV = client_write_IV;
-			secParam->server_write_IV = server_write_IV;
-			secParam->client_write_key = client_write_key;
-			secParam->server_write_key = server_write_key;
-			connection->securityParameters = secParam;
-			connection->conn = client_conn;
-			tls_event = process_alloc_event();
-			tls_flags = TLS_CONNECTED;
-			process_post(calling_process, tls_event, (void*)connection);
-			expected_message = APPLICATION_DATA;
+		if (uip_conn == client_conn){
+			tcp_acked();
+		}
+		if (wait_for_ack && out_length == 0){
+			//the client has our Finished
+			server_connected();
 			wait_for_ack = 0;
-
-		}else
+		}
 		if (uip_connected()) {
 
 			if (server) {
 
-				client_conn = uip_conn;
 				if (num_connected == MAX_CONNECTIONS) {
 					//send an internal_error alert (fatal)
 					uip_send(internal_error, 7);
@@ -1202,33 +1350,38 @@ static void handshake_event_handler(process_event_t ev, process_data_t data) {
 					uip_close();
 					return;
 				}
+				client_conn = uip_conn;
 				num_connected++;
-				state = READY;
+				SEC_STATS_HANDSHAKE_START(&handshake_stats);
+				input_reset();
+				out_queue_reset();
 			} else {
-				tcp_send(buffer, 50);
+				out_queue_reset();
+				tcp_send(buffer, client_hello_length);
 
 				mmem_free(&process_mmem);
 
 			}
 		} else if (uip_newdata()) {
+			SEC_STATS_ADD(wire_in, uip_datalen());
 			process_input((char*)uip_appdata, uip_datalen());
-		} else if (uip_closed()){
+		} else if (uip_closed() || uip_aborted() || uip_timedout()){
 			if (server) {
 				num_connected--;
 				expected_message = CLIENT_HELLO;
 			} else {
 				expected_message = SERVER_HELLO;
 			}
-			state = READY;
-			record_state = RECORD_READY;
-			recv_length = 0;
-			message_recv_length = 0;
-
-			if(!first_data)mmem_free(&datammem);
-			first_data = 1;
+			input_reset();
 			mmem_free(&sec_mmem);
 			mmem_free(&conn_mmem);
+			out_queue_reset();
+			keys_wipe();
 			send_error = 1;
+			return;
+		}
+		if (uip_conn == client_conn){
+			tcp_output();
 		}
 	}
 }
@@ -1243,15 +1396,23 @@ PROCESS_BEGIN();
 	uint16_t port = d->port;
 	client_conn = tcp_connect(addr, UIP_HTONS(port), NULL);
 	sha256_init(&ctx);
+	session_id_len = 0;
+	struct cached_session* c = cache_find_peer(addr, UIP_HTONS(port));
+	if (c != NULL){
+		//we talked to this server before, ask for an abbreviated handshake
+		session_id_len = c->id_len;
+		memcpy(session_id, c->id, c->id_len);
+		memcpy(master_secret, c->master_secret, 48);
+	}
 	/*Create Client Hello message*/
-
-	if (mmem_alloc(&process_mmem,50)==1){
+	client_hello_length = 50+session_id_len;
+	if (mmem_alloc(&process_mmem,client_hello_length)==1){
 		buffer = (char*)MMEM_PTR(&process_mmem);
-		create_client_hello(buffer);
+		create_client_hello(buffer, session_id, session_id_len);
 		//save client_random
 		memcpy(client_random,buffer+11,32);
 		//update the hash of all handshake messages
-		sha256_update(&ctx, (unsigned char*)buffer+5, 45);
+		sha256_update(&ctx, (unsigned char*)buffer+5, 45+session_id_len);
 		/*  done  */
 		while (1) {
 			PROCESS_YIELD();
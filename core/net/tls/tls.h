@@ -11,9 +11,37 @@
 #define VERSION_MINOR 3 //TLS 1.2
 #define TLS_PSK_WITH_AES_128_CCM_8 0xC0A8 //according to RFC 6655
 #define MAX_CONNECTIONS 1
-#define READY 0
-#define RECV_HEADER 1
-#define RECV_MSG 2
+#ifdef TLS_CONF_SESSION_CACHE
+#define TLS_SESSION_CACHE TLS_CONF_SESSION_CACHE //master secrets kept for abbreviated handshakes
+#else
+#define TLS_SESSION_CACHE 2
+#endif
+#ifdef TLS_CONF_SESSION_LIFETIME
+#define TLS_SESSION_LIFETIME TLS_CONF_SESSION_LIFETIME //seconds a cached session can be resumed
+#else
+#define TLS_SESSION_LIFETIME 3600
+#endif
+#define TLS_SESSION_ID_LENGTH 16
+#ifdef TLS_CONF_MAX_RECORD
+#define TLS_MAX_RECORD TLS_CONF_MAX_RECORD //longest record that can be put together when it spans TCP segments
+#else
+#define TLS_MAX_RECORD 256
+#endif
+#ifdef TLS_CONF_OUTPUT_QUEUE
+#define TLS_OUTPUT_QUEUE TLS_CONF_OUTPUT_QUEUE //bytes of records kept until the peer acknowledged them
+#else
+#define TLS_OUTPUT_QUEUE 256
+#endif
+#ifdef TLS_CONF_MAX_PSK_IDENTITY
+#define TLS_MAX_PSK_IDENTITY TLS_CONF_MAX_PSK_IDENTITY //longer identities are unknown to the server
+#else
+#define TLS_MAX_PSK_IDENTITY 32
+#endif
+#ifdef TLS_CONF_MAX_HANDSHAKE_LENGTH
+#define TLS_MAX_HANDSHAKE_LENGTH TLS_CONF_MAX_HANDSHAKE_LENGTH //longest handshake message body that can be put together across records
+#else
+#define TLS_MAX_HANDSHAKE_LENGTH TLS_MAX_RECORD
+#endif
 #define RECORD_READY 0
 #define RECORD_RECV_HEADER 1
 #define RECORD_RECV_MSG 2
@@ -100,6 +128,9 @@ int tls_listen(uint16_t port, uint8_t max_conn);
 	Send data over the connection
 	conn - connection over which to send the data
 	toWrite - data to send  
+	returns 1 once the record is queued, 0 if nothing was sent (the output queue
+	is full or a rehandshake started) and -1 on errors, also when length+21
+	exceeds TLS_OUTPUT_QUEUE so that the record could never be queued
 */
 int tls_write(Connection* conn, char* toWrite, int length);
 
@@ -110,6 +141,10 @@ void tls_close(Connection* conn);
 
 process_event_t tls_event;
 process_event_t send_event;
+/*
+	TLS_NEWDATA is delivered synchronously, tls_appdata points into the received
+	segment and is only valid while the event is handled
+*/
 char* tls_appdata;
 int tls_applen;
 PROCESS_NAME(tls_client_handshake_process);
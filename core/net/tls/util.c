@@ -1,6 +1,6 @@
 #include "util.h"
 #include "tls.h"
-#include "random.h"
+#include "crypto_random.h"
 #include "ntpd.h"
 #include "hmac_sha2.h"
 #include "raven-lcd.h"
@@ -21,18 +21,18 @@ void create_hello_request(char* buffer){
 	*ptr = 0x00;	ptr++;
 	*ptr = 0x00;	ptr++;
 }
-void create_server_hello(char* buffer) {
+void create_server_hello(char* buffer, char* session_id, uint8_t session_id_len, uint8_t hello_done) {
 	char *ptr = buffer;
 	/* SERVER HELLO */
 	*ptr = (char) (handshake & 0xFF); ptr++;
 	*ptr = (char) (VERSION_MAJOR & 0xFF); ptr++;
 	*ptr = (char) (VERSION_MINOR & 0xFF);	ptr++;
 	*ptr = 0x00;	ptr++;
-	*ptr = 0x2A;	ptr++; //length of handshake is 42
+	*ptr = (char) (0x2A + session_id_len);	ptr++; //length of handshake is 42 + session id
 	*ptr = (char) (server_hello & 0xFF);	ptr++; //TYPE: server_hello
 	*ptr = 0x00;	ptr++;
 	*ptr = 0x00;	ptr++;
-	*ptr = 0x26;	ptr++; //length of 		client_hello is 38
+	*ptr = (char) (0x26 + session_id_len);	ptr++; //length of 		server_hello is 38 + session id
 	*ptr = (char) (VERSION_MAJOR & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MINOR & 0xFF);	ptr++;
 	unsigned long current_time = getCurrTime();
@@ -41,15 +41,19 @@ void create_server_hello(char* buffer) {
 	*ptr = (char) ((current_time >> 8) & 0xFF);	ptr++;
 	*ptr = (char) ((current_time) & 0xFF);	ptr++;
 	uint8_t i;
-	random_init(clock_time());
-	for (i = 0; i < 28; i++) {
-		*ptr = (char) (random_rand() % 128 & 0xFF);
-		ptr++;
+	crypto_random(ptr, 28);
+	ptr += 28;
+	*ptr = (char) session_id_len;	ptr++;
+	for (i = 0; i < session_id_len; i++){
+		*ptr = session_id[i]; ptr++;
 	}
-	*ptr = 0x00;	ptr++; //session id is null so the length is 0
 	*ptr = (char) ((TLS_PSK_WITH_AES_128_CCM_8 >> 8) & 0xFF);	ptr++;
 	*ptr = (char) ((TLS_PSK_WITH_AES_128_CCM_8) & 0xFF);	ptr++;
 	*ptr = 0x00;	ptr++; //null compression only (length 1 null 0)
+	if (!hello_done){
+		//an abbreviated handshake goes on with ChangeCipherSpec and Finished
+		return;
+	}
 	/* SERVER_HELLO_DONE */
 	*ptr = (char) (handshake & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MAJOR & 0xFF);	ptr++;
@@ -62,17 +66,17 @@ void create_server_hello(char* buffer) {
 	*ptr = 0x00;	ptr++;
 }
 
-void create_client_hello(char* buffer) {
+void create_client_hello(char* buffer, char* session_id, uint8_t session_id_len) {
 	char* ptr = buffer;
 	*ptr = (char) (handshake & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MAJOR & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MINOR & 0xFF);	ptr++;
 	*ptr = 0x00;	ptr++;
-	*ptr = 0x2D;	ptr++; //length of handshake is 45
+	*ptr = (char) (0x2D + session_id_len);	ptr++; //length of handshake is 45 + session id
 	*ptr = (char) (client_hello & 0xFF);	ptr++; //TYPE: client_hello
 	*ptr = 0x00;	ptr++;
 	*ptr = 0x00;	ptr++;
-	*ptr = 0x29;	ptr++; //length of client_hello is 41
+	*ptr = (char) (0x29 + session_id_len);	ptr++; //length of client_hello is 41 + session id
 	*ptr = (char) (VERSION_MAJOR & 0xFF);	ptr++;
 	*ptr = (char) (VERSION_MINOR & 0xFF);	ptr++;
 	unsigned long current_time = getCurrTime();
@@ -81,12 +85,12 @@ void create_client_hello(char* buffer) {
 	*ptr = (char) ((current_time >> 8) & 0xFF);	ptr++;
 	*ptr = (char) ((current_time) & 0xFF);	ptr++;
 	uint8_t i;
-	random_init(clock_time());
-	for (i = 0; i < 28; i++) {
-		*ptr = (char) (random_rand() % 128 & 0xFF);
-		ptr++;
+	crypto_random(ptr, 28);
+	ptr += 28;
+	*ptr = (char) session_id_len;	ptr++; //a cached session the client wants to resume
+	for (i = 0; i < session_id_len; i++){
+		*ptr = session_id[i]; ptr++;
 	}
-	*ptr = 0x00;	ptr++; //session id is null so the length is 0
 	*ptr = 0x00;	ptr++;
 	*ptr = 0x02;	ptr++; //one cipher suite supported
 	*ptr = (char) ((TLS_PSK_WITH_AES_128_CCM_8 >> 8) & 0xFF);	ptr++;
@@ -162,29 +166,3 @@ void create_alert(char* buffer, uint8_t level, uint8_t type) {
 	*ptr = (char) (level & 0xFF);	ptr++;
 	*ptr = (char) (type & 0xFF);	ptr++;
 }
-
-int PRF(char* output,  char* key, int key_length, char* label, char* seed, int seed_length, int output_length){
-	char A[32];
-	hmac_sha256_ctx c;
-	hmac_sha256_init(&c, key, key_length);
-	hmac_sha256_update(&c, label, strlen(label));
-	hmac_sha256_update(&c, seed, seed_length);
-	hmac_sha256_final(&c, A, 32);
-	int current_length = 0;
-	while (current_length < output_length){
-		hmac_sha256_reinit(&c);
-		hmac_sha256_update(&c, A, 32);
-		hmac_sha256_update(&c, label, strlen(label));
-		hmac_sha256_update(&c, seed, seed_length);
-		int min = output_length - current_length < 32 ? output_length - current_length : 32;
-		hmac_sha256_final(&c, output+current_length, min);
-		//change A
-		hmac_sha256_reinit(&c);
-		hmac_sha256_update(&c, A, 32);
-		hmac_sha256_final(&c, A, 32);
-		current_length+=32;
-	}
-
-	return 1;
-}
-
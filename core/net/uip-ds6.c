@@ -93,6 +93,152 @@ static uip_ds6_nbr_t *locnbr;
 static uip_ds6_defrt_t *locdefrt;
 static uip_ds6_route_t *locroute;
 
+/*
+ * Lookup indexes. The neighbor cache and the host (/128) routes are
+ * hashed on the IP address, head[] holds the first element of each
+ * bucket and next[] chains the elements of a bucket by their position
+ * in the table. Routes to shorter prefixes are chained through the
+ * same next[] in route_prefix_head, longest prefix first, so the first
+ * match is the longest one. The tables themselves stay as they are,
+ * code that walks them directly keeps working. An element that was
+ * freed by clearing isused is skipped by the lookups and unlinked when
+ * its slot is reused.
+ */
+#define INDEX_END      0xffff
+#define INDEX_UNLINKED 0xfffe
+
+struct ds6_index {
+  uint8_t *list;
+  uint16_t elementsize;
+  uint16_t size;
+  uint16_t buckets;
+  uint16_t *head;
+  uint16_t *next;
+};
+
+static uint16_t nbr_head[UIP_DS6_NBR_HASH_NB];
+static uint16_t nbr_next[UIP_DS6_NBR_NB];
+static struct ds6_index nbr_index = {
+  (uint8_t *)uip_ds6_nbr_cache, sizeof(uip_ds6_nbr_t),
+  UIP_DS6_NBR_NB, UIP_DS6_NBR_HASH_NB, nbr_head, nbr_next
+};
+
+static uint16_t route_head[UIP_DS6_ROUTE_HASH_NB];
+static uint16_t route_next[UIP_DS6_ROUTE_NB];
+static uint16_t route_prefix_head;
+static struct ds6_index route_index = {
+  (uint8_t *)uip_ds6_routing_table, sizeof(uip_ds6_route_t),
+  UIP_DS6_ROUTE_NB, UIP_DS6_ROUTE_HASH_NB, route_head, route_next
+};
+
+#define INDEX_ELEMENT(index, i) \
+  ((uip_ds6_element_t *)((index)->list + (i) * (index)->elementsize))
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+index_bucket(struct ds6_index *index, uip_ipaddr_t *ipaddr)
+{
+  uint16_t h = 0;
+  uint8_t i;
+
+  for(i = 0; i < 16; i++) {
+    h = h * 33 + ipaddr->u8[i];
+  }
+  return h % index->buckets;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_reset(struct ds6_index *index)
+{
+  uint16_t i;
+
+  for(i = 0; i < index->buckets; i++) {
+    index->head[i] = INDEX_END;
+  }
+  for(i = 0; i < index->size; i++) {
+    index->next[i] = INDEX_UNLINKED;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_insert(struct ds6_index *index, uint16_t i)
+{
+  uint16_t *head;
+
+  head = &index->head[index_bucket(index, &INDEX_ELEMENT(index, i)->ipaddr)];
+  index->next[i] = *head;
+  *head = i;
+}
+/*---------------------------------------------------------------------------*/
+/* Removes element i from the chain starting at *p */
+static void
+index_unlink(struct ds6_index *index, uint16_t *p, uint16_t i)
+{
+  while(*p != INDEX_END) {
+    if(*p == i) {
+      *p = index->next[i];
+      break;
+    }
+    p = &index->next[*p];
+  }
+  index->next[i] = INDEX_UNLINKED;
+}
+/*---------------------------------------------------------------------------*/
+/* Removes element i from its bucket, it must still hold the address it
+   was inserted with */
+static void
+index_remove(struct ds6_index *index, uint16_t i)
+{
+  if(index->next[i] != INDEX_UNLINKED) {
+    index_unlink(index,
+                 &index->head[index_bucket(index, &INDEX_ELEMENT(index, i)->ipaddr)],
+                 i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_element_t *
+index_find(struct ds6_index *index, uip_ipaddr_t *ipaddr)
+{
+  uip_ds6_element_t *element;
+  uint16_t i;
+
+  for(i = index->head[index_bucket(index, ipaddr)]; i != INDEX_END;
+      i = index->next[i]) {
+    element = INDEX_ELEMENT(index, i);
+    if(element->isused && uip_ipaddr_cmp(&element->ipaddr, ipaddr)) {
+      return element;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_link(uint16_t i)
+{
+  uint16_t *p;
+
+  if(uip_ds6_routing_table[i].length == 128) {
+    index_insert(&route_index, i);
+    return;
+  }
+  for(p = &route_prefix_head;
+      *p != INDEX_END &&
+      uip_ds6_routing_table[*p].length >= uip_ds6_routing_table[i].length;
+      p = &route_next[*p]);
+  route_next[i] = *p;
+  *p = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_unlink(uint16_t i)
+{
+  if(uip_ds6_routing_table[i].length == 128) {
+    index_remove(&route_index, i);
+  } else if(route_next[i] != INDEX_UNLINKED) {
+    index_unlink(&route_index, &route_prefix_head, i);
+  }
+}
+
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_init(void)
@@ -106,6 +252,9 @@ uip_ds6_init(void)
   memset(uip_ds6_prefix_list, 0, sizeof(uip_ds6_prefix_list));
   memset(&uip_ds6_if, 0, sizeof(uip_ds6_if));
   memset(uip_ds6_routing_table, 0, sizeof(uip_ds6_routing_table));
+  index_reset(&nbr_index);
+  index_reset(&route_index);
+  route_prefix_head = INDEX_END;
 
   /* Set interface parameters */
   uip_ds6_if.link_mtu = UIP_LINK_MTU;
@@ -285,15 +434,24 @@ uip_ds6_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
 {
   int r;
 
-  r = uip_ds6_list_loop
-     ((uip_ds6_element_t *) uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
-      sizeof(uip_ds6_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **) &locnbr);
-  //  printf("r %d\n", r);
+  if(index_find(&nbr_index, ipaddr) != NULL) {
+    r = FOUND;
+  } else {
+    r = NOSPACE;
+    for(locnbr = uip_ds6_nbr_cache;
+        locnbr < uip_ds6_nbr_cache + UIP_DS6_NBR_NB; locnbr++) {
+      if(!locnbr->isused) {
+        r = FREESPACE;
+        break;
+      }
+    }
+  }
 
   if(r == FREESPACE) {
+    index_remove(&nbr_index, locnbr - uip_ds6_nbr_cache);
     locnbr->isused = 1;
     uip_ipaddr_copy(&(locnbr->ipaddr), ipaddr);
+    index_insert(&nbr_index, locnbr - uip_ds6_nbr_cache);
     if(lladdr != NULL) {
       memcpy(&(locnbr->lladdr), lladdr, UIP_LLADDR_LEN);
     } else {
@@ -353,6 +511,7 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 {
   if(nbr != NULL) {
     nbr->isused = 0;
+    index_remove(&nbr_index, nbr - uip_ds6_nbr_cache);
 #if UIP_CONF_IPV6_QUEUE_PKT
     //    printf("rm %p\n", &nbr->isused);
     uip_packetqueue_free(&nbr->packethandle);
@@ -366,13 +525,8 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 uip_ds6_nbr_t *
 uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *) uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
-      sizeof(uip_ds6_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **) & locnbr) == FOUND) {
-    return locnbr;
-  }
-  return NULL;
+  locnbr = (uip_ds6_nbr_t *)index_find(&nbr_index, ipaddr);
+  return locnbr;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -722,20 +876,20 @@ uip_ds6_aaddr_lookup(uip_ipaddr_t * ipaddr)
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t * destipaddr)
 {
-  uip_ds6_route_t *locrt = NULL;
-  uint8_t longestmatch = 0;
+  uip_ds6_route_t *locrt;
+  uint16_t i;
 
   PRINTF("DS6: Looking up route for");
   PRINT6ADDR(destipaddr);
   PRINTF("\n");
 
-  for(locroute = uip_ds6_routing_table;
-      locroute < uip_ds6_routing_table + UIP_DS6_ROUTE_NB; locroute++) {
-    if((locroute->isused) && (locroute->length >= longestmatch)
-       &&
-       (uip_ipaddr_prefixcmp
-        (destipaddr, &locroute->ipaddr, locroute->length))) {
-      longestmatch = locroute->length;
+  /* A host route is the longest match there can be */
+  locrt = (uip_ds6_route_t *)index_find(&route_index, destipaddr);
+  for(i = route_prefix_head; locrt == NULL && i != INDEX_END;
+      i = route_next[i]) {
+    locroute = &uip_ds6_routing_table[i];
+    if(locroute->isused &&
+       uip_ipaddr_prefixcmp(destipaddr, &locroute->ipaddr, locroute->length)) {
       locrt = locroute;
     }
   }
@@ -758,16 +912,35 @@ uip_ds6_route_t *
 uip_ds6_route_add(uip_ipaddr_t * ipaddr, u8_t length, uip_ipaddr_t * nexthop,
                   u8_t metric)
 {
+  uint16_t i;
 
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *) uip_ds6_routing_table, UIP_DS6_ROUTE_NB,
-      sizeof(uip_ds6_route_t), ipaddr, length,
-      (uip_ds6_element_t **) & locroute) == FREESPACE) {
+  /* An existing route to the same prefix is returned as it is */
+  if(length == 128) {
+    locroute = (uip_ds6_route_t *)index_find(&route_index, ipaddr);
+  } else {
+    for(i = route_prefix_head; i != INDEX_END; i = route_next[i]) {
+      locroute = &uip_ds6_routing_table[i];
+      if(locroute->isused && locroute->length == length &&
+         uip_ipaddr_prefixcmp(&locroute->ipaddr, ipaddr, length)) {
+        return locroute;
+      }
+    }
+    locroute = NULL;
+  }
+  if(locroute != NULL) {
+    return locroute;
+  }
+
+  for(i = 0; i < (UIP_DS6_ROUTE_NB) && uip_ds6_routing_table[i].isused; i++);
+  if(i < (UIP_DS6_ROUTE_NB)) {
+    locroute = &uip_ds6_routing_table[i];
+    route_unlink(i);
     locroute->isused = 1;
     uip_ipaddr_copy(&(locroute->ipaddr), ipaddr);
     locroute->length = length;
     uip_ipaddr_copy(&(locroute->nexthop), nexthop);
     locroute->metric = metric;
+    route_link(i);
 
     PRINTF("DS6: adding route:");
     PRINT6ADDR(ipaddr);
@@ -786,6 +959,7 @@ void
 uip_ds6_route_rm(uip_ds6_route_t *route)
 {
   route->isused = 0;
+  route_unlink(route - uip_ds6_routing_table);
 #if (DEBUG & DEBUG_ANNOTATE) == DEBUG_ANNOTATE
   /* we need to check if this was the last route towards "nexthop" */
   /* if so - remove that link (annotation) */
@@ -807,6 +981,7 @@ uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop)
       locroute < uip_ds6_routing_table + UIP_DS6_ROUTE_NB; locroute++) {
     if((locroute->isused) && uip_ipaddr_cmp(&locroute->nexthop, nexthop)) {
       locroute->isused = 0;
+      route_unlink(locroute - uip_ds6_routing_table);
     }
   }
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
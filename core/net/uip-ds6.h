@@ -89,6 +89,18 @@
 #endif
 #define UIP_DS6_ROUTE_NB UIP_DS6_ROUTE_NBS + UIP_DS6_ROUTE_NBU
 
+/* Buckets of the hashes over the host (/128) routes and the neighbor cache */
+#ifndef UIP_CONF_DS6_ROUTE_HASH_NB
+#define UIP_DS6_ROUTE_HASH_NB (UIP_DS6_ROUTE_NB)
+#else
+#define UIP_DS6_ROUTE_HASH_NB UIP_CONF_DS6_ROUTE_HASH_NB
+#endif
+#ifndef UIP_CONF_DS6_NBR_HASH_NB
+#define UIP_DS6_NBR_HASH_NB (UIP_DS6_NBR_NB)
+#else
+#define UIP_DS6_NBR_HASH_NB UIP_CONF_DS6_NBR_HASH_NB
+#endif
+
 /* Unicast address list*/
 #define UIP_DS6_ADDR_NBS 1
 #ifndef UIP_CONF_DS6_ADDR_NBU
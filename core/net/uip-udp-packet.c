@@ -54,7 +54,10 @@ uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
 #if UIP_UDP
   uip_udp_conn = c;
   uip_slen = len;
-  memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], data, len > UIP_BUFSIZE? UIP_BUFSIZE: len);
+  /* Callers may build the payload in place in uip_buf to save a copy. */
+  if(data != &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN]) {
+    memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], data, len > UIP_BUFSIZE? UIP_BUFSIZE: len);
+  }
   uip_process(UIP_UDP_SEND_CONN);
 #if UIP_CONF_IPV6 //math
   tcpip_ipv6_output();
@@ -474,6 +474,28 @@
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of datagrams reassembled at the same time, e.g. from
+ * different senders. Each slot holds a buffer of UIP_BUFSIZE bytes.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_SLOTS
+#define SICSLOWPAN_REASS_SLOTS (SICSLOWPAN_CONF_REASS_SLOTS)
+#else
+#define SICSLOWPAN_REASS_SLOTS 2
+#endif
+
+/**
+ * Send the fragments of a datagram as one burst: all but the last
+ * fragment carry the frame pending bit, which tells a duty cycling
+ * RDC (ContikiMAC) that more frames to the same receiver follow, so
+ * that only the first fragment has to wake the receiver up.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_BURST
+#define SICSLOWPAN_FRAG_BURST (SICSLOWPAN_CONF_FRAG_BURST)
+#else
+#define SICSLOWPAN_FRAG_BURST 1
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -50,6 +50,12 @@
 #include "sys/etimer.h"
 #include "sys/process.h"
 
+/*
+ * The timer list is kept sorted by expiration time, so the next timer
+ * to expire is always at its head: the etimer process only looks at
+ * the head of the list and next_expiration is read from it, instead of
+ * scanning all timers after every expiration.
+ */
 static struct etimer *timerlist;
 static clock_time_t next_expiration;
 
@@ -58,30 +64,64 @@ PROCESS(etimer_process, "Event timer");
 static void
 update_time(void)
 {
-  clock_time_t tdist;
-  clock_time_t now;
-  struct etimer *t;
-
   if (timerlist == NULL) {
     next_expiration = 0;
   } else {
-    now = clock_time();
-    t = timerlist;
-    /* Must calculate distance to next time into account due to wraps */
-    tdist = t->timer.start + t->timer.interval - now;
-    for(t = t->next; t != NULL; t = t->next) {
-      if(t->timer.start + t->timer.interval - now < tdist) {
-	tdist = t->timer.start + t->timer.interval - now;
-      }
+    next_expiration = timerlist->timer.start + timerlist->timer.interval;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Time until t expires, 0 if it has expired (the same test as
+   timer_expired()). Measured from now, this orders the timers
+   correctly across clock wraps. */
+static clock_time_t
+time_left(struct etimer *t, clock_time_t now)
+{
+  if(t->timer.interval < (clock_time_t)(now - t->timer.start + 1)) {
+    return 0;
+  }
+  return t->timer.start + t->timer.interval - now;
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_timer(struct etimer *timer)
+{
+  struct etimer **tp;
+  clock_time_t now, left;
+
+  now = clock_time();
+  left = time_left(timer, now);
+
+  /* Behind the timers that expire at the same time */
+  for(tp = &timerlist; *tp != NULL && time_left(*tp, now) <= left;
+      tp = &(*tp)->next);
+  timer->next = *tp;
+  *tp = timer;
+
+  update_time();
+}
+/*---------------------------------------------------------------------------*/
+/* Takes timer off the list, returns 0 if it was not on it */
+static int
+remove_timer(struct etimer *timer)
+{
+  struct etimer **tp;
+
+  for(tp = &timerlist; *tp != NULL; tp = &(*tp)->next) {
+    if(*tp == timer) {
+      *tp = timer->next;
+      timer->next = NULL;
+      update_time();
+      return 1;
     }
-    next_expiration = now + tdist;
   }
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(etimer_process, ev, data)
 {
-  struct etimer *t, *u;
-	
+  struct etimer *t;
+
   PROCESS_BEGIN();
 
   timerlist = NULL;
@@ -105,38 +145,30 @@ PROCESS_THREAD(etimer_process, ev, data)
 	    t = t->next;
 	}
       }
+      update_time();
       continue;
     } else if(ev != PROCESS_EVENT_POLL) {
       continue;
     }
 
-  again:
-    
-    u = NULL;
-    
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(timer_expired(&t->timer)) {
-	if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
-	  
-	  /* Reset the process ID of the event timer, to signal that the
-	     etimer has expired. This is later checked in the
-	     etimer_expired() function. */
-	  t->p = PROCESS_NONE;
-	  if(u != NULL) {
-	    u->next = t->next;
-	  } else {
-	    timerlist = t->next;
-	  }
-	  t->next = NULL;
-	  update_time();
-	  goto again;
-	} else {
-	  etimer_request_poll();
-	}
+    while(timerlist != NULL && timer_expired(&timerlist->timer)) {
+      t = timerlist;
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+
+	/* Reset the process ID of the event timer, to signal that the
+	   etimer has expired. This is later checked in the
+	   etimer_expired() function. */
+	t->p = PROCESS_NONE;
+	timerlist = t->next;
+	t->next = NULL;
+	update_time();
+      } else {
+	/* The event queue is full, try again later */
+	etimer_request_poll();
+	break;
       }
-      u = t;
     }
-    
+
   }
   
   PROCESS_END();
@@ -151,27 +183,17 @@ etimer_request_poll(void)
 static void
 add_timer(struct etimer *timer)
 {
-  struct etimer *t;
-
   etimer_request_poll();
 
-  if(timer->p != PROCESS_NONE) {
-    /* Timer not on list. */
-    
-    for(t = timerlist; t != NULL; t = t->next) {
-      if(t == timer) {
-	/* Timer already on list, bail out. */
-	update_time();
-	return;
-      }
-    }
+  if(timer->p != PROCESS_NONE && remove_timer(timer)) {
+    /* Timer already on list, keep its process but move it to the
+       place of its new expiration time. */
+    insert_timer(timer);
+    return;
   }
 
   timer->p = PROCESS_CURRENT();
-  timer->next = timerlist;
-  timerlist = timer;
-
-  update_time();
+  insert_timer(timer);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -199,7 +221,9 @@ void
 etimer_adjust(struct etimer *et, int timediff)
 {
   et->timer.start += timediff;
-  update_time();
+  if(et->p != PROCESS_NONE && remove_timer(et)) {
+    insert_timer(et);
+  }
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -235,26 +259,7 @@ etimer_next_expiration_time(void)
 void
 etimer_stop(struct etimer *et)
 {
-  struct etimer *t;
-
-  /* First check if et is the first event timer on the list. */
-  if(et == timerlist) {
-    timerlist = timerlist->next;
-    update_time();
-  } else {
-    /* Else walk through the list and try to find the item before the
-       et timer. */
-    for(t = timerlist; t != NULL && t->next != et; t = t->next);
-
-    if(t != NULL) {
-      /* We've found the item before the event timer that we are about
-	 to remove. We point the items next pointer to the event after
-	 the removed item. */
-      t->next = et->next;
-
-      update_time();
-    }
-  }
+  remove_timer(et);
 
   /* Remove the next pointer from the item to be removed. */
   et->next = NULL;
@@ -1,21 +1,79 @@
+
 #include "contiki.h"
 #include "contiki-lib.h"
 #include "contiki-net.h"
-//#include "aes_ccm.h"
+#include "aes.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Times AES_encrypt() with the round tables selected by AES_TABLES (see
+ * core/net/crypto/aes.h) and checks it against the FIPS-197 example vector.
+ * Build once per variant:
+ *
+ *   make clean; make AES_TABLES=1 BLOCKS=100
+ *
+ * "make crypto-footprint" prints the size of aes.c for all three variants.
+ */
+
+#ifndef BLOCKS
+#define BLOCKS 100
+#endif
+
+#if AES_TABLES == AES_TABLES_FULL
+#define TABLE_BYTES 4096
+#elif AES_TABLES == AES_TABLES_SINGLE
+#define TABLE_BYTES 1024
+#else
+#define TABLE_BYTES 256
+#endif
+
+static const uint8_t expected[AES_BLOCK_SIZE] = {
+  0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+  0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+};
 
 static struct etimer et;
+static AES_KEY schedule;
+static uint8_t key[AES_BLOCK_SIZE];
+static uint8_t block[AES_BLOCK_SIZE];
 PROCESS(udp_server_process, "1");
 AUTOSTART_PROCESSES(&udp_server_process);
 /*---------------------------------------------------------------------------*/
-
 PROCESS_THREAD(udp_server_process, ev, data)
 {
+  static uint8_t i;
+  unsigned long n;
+  unsigned long ticks;
+  rtimer_clock_t t;
 
   PROCESS_BEGIN();
 
   etimer_set(&et, CLOCK_CONF_SECOND*3);
   PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
-  //encrypt("","","","",0,"");
+
+  for(i = 0; i < AES_BLOCK_SIZE; i++) {
+    key[i] = i;
+    block[i] = i * 0x11;
+  }
+  AES_set_encrypt_key(key, &schedule);
+  AES_encrypt(block, block, &schedule);
+  printf("AES_TABLES=%d, %d bytes of tables, FIPS-197 vector %s\n",
+         AES_TABLES, TABLE_BYTES,
+         memcmp(block, expected, AES_BLOCK_SIZE) == 0 ? "ok" : "WRONG");
+
+  t = RTIMER_NOW();
+  for(n = 0; n < BLOCKS; n++) {
+    AES_encrypt(block, block, &schedule);
+  }
+  ticks = (rtimer_clock_t)(RTIMER_NOW() - t);
+#ifdef F_CPU
+  printf("%lu blocks, %lu cycles per block\n", (unsigned long)BLOCKS,
+         (unsigned long)((unsigned long long)ticks * (F_CPU / RTIMER_ARCH_SECOND) / BLOCKS));
+#else
+  printf("%lu blocks, %lu ns per block\n", (unsigned long)BLOCKS,
+         (unsigned long)((unsigned long long)ticks * 1000000000ULL / RTIMER_ARCH_SECOND / BLOCKS));
+#endif
 
   PROCESS_END();
 }
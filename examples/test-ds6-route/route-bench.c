@@ -0,0 +1,136 @@
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Times uip_ds6_route_lookup() on a full routing table against the
+ * linear longest prefix scan it replaced. The table holds one /48 and
+ * one /64 route and /128 host routes in the /64 for the rest, like the
+ * root of an RPL network with a DAO route per node. About half of the
+ * destinations have a host route, the others match one of the prefixes.
+ *
+ * make sweep TARGET=native runs it for UIP_DS6_ROUTE_NB from 8 to 1024.
+ */
+
+#define LOOKUPS 200000UL
+
+extern uip_ds6_route_t uip_ds6_routing_table[];
+
+static struct etimer et;
+PROCESS(route_bench_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&route_bench_process);
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+linear_lookup(uip_ipaddr_t *destipaddr)
+{
+  uip_ds6_route_t *r, *found = NULL;
+  uint8_t longestmatch = 0;
+
+  for(r = uip_ds6_routing_table;
+      r < uip_ds6_routing_table + UIP_DS6_ROUTE_NB; r++) {
+    if(r->isused && r->length >= longestmatch &&
+       uip_ipaddr_prefixcmp(destipaddr, &r->ipaddr, r->length)) {
+      longestmatch = r->length;
+      found = r;
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static void
+destination(uip_ipaddr_t *addr, unsigned long i)
+{
+  uint16_t host = (i * 7919) % (2 * (UIP_DS6_ROUTE_NB));
+
+  if(i & 1) {
+    /* Only in the /48 */
+    uip_ip6addr(addr, 0xaaaa, 0, 0, 1, 0, 0, 0, host);
+  } else {
+    uip_ip6addr(addr, 0xaaaa, 0, 0, 0, 0, 0, 0, host);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+compare(void)
+{
+  uip_ipaddr_t addr;
+  unsigned long i;
+
+  for(i = 0; i < 4 * (UIP_DS6_ROUTE_NB); i++) {
+    destination(&addr, i);
+    if(linear_lookup(&addr) != uip_ds6_route_lookup(&addr)) {
+      printf("routes %u: lookups DIFFER\n", UIP_DS6_ROUTE_NB);
+      exit(1);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+run(uip_ds6_route_t *(*lookup)(uip_ipaddr_t *), unsigned long *found)
+{
+  uip_ds6_route_t *r;
+  uip_ipaddr_t addr;
+  clock_time_t t;
+  unsigned long i;
+
+  *found = 0;
+  t = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    destination(&addr, i);
+    r = lookup(&addr);
+    if(r != NULL && r->length == 128) {
+      (*found)++;
+    }
+  }
+  return clock_time() - t;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_bench_process, ev, data)
+{
+  uip_ipaddr_t addr, nexthop;
+  unsigned long linear, indexed, linear_found, indexed_found;
+  uint16_t n;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, CLOCK_SECOND / 10);
+  PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+
+  uip_ip6addr(&nexthop, 0xfe80, 0, 0, 0, 0, 0, 0, 1);
+  uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_route_add(&addr, 48, &nexthop, 0);
+  uip_ds6_route_add(&addr, 64, &nexthop, 0);
+  for(n = 0; n < (UIP_DS6_ROUTE_NB) - 2; n++) {
+    uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 2 * n);
+    if(uip_ds6_route_add(&addr, 128, &nexthop, 0) == NULL) {
+      printf("route %u not added\n", n);
+      exit(1);
+    }
+  }
+
+  /* Both must agree, also after routes were removed and added again */
+  for(n = 0; n < (UIP_DS6_ROUTE_NB) - 2; n += 3) {
+    uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 2 * n);
+    uip_ds6_route_rm(uip_ds6_route_lookup(&addr));
+  }
+  compare();
+  for(n = 0; n < (UIP_DS6_ROUTE_NB) - 2; n += 3) {
+    uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 2 * n);
+    uip_ds6_route_add(&addr, 128, &nexthop, 0);
+  }
+  compare();
+
+  linear = run(linear_lookup, &linear_found);
+  indexed = run(uip_ds6_route_lookup, &indexed_found);
+  printf("routes %4u: linear %5lu ms, indexed %5lu ms for %lu lookups, %lu host routes hit%s\n",
+         UIP_DS6_ROUTE_NB, (unsigned long)(linear * 1000 / CLOCK_SECOND),
+         (unsigned long)(indexed * 1000 / CLOCK_SECOND), LOOKUPS, indexed_found,
+         linear_found == indexed_found ? "" : ", DIFFER");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
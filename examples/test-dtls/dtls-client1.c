@@ -18,18 +18,26 @@ static char* hello_msg = "123456789012345678901234567890123456789012345678901234
 static uip_ipaddr_t ipaddr;
 static void dtls_handler(process_event_t ev, process_data_t data){
 	if (ev == dtls_event){
-		if (dtls_rehandshake()){
+		if (dtls_closed(data)){
+			if (connection == data){
+				//the handle is given back after this event
+				connection = NULL;
+				etimer_stop(&et);
+				etimer_stop(&et2);
+			}
+		} else
+		if (dtls_rehandshake(data)){
 			etimer_stop(&et);
 		} else
-		if (dtls_connected()){
+		if (dtls_connected(data)){
 			//raven_lcd_show_text("conn");
 			connection = (Connection*)data;
 			etimer_set(&et, SEND_INTERVAL);
 			DTLS_Write(connection, hello_msg, 100);
-		} else if (dtls_newdata()){
-			dtls_appdata[5] = 0;
+		} else if (dtls_newdata(data)){
+			dtls_appdata(data)[5] = 0;
 			
-			raven_lcd_show_text(dtls_appdata);
+			raven_lcd_show_text(dtls_appdata(data));
 			etimer_set(&et, CLOSE_INTERVAL);
 			//DTLS_Write(connection, hello_msg, strlen(hello_msg));
 		}
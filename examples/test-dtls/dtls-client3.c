@@ -22,19 +22,25 @@ static char* hello_msg = "hellooo";
 static uip_ipaddr_t ipaddr;
 static void dtls_handler(process_event_t ev, process_data_t data){
 if (ev == dtls_event){
-		if (dtls_rehandshake()){
+		if (dtls_closed(data)){
+			if (connection == data){
+				//the handle is given back after this event
+				connection = NULL;
+				etimer_stop(&et);
+			}
+		} else
+		if (dtls_rehandshake(data)){
 			etimer_stop(&et);
 		} else
-		if (dtls_connected()){
+		if (dtls_connected(data)){
 			//raven_lcd_show_text("conn");
 			PRINTF("CONNECTED\n");
 			connection = (Connection*)data;
 			etimer_set(&et, SEND_INTERVAL);
 			DTLS_Write(connection, hello_msg, strlen(hello_msg));
-		} else if (dtls_newdata()){
-			dtls_appdata[dtls_applen] = 0;
-			PRINTF("GOT NEW DATA: %s\n", dtls_appdata);
-			//raven_lcd_show_text(dtls_appdata);
+		} else if (dtls_newdata(data)){
+			PRINTF("GOT NEW DATA: %s\n", dtls_appdata(data));
+			//raven_lcd_show_text(dtls_appdata(data));
 		}
 	} else if (ev == PROCESS_EVENT_TIMER){
 		if (etimer_expired(&et)){
@@ -42,10 +42,8 @@ static Connection* connection;
 static void dtls_handler(process_event_t ev, process_data_t data){
 
 	if (ev == dtls_event){
-		if (dtls_connected()){
+		if (dtls_connected(data)){
 			connection = (Connection*)data;
-		} else if (dtls_newdata()){
-			dtls_appdata[dtls_applen] = 0;
 		}
 	}
 
@@ -10,14 +10,13 @@ static Connection* connection;
 static void dtls_handler(process_event_t ev, process_data_t data){
 
 	if (ev == dtls_event){
-		if (dtls_connected()){
+		if (dtls_connected(data)){
 		//	raven_lcd_show_text("conn");
 			connection = (Connection*)data;
 			//DTLS_Write(connection, "connected", 9);
-		} else if (dtls_newdata()){
+		} else if (dtls_newdata(data)){
 			//tls_appdata[tls_applen] = 0;
-			dtls_appdata[dtls_applen] = 0;
-			//raven_lcd_show_text(dtls_appdata);
+			//raven_lcd_show_text(dtls_appdata(data));
 			//DTLS_Write(connection, "world", 5);
 		}
 	}
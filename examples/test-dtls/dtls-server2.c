@@ -15,18 +15,25 @@ static struct etimer et2;
 static char* hello_msg = "hello";
 static void dtls_handler(process_event_t ev, process_data_t data){
 if (ev == dtls_event){
-		if (dtls_rehandshake()){
+		if (dtls_closed(data)){
+			if (connection == data){
+				//the handle is given back after this event
+				connection = NULL;
+				etimer_stop(&et);
+				etimer_stop(&et2);
+			}
+		} else
+		if (dtls_rehandshake(data)){
 			etimer_stop(&et);
 		} else
-		if (dtls_connected()){
+		if (dtls_connected(data)){
 			raven_lcd_show_text("conn");
 			connection = (Connection*)data;
 			etimer_set(&et, SEND_INTERVAL);
 			DTLS_Write(connection, hello_msg, strlen(hello_msg));
-		} else if (dtls_newdata()){
-			dtls_appdata[dtls_applen] = 0;
+		} else if (dtls_newdata(data)){
 			
-			raven_lcd_show_text(dtls_appdata);
+			raven_lcd_show_text(dtls_appdata(data));
 			etimer_set(&et, CLOSE_INTERVAL);
 		}
 	} else if (ev == PROCESS_EVENT_TIMER){
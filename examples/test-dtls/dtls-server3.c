@@ -18,14 +18,13 @@ static struct etimer et;
 
 static void dtls_handler(process_event_t ev, process_data_t data){
 	if (ev == dtls_event){
-		if (dtls_connected()){
+		if (dtls_connected(data)){
 			//raven_lcd_show_text("conn");
 			PRINTF("CONNECTED\n");
 			connection = (Connection*)data;
-		} else if (dtls_newdata()){
-			dtls_appdata[dtls_applen] = 0;
-			PRINTF("GOT NEW DATA: %s\n",dtls_appdata);
-			//raven_lcd_show_text(dtls_appdata);
+		} else if (dtls_newdata(data)){
+			PRINTF("GOT NEW DATA: %s\n",dtls_appdata(data));
+			//raven_lcd_show_text(dtls_appdata(data));
 		}
 	}
 
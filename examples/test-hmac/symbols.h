@@ -0,0 +1,2 @@
+#include "loader/symbols.h"
+extern const struct symbols symbols[1];
@@ -1,21 +1,128 @@
+
 #include "contiki.h"
 #include "contiki-lib.h"
 #include "contiki-net.h"
 #include "hmac_sha2.h"
+#include "prf.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Compares the PRF the DTLS/TLS handshakes used to run, one hmac_sha256_ctx
+ * re-initialised for every A(i) and output block, with PRF_key()/PRF_keyed()
+ * the engines call now. Each run derives what one side of a PSK handshake
+ * needs: master secret, key block and both Finished values.
+ */
+
+#define ITERATIONS 10
 
 static struct etimer et;
 PROCESS(udp_server_process, "1");
 AUTOSTART_PROCESSES(&udp_server_process);
 /*---------------------------------------------------------------------------*/
+static int
+prf_reinit(char *output, char *key, int key_length, char *label,
+           char *seed, int seed_length, int output_length)
+{
+  unsigned char A[32];
+  hmac_sha256_ctx c;
+  int current_length = 0;
+  int min;
+
+  hmac_sha256_init(&c, (unsigned char *)key, key_length);
+  hmac_sha256_update(&c, (unsigned char *)label, strlen(label));
+  hmac_sha256_update(&c, (unsigned char *)seed, seed_length);
+  hmac_sha256_final(&c, A, 32);
+  while(current_length < output_length) {
+    hmac_sha256_reinit(&c);
+    hmac_sha256_update(&c, A, 32);
+    hmac_sha256_update(&c, (unsigned char *)label, strlen(label));
+    hmac_sha256_update(&c, (unsigned char *)seed, seed_length);
+    min = output_length - current_length < 32 ? output_length - current_length : 32;
+    hmac_sha256_final(&c, (unsigned char *)output + current_length, min);
+    hmac_sha256_reinit(&c);
+    hmac_sha256_update(&c, A, 32);
+    hmac_sha256_final(&c, A, 32);
+    current_length += 32;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static char premaster[22];
+static char randoms[64];
+static char handshake_hash[32];
+static char master[48];
+static char key_block[40];
+static char client_finished[12];
+static char server_finished[12];
+static char check[12 + 12 + 40];
+
+static void
+handshake_reinit(void)
+{
+  prf_reinit(master, premaster, 22, "master secret", randoms, 64, 48);
+  prf_reinit(key_block, master, 48, "key expansion", randoms, 64, 40);
+  prf_reinit(client_finished, master, 48, "client finished", handshake_hash, 32, 12);
+  prf_reinit(server_finished, master, 48, "server finished", handshake_hash, 32, 12);
+}
 
+static void
+handshake_keyed(void)
+{
+  hmac_sha256_key key;
+
+  PRF_key(&key, premaster, 22);
+  PRF_keyed(master, &key, "master secret", randoms, 64, 48);
+  PRF_key(&key, master, 48);
+  PRF_keyed(key_block, &key, "key expansion", randoms, 64, 40);
+  PRF_keyed(client_finished, &key, "client finished", handshake_hash, 32, 12);
+  PRF_keyed(server_finished, &key, "server finished", handshake_hash, 32, 12);
+}
+
+static void
+run(char *name, void (*handshake)(void))
+{
+  unsigned long ticks = 0;
+  unsigned long blocks = sha256_blocks;
+  rtimer_clock_t t;
+  uint8_t i;
+
+  for(i = 0; i < ITERATIONS; i++) {
+    t = RTIMER_NOW();
+    handshake();
+    ticks += (rtimer_clock_t)(RTIMER_NOW() - t);
+  }
+  printf("%s: %lu compressions, %lu rtimer ticks per handshake\n", name,
+         (sha256_blocks - blocks) / ITERATIONS, ticks / ITERATIONS);
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_server_process, ev, data)
 {
+  uint8_t i;
 
   PROCESS_BEGIN();
 
   etimer_set(&et, CLOCK_CONF_SECOND*3);
   PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
-  hmac_sha256("",0,"",0,"",0);
+
+  for(i = 0; i < sizeof(premaster); i++) {
+    premaster[i] = i;
+  }
+  for(i = 0; i < sizeof(randoms); i++) {
+    randoms[i] = i * 7;
+  }
+  for(i = 0; i < sizeof(handshake_hash); i++) {
+    handshake_hash[i] = i * 13;
+  }
+
+  run("reinit", handshake_reinit);
+  memcpy(check, client_finished, 12);
+  memcpy(check + 12, server_finished, 12);
+  memcpy(check + 24, key_block, 40);
+  run("keyed", handshake_keyed);
+  printf("outputs %s\n", memcmp(check, client_finished, 12) == 0 &&
+         memcmp(check + 12, server_finished, 12) == 0 &&
+         memcmp(check + 24, key_block, 40) == 0 ? "match" : "DIFFER");
 
   PROCESS_END();
 }
@@ -0,0 +1,73 @@
+#include "contiki.h"
+#include "contiki-net.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "dtls.h"
+
+/*
+ * Measures dtls_get_peer(), the lookup dtls_handle_message() does for
+ * every received record, with DTLS_PEER_MAX peers in the table. The time
+ * per lookup should not depend on DTLS_PEER_MAX, compare e.g. the output
+ * of make PEERS=4 and make PEERS=256 on the native platform.
+ */
+
+#define LOOKUPS 1000000UL
+
+PROCESS(peer_lookup_process, "Peer lookup benchmark");
+AUTOSTART_PROCESSES(&peer_lookup_process);
+/*---------------------------------------------------------------------------*/
+static int
+send_to_peer(struct dtls_context_t *ctx,
+             session_t *session, uint8 *data, size_t len)
+{
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_session(session_t *session, unsigned int i)
+{
+  memset(session, 0, sizeof(session_t));
+  uip_ip6addr(&session->addr, 0xaaaa, 0, 0, 0, 0, 0, i >> 8, i & 0xff);
+  session->port = UIP_HTONS(20220);
+  session->size = sizeof(session->addr) + sizeof(session->port);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(peer_lookup_process, ev, data)
+{
+  static dtls_context_t *ctx;
+  session_t session;
+  unsigned long n, found;
+  clock_time_t t;
+  unsigned int i;
+
+  PROCESS_BEGIN();
+
+  dtls_init();
+  ctx = dtls_new_context(NULL);
+  dtls_set_cb(ctx, send_to_peer, write);
+
+  for(i = 0; i < DTLS_PEER_MAX; i++) {
+    set_session(&session, i);
+    dtls_connect(ctx, &session);
+  }
+
+  found = 0;
+  t = clock_time();
+  for(n = 0; n < LOOKUPS; n++) {
+    /* every other lookup is for an unknown peer */
+    set_session(&session, (n >> 1) % DTLS_PEER_MAX + (n & 1) * DTLS_PEER_MAX);
+    if(dtls_get_peer(ctx, &session)) {
+      found++;
+    }
+  }
+  t = clock_time() - t;
+
+  printf("DTLS_PEER_MAX %u: %lu lookups (%lu hits) in %lu ticks, %lu ns each\n",
+         DTLS_PEER_MAX, LOOKUPS, found, (unsigned long)t,
+         (unsigned long)((double)t * 1e9 / CLOCK_SECOND / LOOKUPS));
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,195 @@
+/*
+ * psk-compile: turns the <psk> section of config.xml into the binary
+ * keystore that core/net/psk-store.c searches on the node.
+ *
+ *   <psk>
+ *     <psk-identity>thisisme</psk-identity><key>abcdefghijklmnopqrstuvwxyz123456</key>
+ *     ...
+ *   </psk>
+ *
+ * Usage: psk-compile config.xml psk.bin
+ *
+ * Copy the result to the node's file system as /psk.bin (or whatever
+ * PSK_STORE_CONF_FILE is set to), e.g. with coffee-manager.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_ENTRIES 4096
+
+struct entry {
+  uint32_t hash;
+  const char *identity;
+  int identity_length;
+  const char *key;
+  int key_length;
+};
+
+static struct entry entries[MAX_ENTRIES];
+static int count;
+/*---------------------------------------------------------------------------*/
+/* Same as psk_store_hash() in core/net/psk-store.c */
+static uint32_t
+hash(const char *identity, int length)
+{
+  uint32_t h = 2166136261UL;
+  int i;
+
+  for(i = 0; i < length; i++) {
+    h ^= (uint8_t)identity[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+static int
+compare(const void *a, const void *b)
+{
+  const struct entry *x = a, *y = b;
+
+  if(x->hash != y->hash) {
+    return x->hash < y->hash ? -1 : 1;
+  }
+  if(x->identity_length != y->identity_length) {
+    return x->identity_length - y->identity_length;
+  }
+  return memcmp(x->identity, y->identity, x->identity_length);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the text between <tag> and </tag> after *pos and moves *pos past it */
+static const char *
+element(const char **pos, const char *end, const char *tag, int *length)
+{
+  char open[32], close[32];
+  const char *start, *stop;
+
+  snprintf(open, sizeof(open), "<%s>", tag);
+  snprintf(close, sizeof(close), "</%s>", tag);
+  start = strstr(*pos, open);
+  if(start == NULL || (end != NULL && start > end)) {
+    return NULL;
+  }
+  start += strlen(open);
+  stop = strstr(start, close);
+  if(stop == NULL) {
+    return NULL;
+  }
+  *length = stop - start;
+  *pos = stop + strlen(close);
+  return start;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put16(FILE *f, unsigned v)
+{
+  putc((v >> 8) & 0xff, f);
+  putc(v & 0xff, f);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  FILE *f;
+  char *xml;
+  long size;
+  const char *pos, *end;
+  struct entry *e;
+  unsigned offset;
+  int i;
+
+  if(argc != 3) {
+    fprintf(stderr, "usage: %s config.xml psk.bin\n", argv[0]);
+    return 1;
+  }
+
+  f = fopen(argv[1], "rb");
+  if(f == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  xml = malloc(size + 1);
+  if(xml == NULL || fread(xml, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "%s: cannot read file\n", argv[1]);
+    return 1;
+  }
+  xml[size] = '\0';
+  fclose(f);
+
+  pos = strstr(xml, "<psk>");
+  if(pos == NULL) {
+    fprintf(stderr, "%s: no <psk> section\n", argv[1]);
+    return 1;
+  }
+  end = strstr(pos, "</psk>");
+
+  while(count < MAX_ENTRIES) {
+    e = &entries[count];
+    e->identity = element(&pos, end, "psk-identity", &e->identity_length);
+    if(e->identity == NULL) {
+      break;
+    }
+    e->key = element(&pos, end, "key", &e->key_length);
+    if(e->key == NULL) {
+      fprintf(stderr, "no <key> for identity %.*s\n",
+              e->identity_length, e->identity);
+      return 1;
+    }
+    if(e->identity_length > 255 || e->key_length > 255) {
+      fprintf(stderr, "identity %.*s: identity or key longer than 255 bytes\n",
+              e->identity_length, e->identity);
+      return 1;
+    }
+    e->hash = hash(e->identity, e->identity_length);
+    count++;
+  }
+  if(count == MAX_ENTRIES && element(&pos, end, "psk-identity", &i) != NULL) {
+    fprintf(stderr, "more than %d identities\n", MAX_ENTRIES);
+    return 1;
+  }
+
+  qsort(entries, count, sizeof(struct entry), compare);
+  for(i = 1; i < count; i++) {
+    if(compare(&entries[i - 1], &entries[i]) == 0) {
+      fprintf(stderr, "identity %.*s listed twice\n",
+              entries[i].identity_length, entries[i].identity);
+      return 1;
+    }
+  }
+
+  f = fopen(argv[2], "wb");
+  if(f == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+  fwrite("PSKS", 1, 4, f);
+  put16(f, count);
+  offset = 6 + 8 * count;
+  for(i = 0; i < count; i++) {
+    e = &entries[i];
+    if(offset > 0xffff) {
+      fprintf(stderr, "keystore larger than 64 kB\n");
+      return 1;
+    }
+    put16(f, e->hash >> 16);
+    put16(f, e->hash & 0xffff);
+    put16(f, offset);
+    putc(e->identity_length, f);
+    putc(e->key_length, f);
+    offset += e->identity_length + e->key_length;
+  }
+  for(i = 0; i < count; i++) {
+    fwrite(entries[i].identity, 1, entries[i].identity_length, f);
+    fwrite(entries[i].key, 1, entries[i].key_length, f);
+  }
+  fclose(f);
+
+  printf("%d identities, %u bytes\n", count, offset);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/